@@ -0,0 +1,148 @@
+//=================================================================================================
+//===
+//=== cotask.h
+//===
+//=== Copyright (c) 2020-2024 by RangeSoft.
+//=== All rights reserved.
+//===
+//=== Litvinov "VeduN" Vitaly
+//===
+//=================================================================================================
+#ifndef _SIMPLEUTILS_COTASK_H_
+#define _SIMPLEUTILS_COTASK_H_
+#pragma once
+
+#include <cstddef>
+#include <exception>
+#include <new>
+#include <coroutine>
+
+namespace su
+{
+
+// Allocator of the coroutine frames. The frames are taken from the thread local free lists
+// grouped by the size class, so the frame of the short coroutine doesn't touch the global heap.
+// A frame can be released on the other thread (the coroutine was resumed by the other worker),
+// in this case it will be cached by the releasing thread.
+class CoFramePool
+{
+public:
+    static void* allocate(size_t size)
+    {
+        size_t idx = sizeClass(size);
+
+        if (idx >= CountOfClasses)
+        {
+            return ::operator new(size);
+        }
+
+        auto& list = freeLists();
+        Block* block = list.m_heads[idx];
+
+        if (!block)
+        {
+            return ::operator new((idx + 1) * Granularity);
+        }
+
+        list.m_heads[idx] = block->m_next;
+        --list.m_counts[idx];
+
+        return block;
+    }
+
+    static void deallocate(void* ptr, size_t size) noexcept
+    {
+        size_t idx = sizeClass(size);
+
+        if (idx >= CountOfClasses)
+        {
+            ::operator delete(ptr);
+            return;
+        }
+
+        auto& list = freeLists();
+
+        if (list.m_counts[idx] >= MaxCachedFrames)
+        {
+            ::operator delete(ptr);
+            return;
+        }
+
+        Block* block = static_cast<Block*>(ptr);
+        block->m_next = list.m_heads[idx];
+        list.m_heads[idx] = block;
+        ++list.m_counts[idx];
+    }
+
+private:
+    static constexpr size_t Granularity = 64;
+    static constexpr size_t CountOfClasses = 32;
+    static constexpr size_t MaxCachedFrames = 256;
+
+    struct Block
+    {
+        Block* m_next;
+    };
+
+    struct FreeLists
+    {
+        ~FreeLists()
+        {
+            for (auto head : m_heads)
+            {
+                while (head)
+                {
+                    auto next = head->m_next;
+                    ::operator delete(head);
+                    head = next;
+                }
+            }
+        }
+
+        Block* m_heads[CountOfClasses] = { nullptr };
+        size_t m_counts[CountOfClasses] = { 0 };
+    };
+
+    static size_t sizeClass(size_t size)
+    {
+        return size ? (size - 1) / Granularity : 0;
+    }
+
+    static FreeLists& freeLists()
+    {
+        thread_local FreeLists lists;
+        return lists;
+    }
+};
+
+// Fire-and-forget coroutine. It is started immediately and destroys itself when finished.
+// The flow is moved between the threads by the awaiters (ThreadPool::schedule, ThreadPool::sleep_for,
+// Net::readable, ...), e.g.
+//
+// su::CoTask process(su::ThreadPool& pool, SOCKET socket)
+// {
+//     co_await pool.schedule();
+//     while (co_await su::Net::readable(pool, socket))
+//     {
+//         ...
+//     }
+// }
+class CoTask
+{
+public:
+    struct promise_type
+    {
+        CoTask get_return_object() noexcept { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { std::terminate(); }
+
+        static void* operator new(size_t size) { return CoFramePool::allocate(size); }
+        static void operator delete(void* ptr, size_t size) noexcept { CoFramePool::deallocate(ptr, size); }
+    };
+};
+
+} // namespace su
+
+#endif
@@ -12,6 +12,9 @@
 #define _SMALLUTILS_CRC_H_
 #pragma once
 
+#include <stdint.h>
+#include <stddef.h>
+
 /*
  * Define SMALLUTIL_CRC_AS_STATIC for using Crc class as static class. In this case you can
  * using only one version of Crc but extra memory for tables will not be allocated
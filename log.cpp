@@ -1,5 +1,5 @@
 
-#include "Log.h"
+#include "log.h"
 
 #include <ctime>
 #include <fstream>
@@ -76,16 +76,20 @@ void Log::put(Level level, const char* source, uint32_t lineno, const std::strin
     std::time_t t = std::time(nullptr);
     std::tm dt;
 
+#ifdef _WIN32
     localtime_s(&dt, &t);
+#else
+    localtime_r(&t, &dt);
+#endif
 
     if (m_isTimeStamp)
     {
-        sprintf_s(postfix, "_%04i.%02i.%02i", dt.tm_year + 1900, dt.tm_mon + 1, dt.tm_mday);
+        snprintf(postfix, sizeof(postfix), "_%04i.%02i.%02i", dt.tm_year + 1900, dt.tm_mon + 1, dt.tm_mday);
     }
 
     std::string filename = m_dir + m_filename + postfix + ".log";
 
-    sprintf_s(datetimeMark, "%02i.%02i.%04i %02i:%02i:%02i [%s:%c",
+    snprintf(datetimeMark, sizeof(datetimeMark), "%02i.%02i.%04i %02i:%02i:%02i [%s:%c",
         dt.tm_mday, dt.tm_mon + 1, dt.tm_year + 1900,
         dt.tm_hour, dt.tm_min, dt.tm_sec,
         m_name.c_str(),
@@ -0,0 +1,208 @@
+#include "net/awaitable.h"
+
+namespace su
+{
+namespace Net
+{
+
+// The longest sleep of the reactor without the waiters, it is woken by the registration anyway
+static constexpr uint32_t MaxWaitUSec = 1000000;
+
+SocketReactor& SocketReactor::instance()
+{
+    static SocketReactor reactor;
+    return reactor;
+}
+
+SocketReactor::SocketReactor()
+{
+    m_thread = std::thread(&SocketReactor::run, this);
+}
+
+SocketReactor::~SocketReactor()
+{
+    m_exit = true;
+    wake();
+
+    // the coroutines which are still waiting are dropped
+    m_thread.join();
+}
+
+void SocketReactor::add(Waiter& waiter)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_incoming.push_back(&waiter);
+    }
+    wake();
+}
+
+void SocketReactor::wake()
+{
+    m_poller.wake();
+}
+
+void SocketReactor::run()
+{
+    std::vector<Waiter*> incoming;
+
+    while (!m_exit)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            incoming.swap(m_incoming);
+        }
+
+        for (auto waiter : incoming)
+        {
+            registerWaiter(waiter);
+        }
+        incoming.clear();
+
+        if (m_poller.wait(m_events, timeout()) < 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        for (auto& event : m_events)
+        {
+            // The socket is ready for the awaited operation or failed, the failed one is ready for
+            // the reading if its pending data can be still read
+            auto item = static_cast<std::pair<const SOCKET, Registration>*>(event.m_data);
+            auto& registration = item->second;
+            bool isError = event.m_events & Poller::Error;
+
+            if (registration.m_reader && (event.m_events & (Poller::Read | Poller::Error)))
+            {
+                complete(registration.m_reader, event.m_events & Poller::Read);
+                registration.m_reader = nullptr;
+            }
+            if (registration.m_writer && ((event.m_events & Poller::Write) || isError))
+            {
+                complete(registration.m_writer, (event.m_events & Poller::Write) && !isError);
+                registration.m_writer = nullptr;
+            }
+
+            update(item->first, registration);
+        }
+
+        // The expired waiters
+        auto now = std::chrono::steady_clock::now();
+
+        while (m_deadlines.size() && m_deadlines.begin()->first <= now)
+        {
+            auto waiter = m_deadlines.begin()->second;
+            auto item = m_sockets.find(waiter->m_socket);
+
+            if (item != m_sockets.end())
+            {
+                (item->second.m_reader == waiter ? item->second.m_reader : item->second.m_writer) = nullptr;
+                complete(waiter, false);
+                update(item->first, item->second);
+            }
+            else
+            {
+                complete(waiter, false);
+            }
+        }
+
+        resume();
+    }
+}
+
+void SocketReactor::registerWaiter(Waiter* waiter)
+{
+    auto item = m_sockets.find(waiter->m_socket);
+    bool isNew = item == m_sockets.end();
+
+    if (isNew)
+    {
+        item = m_sockets.emplace(waiter->m_socket, Registration()).first;
+    }
+
+    Waiter*& slot = waiter->m_events == Poller::Read ? item->second.m_reader : item->second.m_writer;
+
+    // the same operation of the socket is awaited already, the second waiter fails
+    if (slot)
+    {
+        complete(waiter, false);
+        return;
+    }
+
+    slot = waiter;
+    m_waiters.emplace(waiter, m_deadlines.emplace(waiter->m_deadline, waiter));
+
+    uint32_t events = item->second.events();
+    // the closed socket is removed from epoll silently, so its number may be registered again
+    bool isAdded = isNew ? m_poller.add(waiter->m_socket, &*item, events, false) :
+                           m_poller.modify(waiter->m_socket, &*item, events, false) ||
+                           m_poller.add(waiter->m_socket, &*item, events, false);
+
+    // the socket isn't valid or can't be polled
+    if (!isAdded)
+    {
+        slot = nullptr;
+        complete(waiter, false);
+
+        if (isNew)
+        {
+            m_sockets.erase(item);
+        }
+    }
+}
+
+// The socket is polled only while it has the waiters, so it may be closed by the owner after that
+void SocketReactor::update(SOCKET socket, Registration& registration)
+{
+    uint32_t events = registration.events();
+
+    if (events)
+    {
+        m_poller.modify(socket, &*m_sockets.find(socket), events, false);
+        return;
+    }
+
+    m_poller.remove(socket);
+    m_sockets.erase(socket);
+}
+
+void SocketReactor::complete(Waiter* waiter, bool isReady)
+{
+    auto item = m_waiters.find(waiter);
+    if (item != m_waiters.end())
+    {
+        m_deadlines.erase(item->second);
+        m_waiters.erase(item);
+    }
+
+    waiter->m_isReady = isReady;
+    m_completed.push_back(waiter);
+}
+
+// The coroutines are resumed after their sockets have been unregistered, so the sockets may be closed by them.
+// The waiter belongs to the coroutine, it isn't touched after the posting.
+void SocketReactor::resume()
+{
+    for (auto waiter : m_completed)
+    {
+        waiter->m_pool->post([handle = waiter->m_handle]() { handle.resume(); });
+    }
+    m_completed.clear();
+}
+
+uint32_t SocketReactor::timeout() const
+{
+    if (m_deadlines.empty())
+    {
+        return MaxWaitUSec;
+    }
+
+    auto left = std::chrono::duration_cast<std::chrono::microseconds>(m_deadlines.begin()->first -
+                                                                      std::chrono::steady_clock::now()).count();
+
+    left = std::max<int64_t>(left, 0);
+    return static_cast<uint32_t>(std::min<int64_t>(left, MaxWaitUSec));
+}
+
+} // namespace Net
+} // namespace su
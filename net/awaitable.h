@@ -0,0 +1,135 @@
+#pragma once
+
+#include <chrono>
+#include <coroutine>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "threadpool.h"
+#include "net/net.h"
+#include "net/poller.h"
+
+namespace su
+{
+namespace Net
+{
+
+// The thread waiting for the readiness of the sockets of the awaiters (Poller: epoll or select()).
+// The socket is registered until it is ready, failed or the timeout is expired, then the coroutine
+// is posted to its pool. The thread sleeps until the nearest deadline or the next registration.
+class SocketReactor
+{
+public:
+    struct Waiter
+    {
+        ThreadPool* m_pool = nullptr;
+        std::coroutine_handle<> m_handle;
+        SOCKET m_socket = SOCKET_ERROR;
+        uint32_t m_events = Poller::None; // Poller::Read or Poller::Write
+        std::chrono::steady_clock::time_point m_deadline;
+        bool m_isReady = false;
+    };
+
+    static SocketReactor& instance();
+
+    SocketReactor();
+    ~SocketReactor();
+
+    SocketReactor(const SocketReactor&) = delete;
+    SocketReactor& operator=(const SocketReactor&) = delete;
+
+    // The waiter must live until its coroutine is resumed, the pool must outlive the waiting
+    void add(Waiter& waiter);
+
+private:
+    // The socket may be awaited by one reader and one writer at once
+    struct Registration
+    {
+        Waiter* m_reader = nullptr;
+        Waiter* m_writer = nullptr;
+
+        uint32_t events() const { return (m_reader ? uint32_t(Poller::Read) : 0u) | (m_writer ? uint32_t(Poller::Write) : 0u); }
+    };
+
+    using Deadlines = std::multimap<std::chrono::steady_clock::time_point, Waiter*>;
+
+    void run();
+    void wake();
+    void registerWaiter(Waiter* waiter);
+    void update(SOCKET socket, Registration& registration);
+    void complete(Waiter* waiter, bool isReady);
+    void resume();
+    uint32_t timeout() const;
+
+private:
+    Poller m_poller;
+    std::thread m_thread;
+    std::atomic<bool> m_exit = false;
+    std::mutex m_mutex;
+    std::vector<Waiter*> m_incoming;
+    // The state of the thread
+    std::unordered_map<SOCKET, Registration> m_sockets;
+    Deadlines m_deadlines;
+    std::unordered_map<Waiter*, Deadlines::iterator> m_waiters;
+    std::vector<Poller::Event> m_events;
+    std::vector<Waiter*> m_completed;
+};
+
+// co_await Net::readable(pool, socket) / co_await Net::writable(pool, socket)
+// The coroutine is suspended until the socket is ready or the timeout is expired and continued on
+// the pool worker. The readiness is reported by SocketReactor, so neither a worker nor a timer is busy
+// while waiting. Result of the co_await is true if the socket is ready and false on timeout or socket error.
+class SocketAwaiter
+{
+public:
+    enum class Event
+    {
+        Read,
+        Write,
+    };
+
+    SocketAwaiter(ThreadPool& pool, SOCKET socket, Event event, std::chrono::milliseconds timeout)
+    {
+        m_waiter.m_pool = &pool;
+        m_waiter.m_socket = socket;
+        m_waiter.m_events = event == Event::Read ? Poller::Read : Poller::Write;
+        m_waiter.m_deadline = std::chrono::steady_clock::now() + timeout;
+    }
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        m_waiter.m_handle = handle;
+        SocketReactor::instance().add(m_waiter);
+    }
+
+    bool await_resume() const noexcept
+    {
+        return m_waiter.m_isReady;
+    }
+
+private:
+    SocketReactor::Waiter m_waiter;
+};
+
+inline SocketAwaiter readable(ThreadPool& pool, SOCKET socket,
+                              std::chrono::milliseconds timeout = std::chrono::milliseconds(1000))
+{
+    return SocketAwaiter(pool, socket, SocketAwaiter::Event::Read, timeout);
+}
+
+inline SocketAwaiter writable(ThreadPool& pool, SOCKET socket,
+                              std::chrono::milliseconds timeout = std::chrono::milliseconds(1000))
+{
+    return SocketAwaiter(pool, socket, SocketAwaiter::Event::Write, timeout);
+}
+
+} // namespace Net
+} // namespace su
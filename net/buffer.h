@@ -0,0 +1,251 @@
+#pragma once
+
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+namespace su
+{
+namespace Net
+{
+
+// The read-only view of the bytes which shares the ownership of the storage,
+// so the consumer may keep the received data without copying
+class Bytes
+{
+public:
+    Bytes() = default;
+    Bytes(std::shared_ptr<const void> owner, const uint8_t* data, size_t size)
+        : m_owner(std::move(owner)), m_data(data), m_size(size) {}
+
+    static Bytes copy(const void* data, size_t size)
+    {
+        std::shared_ptr<uint8_t[]> storage(new uint8_t[size ? size : 1]);
+        memcpy(storage.get(), data, size);
+
+        auto ptr = storage.get();
+        return Bytes(std::move(storage), ptr, size);
+    }
+
+    static Bytes take(std::vector<uint8_t>&& data)
+    {
+        auto storage = std::make_shared<std::vector<uint8_t>>(std::move(data));
+
+        auto ptr = storage->data();
+        auto size = storage->size();
+        return Bytes(std::move(storage), ptr, size);
+    }
+
+    const uint8_t* data() const { return m_data; }
+    size_t size() const { return m_size; }
+    bool empty() const { return !m_size; }
+
+    const uint8_t* begin() const { return m_data; }
+    const uint8_t* end() const { return m_data + m_size; }
+    uint8_t operator[](size_t index) const { return m_data[index]; }
+
+    Bytes slice(size_t offset, size_t size) const
+    {
+        if (offset > m_size)
+        {
+            return Bytes();
+        }
+        return Bytes(m_owner, m_data + offset, size < m_size - offset ? size : m_size - offset);
+    }
+
+    std::vector<uint8_t> toVector() const { return std::vector<uint8_t>(begin(), end()); }
+
+private:
+    std::shared_ptr<const void> m_owner;
+    const uint8_t* m_data = nullptr;
+    size_t m_size = 0;
+};
+
+#if defined(__SANITIZE_THREAD__)
+#define SU_NET_TSAN 1
+#elif defined(__has_feature)
+#if __has_feature(thread_sanitizer)
+#define SU_NET_TSAN 1
+#endif
+#endif
+
+// True if the pointer is the only owner of the storage, then the reads of the released owners happen before
+// the rewriting: the releases of the counter are synchronized by the acquire fence after reading it
+template <typename T>
+inline bool isSoleOwner(const std::shared_ptr<T>& ptr)
+{
+    if (ptr.use_count() != 1)
+    {
+        return false;
+    }
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+#ifdef SU_NET_TSAN
+    // ThreadSanitizer doesn't see the fences, the copy is the read-modify-write of the counter it does see
+    std::shared_ptr<T> probe = ptr;
+#endif
+    return true;
+}
+
+// The pool of the writable buffers of the owner. The buffer is handed out as the Bytes after filling
+// and returns to the pool when the last view is released, so the steady flow doesn't allocate.
+// The pool is used by one thread. The buffers grown over maxBufferSize aren't reused.
+class BufferPool
+{
+public:
+    explicit BufferPool(size_t maxCount = 64, size_t maxBufferSize = 1024 * 1024)
+        : m_maxCount(maxCount), m_maxBufferSize(maxBufferSize) {}
+
+    // The empty buffer with at least `capacity` bytes reserved
+    std::shared_ptr<std::vector<uint8_t>> acquire(size_t capacity)
+    {
+        for (size_t ii = 0; ii < m_buffers.size(); ++ii)
+        {
+            auto& buffer = m_buffers[(m_next + ii) % m_buffers.size()];
+
+            if (isSoleOwner(buffer))
+            {
+                m_next = (m_next + ii + 1) % m_buffers.size();
+
+                if (buffer->capacity() > m_maxBufferSize)
+                {
+                    buffer = std::make_shared<std::vector<uint8_t>>();
+                }
+
+                buffer->clear();
+                buffer->reserve(capacity);
+                return buffer;
+            }
+        }
+
+        auto buffer = std::make_shared<std::vector<uint8_t>>();
+        buffer->reserve(capacity);
+
+        if (m_buffers.size() < m_maxCount)
+        {
+            m_buffers.push_back(buffer);
+        }
+        return buffer;
+    }
+
+    static Bytes view(const std::shared_ptr<std::vector<uint8_t>>& buffer)
+    {
+        return Bytes(buffer, buffer->data(), buffer->size());
+    }
+
+private:
+    std::vector<std::shared_ptr<std::vector<uint8_t>>> m_buffers;
+    size_t m_maxCount;
+    size_t m_maxBufferSize;
+    size_t m_next = 0;
+};
+
+// The receive buffer of the thread. The data is read into the free tail of the current block and
+// handed out as the Bytes sharing the block. The block is reused as soon as nobody keeps its data,
+// otherwise the new one is allocated. The memory isn't zero-filled.
+// One kept view pins its whole block, so the slow consumers could pin many blocks: when MaxPinnedBlocks
+// replaced blocks are still kept, the committed data is copied out of the slab until some of them are released.
+class RecvSlab
+{
+public:
+    static constexpr size_t BlockSize = 1024 * 1024;
+    static constexpr size_t MinFree = 16 * 1024;
+    static constexpr size_t MaxPinnedBlocks = 8;
+
+    static RecvSlab& local()
+    {
+        thread_local RecvSlab slab;
+        return slab;
+    }
+
+    // Returns at least minSize (or MinFree) contiguous bytes, size is updated to the available size
+    uint8_t* reserve(size_t minSize, size_t& size)
+    {
+        minSize = minSize > MinFree ? minSize : MinFree;
+        size_t blockSize = minSize > BlockSize ? minSize : BlockSize;
+
+        if (m_block && isSoleOwner(m_block))
+        {
+            m_used = 0;
+        }
+
+        if (!m_block || m_capacity - m_used < minSize)
+        {
+            if (m_block && !isSoleOwner(m_block))
+            {
+                m_pinned.push_back(std::move(m_block));
+            }
+
+            if (!m_block || m_capacity < blockSize)
+            {
+                m_block.reset(new uint8_t[blockSize]);
+                m_capacity = blockSize;
+            }
+            m_used = 0;
+        }
+
+        releasePinned();
+
+        size = size < m_capacity - m_used ? size : m_capacity - m_used;
+        return m_block.get() + m_used;
+    }
+
+    // The bytes which have been written into the reserved space
+    Bytes commit(size_t size)
+    {
+        // the current block isn't pinned while the others are kept
+        if (isCopying())
+        {
+            return Bytes::copy(m_block.get() + m_used, size);
+        }
+
+        Bytes out(m_block, m_block.get() + m_used, size);
+
+        // the next data starts from the cache line
+        m_used += (size + 63) & ~size_t(63);
+        m_used = m_used < m_capacity ? m_used : m_capacity;
+        return out;
+    }
+
+    Bytes copy(const void* data, size_t size)
+    {
+        if (size > BlockSize / 4)
+        {
+            return Bytes::copy(data, size);
+        }
+
+        size_t available = size;
+        memcpy(reserve(size, available), data, size);
+        return commit(size);
+    }
+
+    bool isCopying() const { return m_pinned.size() >= MaxPinnedBlocks; }
+
+private:
+    // The replaced blocks which are still kept by the consumers
+    void releasePinned()
+    {
+        for (size_t ii = 0; ii < m_pinned.size();)
+        {
+            if (isSoleOwner(m_pinned[ii]))
+            {
+                m_pinned[ii] = std::move(m_pinned.back());
+                m_pinned.pop_back();
+                continue;
+            }
+            ++ii;
+        }
+    }
+
+private:
+    std::shared_ptr<uint8_t[]> m_block;
+    size_t m_capacity = 0;
+    size_t m_used = 0;
+    std::vector<std::shared_ptr<uint8_t[]>> m_pinned;
+};
+
+} // namespace Net
+} // namespace su
@@ -0,0 +1,103 @@
+#include "net/checksum.h"
+
+#include <cstring>
+#include "crc.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <nmmintrin.h>
+#define SU_NET_CRC32C_SSE42
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define SU_NET_CRC32C_ARM
+#endif
+
+namespace su
+{
+namespace Net
+{
+
+static uint32_t crc32cTable(const void* data, size_t size)
+{
+    // the table is only read after the initialization
+    static Crc32 crc(Polynomial::CRC32_C);
+    return crc.get(data, size);
+}
+
+#ifdef SU_NET_CRC32C_SSE42
+
+// The instructions are enabled for these functions only, the CPU is checked at runtime
+__attribute__((target("sse4.2")))
+static uint32_t crc32cHardware(const void* data, size_t size)
+{
+    auto ptr = static_cast<const uint8_t*>(data);
+    uint64_t crc = 0xffffffff;
+
+    for (; size >= 8; size -= 8, ptr += 8)
+    {
+        uint64_t value;
+        memcpy(&value, ptr, sizeof(value));
+        crc = _mm_crc32_u64(crc, value);
+    }
+
+    for (; size; --size, ++ptr)
+    {
+        crc = _mm_crc32_u8(static_cast<uint32_t>(crc), *ptr);
+    }
+
+    return static_cast<uint32_t>(crc) ^ 0xffffffff;
+}
+
+bool hasHardwareCrc32c()
+{
+    static const bool isSupported = __builtin_cpu_supports("sse4.2");
+    return isSupported;
+}
+
+#elif defined(SU_NET_CRC32C_ARM)
+
+static uint32_t crc32cHardware(const void* data, size_t size)
+{
+    auto ptr = static_cast<const uint8_t*>(data);
+    uint32_t crc = 0xffffffff;
+
+    for (; size >= 8; size -= 8, ptr += 8)
+    {
+        uint64_t value;
+        memcpy(&value, ptr, sizeof(value));
+        crc = __crc32cd(crc, value);
+    }
+
+    for (; size; --size, ++ptr)
+    {
+        crc = __crc32cb(crc, *ptr);
+    }
+
+    return crc ^ 0xffffffff;
+}
+
+bool hasHardwareCrc32c()
+{
+    return true;
+}
+
+#else
+
+static uint32_t crc32cHardware(const void* data, size_t size)
+{
+    return crc32cTable(data, size);
+}
+
+bool hasHardwareCrc32c()
+{
+    return false;
+}
+
+#endif
+
+uint32_t crc32c(const void* data, size_t size)
+{
+    return hasHardwareCrc32c() ? crc32cHardware(data, size) : crc32cTable(data, size);
+}
+
+} // namespace Net
+} // namespace su
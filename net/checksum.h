@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace su
+{
+namespace Net
+{
+
+// The checksum algorithms of the packets
+enum class Checksum : uint8_t
+{
+    Crc32 = 0,  // CRC32 IEEE by the table, understood by all peers
+    Crc32C = 1, // CRC32C (Castagnoli), SSE4.2 or ARMv8 CRC instructions when the CPU has them
+    None = 2,   // the payload isn't checked, for the trusted links only
+};
+
+// CRC32C with the initial value and the final xor of 0xffffffff, the same as su::Crc32(CRC32_C)
+uint32_t crc32c(const void* data, size_t size);
+
+// The CPU computes CRC32C by the instructions
+bool hasHardwareCrc32c();
+
+} // namespace Net
+} // namespace su
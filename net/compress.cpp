@@ -0,0 +1,273 @@
+#include "net/compress.h"
+
+#include <cstring>
+
+namespace su
+{
+namespace Net
+{
+
+static constexpr size_t MinMatch = 4;
+// The last bytes are the literals and the last match starts before MatchLimit bytes to the end
+static constexpr size_t LastLiterals = 5;
+static constexpr size_t MatchLimit = 12;
+static constexpr size_t MaxOffset = 65535;
+static constexpr uint32_t HashLog = 12;
+
+static uint32_t read32(const uint8_t* ptr)
+{
+    uint32_t value;
+    memcpy(&value, ptr, sizeof(value));
+    return value;
+}
+
+static uint32_t hash(uint32_t sequence)
+{
+    return (sequence * 2654435761u) >> (32 - HashLog);
+}
+
+namespace
+{
+
+class Writer
+{
+public:
+    Writer(uint8_t* dst, size_t capacity) : m_ptr(dst), m_end(dst + capacity) {}
+
+    bool putByte(uint8_t value)
+    {
+        if (m_ptr == m_end)
+        {
+            return false;
+        }
+        *m_ptr++ = value;
+        return true;
+    }
+
+    // The rest of the length over 15 is written by the bytes of 255 and the remainder
+    bool putLength(size_t length)
+    {
+        for (; length >= 255; length -= 255)
+        {
+            if (!putByte(255))
+            {
+                return false;
+            }
+        }
+        return putByte(static_cast<uint8_t>(length));
+    }
+
+    bool put(const uint8_t* data, size_t size)
+    {
+        if (!size)
+        {
+            return true;
+        }
+
+        if (size_t(m_end - m_ptr) < size)
+        {
+            return false;
+        }
+        memcpy(m_ptr, data, size);
+        m_ptr += size;
+        return true;
+    }
+
+    // The literals and the match, matchSize 0 - the last literals without the match
+    bool putSequence(const uint8_t* literals, size_t literalSize, size_t offset, size_t matchSize)
+    {
+        size_t matchCode = matchSize ? matchSize - MinMatch : 0;
+        size_t literalCode = literalSize < 15 ? literalSize : 15;
+        uint8_t token = static_cast<uint8_t>((literalCode << 4) | (matchCode < 15 ? matchCode : 15));
+
+        if (!putByte(token))
+        {
+            return false;
+        }
+
+        if (literalSize >= 15 && !putLength(literalSize - 15))
+        {
+            return false;
+        }
+
+        if (!put(literals, literalSize))
+        {
+            return false;
+        }
+
+        if (!matchSize)
+        {
+            return true;
+        }
+
+        if (!putByte(static_cast<uint8_t>(offset)) || !putByte(static_cast<uint8_t>(offset >> 8)))
+        {
+            return false;
+        }
+        return matchCode < 15 || putLength(matchCode - 15);
+    }
+
+    uint8_t* ptr() const { return m_ptr; }
+
+private:
+    uint8_t* m_ptr;
+    uint8_t* m_end;
+};
+
+} // namespace
+
+size_t lzCompressBound(size_t size)
+{
+    return size + size / 255 + 16;
+}
+
+size_t lzCompress(const void* src, size_t size, void* dst, size_t capacity)
+{
+    auto in = static_cast<const uint8_t*>(src);
+    Writer out(static_cast<uint8_t*>(dst), capacity);
+    size_t anchor = 0;
+
+    if (size > MatchLimit)
+    {
+        // the positions of the last sequences by their hashes, the table lives on the thread stack
+        uint32_t table[1 << HashLog] = { 0 };
+        size_t pos = 0;
+        size_t limit = size - MatchLimit;
+
+        while (pos < limit)
+        {
+            uint32_t sequence = read32(in + pos);
+            uint32_t& slot = table[hash(sequence)];
+            size_t candidate = slot;
+
+            slot = static_cast<uint32_t>(pos);
+
+            if (candidate >= pos || pos - candidate > MaxOffset || read32(in + candidate) != sequence)
+            {
+                // the data without matches is skipped faster
+                pos += 1 + ((pos - anchor) >> 6);
+                continue;
+            }
+
+            // the match is extended backward over the literals and forward up to the last literals
+            while (pos > anchor && candidate > 0 && in[pos - 1] == in[candidate - 1])
+            {
+                --pos;
+                --candidate;
+            }
+
+            size_t matchSize = MinMatch;
+            while (pos + matchSize < size - LastLiterals && in[candidate + matchSize] == in[pos + matchSize])
+            {
+                ++matchSize;
+            }
+
+            if (!out.putSequence(in + anchor, pos - anchor, pos - candidate, matchSize))
+            {
+                return 0;
+            }
+
+            pos += matchSize;
+            anchor = pos;
+        }
+    }
+
+    if (!out.putSequence(in + anchor, size - anchor, 0, 0))
+    {
+        return 0;
+    }
+    return out.ptr() - static_cast<uint8_t*>(dst);
+}
+
+bool lzDecompress(const void* src, size_t size, void* dst, size_t dstSize)
+{
+    auto in = static_cast<const uint8_t*>(src);
+    auto inEnd = in + size;
+    auto out = static_cast<uint8_t*>(dst);
+    size_t pos = 0;
+
+    auto readLength = [&in, inEnd](size_t& length) -> bool
+    {
+        uint8_t value = 255;
+
+        while (value == 255)
+        {
+            if (in == inEnd)
+            {
+                return false;
+            }
+            value = *in++;
+            length += value;
+        }
+        return true;
+    };
+
+    while (in < inEnd)
+    {
+        uint8_t token = *in++;
+        size_t literalSize = token >> 4;
+
+        if (literalSize == 15 && !readLength(literalSize))
+        {
+            return false;
+        }
+
+        if (size_t(inEnd - in) < literalSize || dstSize - pos < literalSize)
+        {
+            return false;
+        }
+
+        if (literalSize)
+        {
+            memcpy(out + pos, in, literalSize);
+        }
+        in += literalSize;
+        pos += literalSize;
+
+        // the last sequence has no match
+        if (in == inEnd)
+        {
+            break;
+        }
+
+        if (inEnd - in < 2)
+        {
+            return false;
+        }
+
+        size_t offset = in[0] | (size_t(in[1]) << 8);
+        in += 2;
+
+        size_t matchSize = token & 15;
+        if (matchSize == 15 && !readLength(matchSize))
+        {
+            return false;
+        }
+        matchSize += MinMatch;
+
+        if (!offset || offset > pos || dstSize - pos < matchSize)
+        {
+            return false;
+        }
+
+        // the overlapped match repeats the bytes which have been just written
+        uint8_t* from = out + pos - offset;
+        if (offset >= matchSize)
+        {
+            memcpy(out + pos, from, matchSize);
+        }
+        else
+        {
+            for (size_t ii = 0; ii < matchSize; ++ii)
+            {
+                out[pos + ii] = from[ii];
+            }
+        }
+        pos += matchSize;
+    }
+
+    return pos == dstSize;
+}
+
+} // namespace Net
+} // namespace su
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace su
+{
+namespace Net
+{
+
+// The fast LZ77 compression in the LZ4 block format: the sequences of the literals and the matches
+// with 16-bit offsets. There are no frame headers, the decompressed size is kept by the caller.
+
+// The maximum compressed size of the data, the compression into such buffer always succeeds
+size_t lzCompressBound(size_t size);
+
+// Returns the compressed size or 0 if the result doesn't fit into the capacity
+size_t lzCompress(const void* src, size_t size, void* dst, size_t capacity);
+
+// The data must be decompressed into exactly dstSize bytes, the broken data is detected
+bool lzDecompress(const void* src, size_t size, void* dst, size_t dstSize);
+
+} // namespace Net
+} // namespace su
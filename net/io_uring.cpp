@@ -0,0 +1,283 @@
+#include "net/io_uring.h"
+
+#ifdef SU_NET_IOURING
+
+#include <algorithm>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+
+namespace su
+{
+namespace Net
+{
+
+IoUring::~IoUring()
+{
+    if (m_sqes)
+    {
+        ::munmap(m_sqes, m_sqesSize);
+    }
+
+    if (m_sqRing)
+    {
+        ::munmap(m_sqRing, m_sqRingSize);
+    }
+
+    if (m_fd >= 0)
+    {
+        ::close(m_fd);
+    }
+}
+
+bool IoUring::isSupported()
+{
+    static const bool isSupported = []()
+    {
+        // the multishot recv is available since 6.0
+        utsname name;
+        int major = 0;
+        int minor = 0;
+
+        if (::uname(&name) != 0 || sscanf(name.release, "%d.%d", &major, &minor) != 2 || major < 6)
+        {
+            return false;
+        }
+
+        IoUring test;
+        if (!test.init(4))
+        {
+            return false;
+        }
+
+        const size_t size = sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op);
+        std::vector<uint8_t> buff(size, 0);
+        auto probe = reinterpret_cast<io_uring_probe*>(buff.data());
+
+        if (::syscall(__NR_io_uring_register, test.m_fd, IORING_REGISTER_PROBE, probe, 256) < 0)
+        {
+            return false;
+        }
+
+        for (auto op : { IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SENDMSG, IORING_OP_ASYNC_CANCEL, IORING_OP_PROVIDE_BUFFERS })
+        {
+            if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }();
+
+    return isSupported;
+}
+
+bool IoUring::init(uint32_t entries)
+{
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    m_fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+    if (m_fd < 0)
+    {
+        return false;
+    }
+
+    m_features = params.features;
+    if (!(m_features & IORING_FEAT_SINGLE_MMAP) || !(m_features & IORING_FEAT_EXT_ARG))
+    {
+        ::close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+
+    // The SQ and CQ rings share the one mapping
+    m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    m_sqRingSize = m_sqRingSize > m_cqRingSize ? m_sqRingSize : m_cqRingSize;
+
+    m_sqRing = ::mmap(nullptr, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+    if (m_sqRing == MAP_FAILED)
+    {
+        m_sqRing = nullptr;
+        return false;
+    }
+    m_cqRing = m_sqRing;
+
+    m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    m_sqes = static_cast<io_uring_sqe*>(::mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES));
+    if (m_sqes == MAP_FAILED)
+    {
+        m_sqes = nullptr;
+        return false;
+    }
+
+    auto sq = static_cast<uint8_t*>(m_sqRing);
+    m_sqHead = reinterpret_cast<uint32_t*>(sq + params.sq_off.head);
+    m_sqTail = reinterpret_cast<uint32_t*>(sq + params.sq_off.tail);
+    m_sqMask = reinterpret_cast<uint32_t*>(sq + params.sq_off.ring_mask);
+    m_sqEntries = reinterpret_cast<uint32_t*>(sq + params.sq_off.ring_entries);
+    m_sqArray = reinterpret_cast<uint32_t*>(sq + params.sq_off.array);
+    m_sqLocalTail = *m_sqTail;
+    m_sqSubmitted = m_sqLocalTail;
+
+    auto cq = static_cast<uint8_t*>(m_cqRing);
+    m_cqHead = reinterpret_cast<uint32_t*>(cq + params.cq_off.head);
+    m_cqTail = reinterpret_cast<uint32_t*>(cq + params.cq_off.tail);
+    m_cqMask = reinterpret_cast<uint32_t*>(cq + params.cq_off.ring_mask);
+    m_cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    return true;
+}
+
+bool IoUring::initBuffers(uint16_t group, uint32_t count, uint32_t size)
+{
+    if (!count || count > 0x10000 || !size)
+    {
+        return false;
+    }
+
+    m_bufferSize = size;
+    m_bufferGroup = group;
+    m_buffers.resize(static_cast<size_t>(count) * size);
+
+    for (uint32_t bid = 0; bid < count; ++bid)
+    {
+        m_recycled.push_back(static_cast<uint16_t>(bid));
+    }
+    provideBuffers();
+
+    // The buffers must be accepted before the first receiving, all of them are provided by one request
+    if (enter(flush(), 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0)
+    {
+        return false;
+    }
+
+    uint32_t head = *m_cqHead;
+    if (head == __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE))
+    {
+        return false;
+    }
+
+    int32_t result = m_cqes[head & *m_cqMask].res;
+    __atomic_store_n(m_cqHead, head + 1, __ATOMIC_RELEASE);
+
+    return result >= 0;
+}
+
+void IoUring::provideBuffers()
+{
+    if (m_recycled.empty())
+    {
+        return;
+    }
+
+    std::sort(m_recycled.begin(), m_recycled.end());
+
+    size_t first = 0;
+    size_t pos = 0;
+
+    while (first < m_recycled.size())
+    {
+        for (pos = first + 1; pos < m_recycled.size() && m_recycled[pos] == m_recycled[pos - 1] + 1; ++pos)
+        {
+        }
+
+        auto sqe = getSqe();
+        if (!sqe)
+        {
+            break;
+        }
+
+        sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+        sqe->fd = static_cast<int32_t>(pos - first);
+        sqe->addr = reinterpret_cast<uint64_t>(buffer(m_recycled[first]));
+        sqe->len = m_bufferSize;
+        sqe->off = m_recycled[first];
+        sqe->buf_group = m_bufferGroup;
+        sqe->user_data = InternalData;
+
+        first = pos;
+    }
+
+    m_recycled.erase(m_recycled.begin(), m_recycled.begin() + first);
+}
+
+io_uring_sqe* IoUring::getSqe()
+{
+    if (m_sqLocalTail - __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE) >= *m_sqEntries)
+    {
+        enter(flush(), 0, 0, nullptr, 0);
+
+        if (m_sqLocalTail - __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE) >= *m_sqEntries)
+        {
+            return nullptr;
+        }
+    }
+
+    auto sqe = &m_sqes[m_sqLocalTail & *m_sqMask];
+    memset(sqe, 0, sizeof(*sqe));
+    ++m_sqLocalTail;
+
+    return sqe;
+}
+
+uint32_t IoUring::flush()
+{
+    uint32_t count = m_sqLocalTail - m_sqSubmitted;
+
+    for (uint32_t ii = m_sqSubmitted; ii != m_sqLocalTail; ++ii)
+    {
+        m_sqArray[ii & *m_sqMask] = ii & *m_sqMask;
+    }
+
+    __atomic_store_n(m_sqTail, m_sqLocalTail, __ATOMIC_RELEASE);
+    m_sqSubmitted = m_sqLocalTail;
+
+    return count;
+}
+
+int IoUring::submitAndWait(uint32_t timeoutUSec)
+{
+    provideBuffers();
+
+    uint32_t count = flush();
+
+    if (!timeoutUSec)
+    {
+        return count ? enter(count, 0, 0, nullptr, 0) : 0;
+    }
+
+    __kernel_timespec ts;
+    ts.tv_sec = timeoutUSec / 1000000;
+    ts.tv_nsec = (timeoutUSec % 1000000) * 1000;
+
+    io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    arg.sigmask_sz = _NSIG / 8;
+    arg.ts = reinterpret_cast<uint64_t>(&ts);
+
+    int result = enter(count, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+
+    return result == -ETIME ? 0 : result;
+}
+
+int IoUring::enter(uint32_t toSubmit, uint32_t minComplete, uint32_t flags, void* arg, size_t argSize)
+{
+    long result = ::syscall(__NR_io_uring_enter, m_fd, toSubmit, minComplete, flags, arg, argSize);
+
+    if (result < 0)
+    {
+        return errno == EINTR ? 0 : -errno;
+    }
+    return static_cast<int>(result);
+}
+
+} // namespace Net
+} // namespace su
+
+#endif
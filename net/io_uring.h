@@ -0,0 +1,164 @@
+#pragma once
+
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+#include "net/buffer.h"
+#include "net/platform.h"
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define SU_NET_IOURING
+#include <linux/io_uring.h>
+#include <sys/uio.h>
+#endif
+
+namespace su
+{
+namespace Net
+{
+
+class Node;
+
+#ifdef SU_NET_IOURING
+
+// The minimal io_uring wrapper over the raw system calls (liburing is not required).
+// Besides the submission and completion rings it owns one group of the provided buffers for the receiving.
+class IoUring
+{
+public:
+    IoUring() = default;
+    virtual ~IoUring();
+
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    // The kernel supports everything used by the TcpServer: multishot accept/recv,
+    // provided buffers and the waiting with timeout
+    static bool isSupported();
+
+    bool init(uint32_t entries);
+    bool isValid() const { return m_fd >= 0; }
+
+    // The buffers are provided by IORING_OP_PROVIDE_BUFFERS, the registered buffer rings
+    // are not used as they are not reliable on some kernels
+    bool initBuffers(uint16_t group, uint32_t count, uint32_t size);
+    uint16_t bufferGroup() const { return m_bufferGroup; }
+    uint8_t* buffer(uint16_t bid) { return m_buffers.data() + static_cast<size_t>(bid) * m_bufferSize; }
+
+    // The recycled buffers are given back to the kernel by provideBuffers() or submitAndWait(),
+    // the consecutive buffers are merged into one request
+    void recycleBuffer(uint16_t bid) { m_recycled.push_back(bid); }
+    void provideBuffers();
+
+    // user_data of the internal requests, the completions are skipped by forEachCqe()
+    static const uint64_t InternalData = 0;
+
+    // Returns nullptr if the submission queue is full even after the submitting
+    io_uring_sqe* getSqe();
+
+    // Submit the queued entries and wait for at least one completion or the timeout
+    int submitAndWait(uint32_t timeoutUSec);
+
+    // Call func(const io_uring_cqe&) for every completion, returns the count of completions
+    template <typename Func>
+    uint32_t forEachCqe(Func func)
+    {
+        uint32_t head = *m_cqHead;
+        uint32_t tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+        uint32_t count = 0;
+
+        while (head != tail)
+        {
+            auto& cqe = m_cqes[head & *m_cqMask];
+            if (cqe.user_data != InternalData)
+            {
+                func(cqe);
+            }
+            ++head;
+            ++count;
+        }
+
+        __atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+        return count;
+    }
+
+private:
+    int enter(uint32_t toSubmit, uint32_t minComplete, uint32_t flags, void* arg, size_t argSize);
+    uint32_t flush();
+
+private:
+    int m_fd = -1;
+    uint32_t m_features = 0;
+
+    void* m_sqRing = nullptr;
+    size_t m_sqRingSize = 0;
+    void* m_cqRing = nullptr;
+    size_t m_cqRingSize = 0;
+    io_uring_sqe* m_sqes = nullptr;
+    size_t m_sqesSize = 0;
+
+    uint32_t* m_sqHead = nullptr;
+    uint32_t* m_sqTail = nullptr;
+    uint32_t* m_sqMask = nullptr;
+    uint32_t* m_sqEntries = nullptr;
+    uint32_t* m_sqArray = nullptr;
+    uint32_t m_sqLocalTail = 0;
+    uint32_t m_sqSubmitted = 0;
+
+    uint32_t* m_cqHead = nullptr;
+    uint32_t* m_cqTail = nullptr;
+    uint32_t* m_cqMask = nullptr;
+    io_uring_cqe* m_cqes = nullptr;
+
+    uint32_t m_bufferSize = 0;
+    uint16_t m_bufferGroup = 0;
+    std::vector<uint8_t> m_buffers;
+    std::vector<uint16_t> m_recycled;
+};
+
+#endif
+
+// The state of the io_uring engine of the TcpServer
+struct UringState
+{
+#ifdef SU_NET_IOURING
+    enum Operation : uint8_t
+    {
+        Accept = 1,
+        Recv,
+        Send,
+        Cancel,
+        Wake,   // the poller of the reactor is woken (Poller::wake())
+    };
+
+    // The connection outlives the node while its operations are in flight
+    struct Connection
+    {
+        Node* m_node = nullptr;
+        SOCKET m_socket = INVALID_SOCKET;
+        std::vector<Bytes> m_sending;           // the segments taken from the node
+        std::vector<iovec> m_iov;
+        msghdr m_msg = {};
+        size_t m_sendSize = 0;
+        size_t m_sendOffset = 0;
+        bool m_isSending = false;
+        bool m_isReceiving = false;
+    };
+
+    static uint64_t userData(uint64_t key, Operation op) { return (key << 8) | op; }
+    static uint64_t key(uint64_t userData) { return userData >> 8; }
+    static Operation operation(uint64_t userData) { return static_cast<Operation>(userData & 0xff); }
+
+    IoUring m_ring;
+    std::unordered_map<uint64_t, Connection> m_connections;
+    std::unordered_map<Node*, uint64_t> m_keys;
+    std::vector<uint64_t> m_rearm;
+    uint64_t m_nextKey = 1;
+    bool m_isAccepting = false;
+    bool m_isWakeArmed = false;
+#endif
+};
+
+} // namespace Net
+} // namespace su
@@ -0,0 +1,178 @@
+#include "net/ip_acl.h"
+#include "net/platform.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstdlib>
+
+namespace su
+{
+namespace Net
+{
+
+bool IpAcl::add(const std::string& rule, Action action)
+{
+    auto slash = rule.find('/');
+    std::string address = rule.substr(0, slash);
+    long prefix = 32;
+
+    if (slash != std::string::npos)
+    {
+        char* end = nullptr;
+        prefix = strtol(rule.c_str() + slash + 1, &end, 10);
+
+        if (slash + 1 == rule.size() || *end || prefix < 0 || prefix > 32)
+        {
+            return false;
+        }
+    }
+
+    uint32_t value = 0;
+    // Parsing string "XXX.XXX.XXX.XXX"
+    if (inet_pton(AF_INET, address.c_str(), &value) != 1)
+    {
+        return false;
+    }
+
+    return add(value, static_cast<uint8_t>(prefix), action);
+}
+
+bool IpAcl::add(uint32_t ip, uint8_t prefix, Action action)
+{
+    if (prefix > 32 || action == Action::None)
+    {
+        return false;
+    }
+
+    uint32_t key = ntohl(ip);
+    bool isAdded = prefix == 32 ? setAction(m_exact[key], action) : insert(mask(key, prefix), prefix, action);
+
+    if (isAdded && action == Action::Allow)
+    {
+        ++m_countOfAllows;
+    }
+    return isAdded;
+}
+
+bool IpAcl::setAction(Action& target, Action action)
+{
+    if (target == action || target == Action::Deny)
+    {
+        return false;
+    }
+
+    // the deny replaces the allow of the same range
+    if (target == Action::Allow)
+    {
+        --m_countOfAllows;
+    }
+    else
+    {
+        ++m_countOfRules;
+    }
+
+    target = action;
+    return true;
+}
+
+bool IpAcl::insert(uint32_t key, uint8_t length, Action action)
+{
+    uint32_t current = 0;
+
+    while (1)
+    {
+        // the prefix of the current node is the prefix of the key
+        if (m_trie[current].m_length == length)
+        {
+            return setAction(m_trie[current].m_action, action);
+        }
+
+        uint32_t side = bit(key, m_trie[current].m_length);
+        uint32_t child = m_trie[current].m_child[side];
+
+        if (!child)
+        {
+            m_trie.push_back({ key, length, Action::None });
+            m_trie[current].m_child[side] = static_cast<uint32_t>(m_trie.size() - 1);
+            return setAction(m_trie.back().m_action, action);
+        }
+
+        uint8_t childLength = m_trie[child].m_length;
+        uint32_t diff = key ^ m_trie[child].m_key;
+        uint8_t common = static_cast<uint8_t>(std::countl_zero(diff));
+        common = std::min(common, std::min(length, childLength));
+
+        if (common == childLength)
+        {
+            current = child;
+            continue;
+        }
+
+        // The edge is split by the new node: it is the rule itself or the branch of the rule and the child
+        uint32_t split = static_cast<uint32_t>(m_trie.size());
+        m_trie.push_back({ mask(key, common), common, Action::None });
+        m_trie[split].m_child[bit(m_trie[child].m_key, common)] = child;
+        m_trie[current].m_child[side] = split;
+
+        if (common == length)
+        {
+            return setAction(m_trie[split].m_action, action);
+        }
+
+        m_trie.push_back({ key, length, Action::None });
+        m_trie[split].m_child[bit(key, common)] = static_cast<uint32_t>(m_trie.size() - 1);
+        return setAction(m_trie.back().m_action, action);
+    }
+}
+
+IpAcl::Action IpAcl::find(uint32_t ip) const
+{
+    uint32_t key = ntohl(ip);
+
+    if (!m_exact.empty())
+    {
+        auto item = m_exact.find(key);
+        if (item != m_exact.end())
+        {
+            return item->second;
+        }
+    }
+
+    // The longest prefix with the rule
+    Action result = Action::None;
+    uint32_t current = 0;
+
+    while (1)
+    {
+        const auto& node = m_trie[current];
+
+        if (mask(key, node.m_length) != node.m_key)
+        {
+            return result;
+        }
+
+        if (node.m_action != Action::None)
+        {
+            result = node.m_action;
+        }
+
+        if (node.m_length == 32 || !(current = node.m_child[bit(key, node.m_length)]))
+        {
+            return result;
+        }
+    }
+}
+
+bool IpAcl::isAllowed(uint32_t ip) const
+{
+    if (empty())
+    {
+        return true;
+    }
+
+    Action action = find(ip);
+    return action == Action::None ? !m_countOfAllows : action == Action::Allow;
+}
+
+} // namespace Net
+} // namespace su
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace su
+{
+namespace Net
+{
+
+// The access list of the IPv4 addresses. The exact addresses are looked up by the hash map,
+// the ranges (CIDR) by the path compressed binary trie, so the lookup doesn't depend on the count of the rules.
+// The list isn't synchronized, it is built once and then shared read only (TcpServer::setAcl(), addAclRules()).
+class IpAcl
+{
+public:
+    enum class Action : uint8_t
+    {
+        None,
+        Allow,
+        Deny,
+    };
+
+    // The rule is "a.b.c.d" or "a.b.c.d/prefix", false - the rule can't be parsed
+    bool allow(const std::string& rule) { return add(rule, Action::Allow); }
+    bool deny(const std::string& rule) { return add(rule, Action::Deny); }
+    bool add(const std::string& rule, Action action);
+    // The ip is in the network byte order. Returns false if the rule is wrong or exists already
+    bool add(uint32_t ip, uint8_t prefix, Action action);
+
+    // The exact address wins, then the longest prefix; the deny wins over the allow of the same prefix.
+    // The ip without rules is allowed only if there are no allow rules (the empty white list allows all).
+    // The ip is in the network byte order
+    bool isAllowed(uint32_t ip) const;
+    Action find(uint32_t ip) const;
+
+    bool empty() const { return !m_countOfRules; }
+    size_t size() const { return m_countOfRules; }
+
+private:
+    // The node keeps the prefix of the range, the nodes without the rule only branch the trie
+    struct TrieNode
+    {
+        uint32_t m_key = 0;
+        uint8_t m_length = 0;
+        Action m_action = Action::None;
+        uint32_t m_child[2] = { 0, 0 };
+    };
+
+    static uint32_t mask(uint32_t key, uint8_t length) { return length ? key & (~0u << (32 - length)) : 0; }
+    static uint32_t bit(uint32_t key, uint8_t index) { return (key >> (31 - index)) & 1; }
+    bool setAction(Action& target, Action action);
+    bool insert(uint32_t key, uint8_t length, Action action);
+
+private:
+    std::unordered_map<uint32_t, Action> m_exact;
+    // the root is the range 0.0.0.0/0, 0 is the missing child
+    std::vector<TrieNode> m_trie = std::vector<TrieNode>(1);
+    size_t m_countOfRules = 0;
+    size_t m_countOfAllows = 0;
+};
+
+} // namespace Net
+} // namespace su
@@ -1,9 +1,6 @@
 
-#include <net/net.h>
-
-#define WIN32_LEAN_AND_MEAN
-#include <winsock2.h>
-#include <ws2tcpip.h>
+#include "net/net.h"
+#include "net/udp_sender.h"
 
 namespace su
 {
@@ -14,13 +11,17 @@ const std::string TcpBroadcastAddress = "0.0.0.0";
 
 bool initWinSock2()
 {
+#ifdef _WIN32
     WSADATA wsaData;
     return WSAStartup(MAKEWORD(2, 2), &wsaData) == NO_ERROR;
+#else
+    return true;
+#endif
 }
 
 std::string addrToString(const sockaddr_in& addr)
 {
-    return ipToString(addr.sin_addr.S_un.S_addr);
+    return ipToString(addr.sin_addr.s_addr);
 }
 
 std::string ipToString(uint32_t ip)
@@ -73,46 +74,31 @@ std::vector<uint32_t> getLocalIps()
 //
 // Multicast address expample:
 //  220..239.x.y.z
-int updSend(const std::string& ip, uint16_t port, void* data, size_t size, UdpSendType type)
+int updSend(const std::string& ip, uint16_t port, void* data, size_t size, UdpSendType type, size_t segmentSize)
 {
-    SOCKET soc = ::socket(AF_INET, SOCK_DGRAM, 0);
+    // The socket of the thread is kept open, the options are set once
+    thread_local UdpSender senders[3];
+    UdpSender& sender = senders[type];
 
-    if (soc == SOCKET_ERROR)
+    if (sender.open() != OK)
     {
         return 0;
     }
 
-    struct sockaddr_in addr;
-
-    addr.sin_addr.s_addr = 0;
-    addr.sin_family = AF_INET;
-    addr.sin_port = htons(port);
-    inet_pton(AF_INET, ip.c_str(), &addr.sin_addr.s_addr);
-
     switch (type)
     {
         case None: break;
-        case Broadcast:
-        {
-            // Set broadcast attributes
-            int op = 1;
-            ::setsockopt(soc, SOL_SOCKET, SO_BROADCAST, (const char*)&op, sizeof(op));
-        }
-        break;
-
-        case Multicast:
-        {
-            struct in_addr imr_multiaddr;
-            ::inet_pton(AF_INET, ip.c_str(), &imr_multiaddr.s_addr);
-            ::setsockopt(soc, IPPROTO_IP, IP_MULTICAST_IF, (const char*)&imr_multiaddr, sizeof(imr_multiaddr));
-        }
-        break;
+        case Broadcast: sender.setBroadcast(true); break;
+        case Multicast: sender.setMulticastInterface(ip); break;
     }
 
-    int out = ::sendto(soc, (const char*)data, (int)size, 0, (struct sockaddr*)&addr, (int)sizeof(addr));
-    ::closesocket(soc);
+    sockaddr_in addr;
+    if (!sender.resolve(ip, port, addr))
+    {
+        return -1;
+    }
 
-    return out;
+    return segmentSize ? sender.sendSegments(&addr, data, size, segmentSize) : sender.sendTo(addr, data, size);
 }
 
 } // namespace Net
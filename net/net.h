@@ -1,12 +1,12 @@
 
 #pragma once
 
-#define WIN32_LEAN_AND_MEAN
-
 #include <stdint.h>
 #include <vector>
 #include <string>
-#include <winsock2.h>
+
+#include "net/buffer.h"
+#include "net/platform.h"
 
 namespace su
 {
@@ -48,14 +48,17 @@ enum RecvStatus
     Complited = 1,
 };
 
+// The received packet, raw is the view of the received data (it may share the receive buffer)
 struct RawData
 {
     RawData() = default;
-    RawData(size_t size) : raw(size) {}
-    RawData(const sockaddr_in& a, size_t size) : raw(size) { addr = a; }
+    RawData(const sockaddr_in& a, const Bytes& data) : raw(data) { addr = a; }
+    // The zero-filled data of the size, raw was std::vector<uint8_t> before, raw.toVector() returns the copy
+    RawData(size_t size) : raw(Bytes::take(std::vector<uint8_t>(size))) {}
+    RawData(const sockaddr_in& a, size_t size) : raw(Bytes::take(std::vector<uint8_t>(size))) { addr = a; }
 
     sockaddr_in addr;
-    std::vector<uint8_t> raw;
+    Bytes raw;
 };
 
 
@@ -65,8 +68,11 @@ extern std::string addrToString(const sockaddr_in& addr);
 extern std::string ipToString(uint32_t ip);
 extern std::vector<uint32_t> getLocalIps();
 
-// UDP
-extern int updSend(const std::string& ip, uint16_t port, void* data, size_t size, UdpSendType type);
+// UDP. The data is split into the datagrams of segmentSize bytes (the last one may be shorter) if it is set,
+// they are sent by one system call with UDP_SEGMENT where it is supported. Returns the count of the sent bytes.
+// The socket is kept open by the calling thread, see UdpSender to control its options
+extern int updSend(const std::string& ip, uint16_t port, void* data, size_t size, UdpSendType type,
+                   size_t segmentSize = 0);
 
 }
 }
@@ -1,10 +1,10 @@
 
+#include <algorithm>
 #include <thread>
+#include <cstring>
 
 #include "net/node.h"
 #include <vector>
-#include <ws2tcpip.h>
-#include <ws2def.h>
 
 namespace su
 {
@@ -25,6 +25,11 @@ Node::Node(SOCKET socket, const sockaddr_in& addr, int32_t id, Log* plog)
 Node::~Node()
 {
     disconnect();
+
+    if (m_sendBudget)
+    {
+        m_sendBudget->m_used.fetch_sub(m_sendQueued, std::memory_order_relaxed);
+    }
 }
 
 Result Node::configureAddress(const std::string& ip, uint16_t port)
@@ -37,25 +42,33 @@ Result Node::configureAddress(const std::string& ip, uint16_t port)
     return OK;
 }
 
-Result Node::createTcpServer()
+Result Node::createSocket(int family, int type, int protocol)
 {
-    m_socket = ::socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
+    m_socket = ::socket(family, type, protocol);
+
+    if (m_socket == SOCKET_ERROR)
+    {
+        return CantCreateSocket;
+    }
+
+    std::lock_guard<std::mutex> guard(m_mutex);
+    m_isDisconnected = false;
+    return OK;
+}
 
-    return m_socket == SOCKET_ERROR ? CantCreateSocket : OK;
+Result Node::createTcpServer()
+{
+    return createSocket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
 }
 
 Result Node::createUdpServer()
 {
-    m_socket = ::socket(PF_INET, SOCK_DGRAM, IPPROTO_UDP);
-
-    return m_socket == SOCKET_ERROR ? CantCreateSocket : OK;
+    return createSocket(PF_INET, SOCK_DGRAM, IPPROTO_UDP);
 }
 
 Result Node::createTcpClient()
 {
-    m_socket = ::socket(AF_INET, SOCK_STREAM, 0);
-
-    return m_socket == SOCKET_ERROR ? CantCreateSocket : OK;
+    return createSocket(AF_INET, SOCK_STREAM, 0);
 }
 
 Result Node::configureParameters()
@@ -92,12 +105,7 @@ Result Node::configureParameters()
 
 Result Node::configureNoBlock()
 {
-#ifdef WIN32
-    u_long uflag = 1;
-    return ::ioctlsocket(m_socket, FIONBIO, &uflag) == SOCKET_ERROR ? CantSetNoBlock : OK;
-#else
-    ::fcntl(m_socket, F_SETFL, O_NONBLOCK);
-#endif
+    return setNoBlock(m_socket) ? OK : CantSetNoBlock;
 }
 
 Result Node::configureKeepAlive()
@@ -137,7 +145,7 @@ Result Node::configureKeepAlive()
         return Result::CantSetKeepAlive; // Can't set socket keepcnt
     }
 
-#ifdef WIN32
+#ifdef _WIN32
     struct timeval timeout;
     timeout.tv_sec = 2;
     timeout.tv_usec = 0;
@@ -153,11 +161,14 @@ Result Node::configureKeepAlive()
         disconnect();
         return Result::CantSetTimeout;
     }
-#else
-    if (setsockopt(m_socket, IPPROTO_TCP, TCP_USER_TIMEOUT, (const char*)&count, sizeof(count)) != 0)
+#elif defined(TCP_USER_TIMEOUT)
+    // The time (msec) the transmitted data may remain unacknowledged before the connection is closed,
+    // it is the same as the time of the keepalive probing
+    unsigned int userTimeout = (keepIdle + interval * count) * 1000;
+    if (setsockopt(m_socket, IPPROTO_TCP, TCP_USER_TIMEOUT, (const char*)&userTimeout, sizeof(userTimeout)) != 0)
     {
         disconnect();
-        return Result::CantSetTimeout; // Can't set socket keepcnt
+        return Result::CantSetTimeout; // Can't set socket user timeout
     }
 #endif
     return OK;
@@ -175,6 +186,22 @@ Result Node::configureReuse()
     return OK;
 }
 
+Result Node::configureReusePort()
+{
+#ifdef SO_REUSEPORT
+    int flag_on = 1;
+    if (setsockopt(m_socket, SOL_SOCKET, SO_REUSEPORT, (const char*)&flag_on, sizeof(flag_on)) == SOCKET_ERROR)
+    {
+        disconnect();
+        return CantSetReuse;
+    }
+
+    return OK;
+#else
+    return CantSetReuse;
+#endif
+}
+
 Result Node::configureImmediatelyClose()
 {
     linger l;
@@ -251,15 +278,432 @@ RecvStatus Node::recv(uint8_t*, size_t, const sockaddr_in&)
     return Complited;
 }
 
+RecvStatus Node::recv(const Bytes& data, const sockaddr_in& addr)
+{
+    return recv(const_cast<uint8_t*>(data.data()), data.size(), addr);
+}
+
 size_t Node::send(const void *packet, size_t size)
+{
+    if (!size)
+    {
+        return 0;
+    }
+
+    // the data of the caller is copied once, the queued segments are never moved
+    return send(Bytes::copy(packet, size));
+}
+
+size_t Node::send(const Bytes& data)
+{
+    return enqueueSend({ data });
+}
+
+void Node::setSendNotify(const std::function<void(Node*)>& func)
+{
+    std::lock_guard<std::recursive_mutex> guard(m_notifyMutex);
+    m_sendNotify = func;
+}
+
+void Node::setRecvNotify(const std::function<void(Node*)>& func)
+{
+    std::lock_guard<std::recursive_mutex> guard(m_notifyMutex);
+    m_recvNotify = func;
+}
+
+void Node::setBackpressureNotify(const std::function<void(Node*, bool)>& func)
+{
+    std::lock_guard<std::recursive_mutex> guard(m_notifyMutex);
+    m_backpressureNotify = func;
+}
+
+void Node::detachOwner()
+{
+    {
+        std::lock_guard<std::recursive_mutex> guard(m_notifyMutex);
+
+        m_sendNotify = nullptr;
+        m_recvNotify = nullptr;
+        m_backpressureNotify = nullptr;
+    }
+
+    // the queued data isn't counted by the budget of the owner anymore
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    if (m_sendBudget)
+    {
+        m_sendBudget->m_used.fetch_sub(m_sendQueued, std::memory_order_relaxed);
+        m_sendBudget = nullptr;
+    }
+}
+
+void Node::notifySend()
+{
+    std::lock_guard<std::recursive_mutex> guard(m_notifyMutex);
+
+    if (m_sendNotify)
+    {
+        m_sendNotify(this);
+    }
+}
+
+void Node::notifyRecv()
+{
+    std::lock_guard<std::recursive_mutex> guard(m_notifyMutex);
+
+    if (m_recvNotify)
+    {
+        m_recvNotify(this);
+    }
+}
+
+void Node::notifyBackpressure(bool isWritable)
+{
+    std::lock_guard<std::recursive_mutex> guard(m_notifyMutex);
+
+    if (m_backpressureNotify)
+    {
+        m_backpressureNotify(this, isWritable);
+    }
+}
+
+void Node::setCoalescing(size_t budget, uint32_t delayUSec)
 {
     std::lock_guard<std::mutex> guard(m_mutex);
-    size_t pos = m_sendBuffer.size();
-    m_sendBuffer.resize(m_sendBuffer.size() + size);
 
-    memcpy(m_sendBuffer.data() + pos, packet, size);
+    m_coalescingBudget = budget;
+    m_coalescingDelay = std::chrono::microseconds(delayUSec);
+}
+
+void Node::flush()
+{
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+
+        if (m_sendQueue.empty() || !m_coalescingBudget)
+        {
+            return;
+        }
+        m_isFlushRequested = true;
+    }
+
+    notifySend();
+}
 
-    return m_sendBuffer.size();
+int64_t Node::sendDelay() const
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+    return sendDelayLocked(std::chrono::steady_clock::now());
+}
+
+int64_t Node::sendDelayLocked(std::chrono::steady_clock::time_point now) const
+{
+    if (m_sendQueue.empty())
+    {
+        return -1;
+    }
+
+    // the rest of the partially written data isn't held
+    if (!m_coalescingBudget || m_isFlushRequested || m_sendOffset || m_sendQueued >= m_coalescingBudget)
+    {
+        return 0;
+    }
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(now - m_coalescingStart);
+    return elapsed < m_coalescingDelay ? (m_coalescingDelay - elapsed).count() : 0;
+}
+
+void Node::setWaterMarks(size_t high, size_t low, SendPolicy policy, uint32_t blockTimeoutMSec)
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    m_highWater = high;
+    m_lowWater = low < high ? low : high;
+    m_sendPolicy = policy;
+    m_blockTimeout = std::chrono::milliseconds(blockTimeoutMSec);
+}
+
+bool Node::isBackpressured() const
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+    return m_isBackpressured;
+}
+
+bool Node::isSendOverflowed() const
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+    return m_isSendOverflowed;
+}
+
+size_t Node::countDroppedSends() const
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+    return m_droppedSends;
+}
+
+bool Node::isSendOverLimitLocked(size_t size) const
+{
+    // the packet bigger than the high water mark is queued alone
+    if (m_highWater && m_sendQueued && m_sendQueued + size > m_highWater)
+    {
+        return true;
+    }
+    return m_sendBudget && m_sendBudget->isExceeded(size);
+}
+
+bool Node::releaseSendLocked(size_t size)
+{
+    m_sendQueued -= size;
+    m_isFlushRequested = m_isFlushRequested && !m_sendQueue.empty();
+
+    if (m_sendBudget)
+    {
+        m_sendBudget->m_used.fetch_sub(size, std::memory_order_relaxed);
+    }
+
+    if (m_blockedSends)
+    {
+        m_sendCV.notify_all();
+    }
+
+    if (m_isBackpressured && m_sendQueued <= m_lowWater)
+    {
+        m_isBackpressured = false;
+        return true;
+    }
+    return false;
+}
+
+bool Node::admitSendLocked(std::unique_lock<std::mutex>& guard, size_t size, bool canBlock)
+{
+    if (!size || !isSendOverLimitLocked(size))
+    {
+        return true;
+    }
+
+    bool isFirst = !m_isBackpressured;
+    bool isOverflow = m_sendPolicy == SendPolicy::Disconnect && !m_isSendOverflowed;
+
+    m_isBackpressured = true;
+    m_isSendOverflowed = m_isSendOverflowed || isOverflow;
+
+    // the callbacks are called without the lock, the owner disconnects the overflowed node
+    if (isFirst || isOverflow)
+    {
+        guard.unlock();
+        if (isFirst)
+        {
+            notifyBackpressure(false);
+        }
+        if (isOverflow)
+        {
+            notifySend();
+        }
+        guard.lock();
+    }
+
+    bool isBlocking = m_sendPolicy == SendPolicy::Block && canBlock;
+
+    if (isBlocking)
+    {
+        uint64_t epoch = m_sendEpoch;
+        auto deadline = std::chrono::steady_clock::now() + m_blockTimeout;
+
+        // the budget is shared with the other nodes, so it is checked periodically too
+        ++m_blockedSends;
+        while (isSendOverLimitLocked(size) && epoch == m_sendEpoch && std::chrono::steady_clock::now() < deadline)
+        {
+            m_sendCV.wait_for(guard, std::chrono::milliseconds(1));
+        }
+        --m_blockedSends;
+    }
+
+    if (!isBlocking || isSendOverLimitLocked(size))
+    {
+        ++m_droppedSends;
+        return false;
+    }
+    return true;
+}
+
+size_t Node::pushSendLocked(std::initializer_list<Bytes> segments, bool& isNotify)
+{
+    bool wasEmpty = m_sendQueue.empty();
+    size_t out = 0;
+
+    for (auto& segment : segments)
+    {
+        if (segment.size())
+        {
+            m_sendQueue.push_back(segment);
+            out += segment.size();
+        }
+    }
+    m_sendQueued += out;
+
+    if (m_sendBudget)
+    {
+        m_sendBudget->m_used.fetch_add(out, std::memory_order_relaxed);
+    }
+
+    bool isFilled = false;
+
+    if (m_coalescingBudget && out)
+    {
+        if (wasEmpty)
+        {
+            m_coalescingStart = std::chrono::steady_clock::now();
+        }
+
+        // the owner is notified again when the budget is reached
+        isFilled = m_sendQueued >= m_coalescingBudget && m_sendQueued - out < m_coalescingBudget;
+    }
+
+    isNotify = (wasEmpty || isFilled) && out;
+    return out;
+}
+
+size_t Node::enqueueSend(std::initializer_list<Bytes> segments, bool canBlock)
+{
+    bool isNotify = false;
+    size_t out = 0;
+    size_t size = 0;
+
+    for (auto& segment : segments)
+    {
+        size += segment.size();
+    }
+
+    {
+        std::unique_lock<std::mutex> guard(m_mutex);
+
+        // the closed node doesn't keep the data, it may be released by its owner already
+        if (m_isDisconnected || !admitSendLocked(guard, size, canBlock))
+        {
+            return 0;
+        }
+
+        out = pushSendLocked(segments, isNotify);
+    }
+
+    if (isNotify)
+    {
+        notifySend();
+    }
+
+    return out;
+}
+
+size_t Node::reserveSend(size_t size, bool canBlock)
+{
+    std::unique_lock<std::mutex> guard(m_mutex);
+
+    if (m_isDisconnected || !admitSendLocked(guard, size, canBlock))
+    {
+        return 0;
+    }
+
+    m_sendQueued += size;
+    m_sendReserved += size;
+
+    if (m_sendBudget)
+    {
+        m_sendBudget->m_used.fetch_add(size, std::memory_order_relaxed);
+    }
+    return size;
+}
+
+size_t Node::enqueueReserved(std::initializer_list<Bytes> segments, size_t reserved)
+{
+    bool isNotify = false;
+    bool isDrained = false;
+    size_t out = 0;
+
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+
+        // the data was admitted by the limits already, it replaces its reservation
+        if (!m_isDisconnected)
+        {
+            out = pushSendLocked(segments, isNotify);
+        }
+
+        m_sendReserved -= reserved;
+        isDrained = releaseSendLocked(reserved);
+    }
+
+    if (isNotify)
+    {
+        notifySend();
+    }
+    if (isDrained)
+    {
+        notifyBackpressure(true);
+    }
+
+    return out;
+}
+
+size_t Node::takeSendSegments(std::vector<Bytes>& out, size_t maxCount)
+{
+    std::unique_lock<std::mutex> guard(m_mutex);
+    size_t size = 0;
+
+    out.clear();
+
+    while (m_sendQueue.size() && out.size() < maxCount)
+    {
+        auto& segment = m_sendQueue.front();
+
+        out.push_back(m_sendOffset ? segment.slice(m_sendOffset, segment.size()) : segment);
+        size += out.back().size();
+
+        m_sendOffset = 0;
+        m_sendQueue.pop_front();
+    }
+
+    // the taken data is owned by the engine, it isn't counted by the limits
+    if (releaseSendLocked(size))
+    {
+        guard.unlock();
+        notifyBackpressure(true);
+    }
+    return size;
+}
+
+void Node::clearSendQueue()
+{
+    std::unique_lock<std::mutex> guard(m_mutex);
+
+    m_sendQueue.clear();
+    m_sendOffset = 0;
+    m_isSendOverflowed = false;
+    ++m_sendEpoch;
+
+    // the reserved data isn't queued yet, its reservation is released by enqueueReserved()
+    if (releaseSendLocked(m_sendQueued - m_sendReserved))
+    {
+        guard.unlock();
+        notifyBackpressure(true);
+    }
+}
+
+size_t Node::sizeSendBuffer() const
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+    return m_sendQueued;
+}
+
+size_t Node::countSendSegments() const
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+    return m_sendQueue.size();
+}
+
+bool Node::hasPendingSend()
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+    return !m_sendQueue.empty();
 }
 
 bool Node::disconnect()
@@ -271,11 +715,20 @@ bool Node::disconnect()
 
     if (!m_immediatelyClose)
     {
-        shutdown(m_socket, SD_SEND);
+        shutdown(m_socket, SU_SHUT_SEND);
     }
 
-    closesocket(m_socket);
+    closeSocket(m_socket);
     m_socket = SOCKET_ERROR;
+    m_socketType = 0;
+
+    // the blocked producers stop waiting
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_isDisconnected = true;
+        ++m_sendEpoch;
+        m_sendCV.notify_all();
+    }
 
     return true;
 }
@@ -287,7 +740,7 @@ bool Node::isConnected() const
 
 int Node::getLastError() const
 {
-    return ::WSAGetLastError();
+    return getSocketError();
 }
 
 bool Node::tooManySendErrors() const
@@ -310,43 +763,56 @@ int32_t Node::lastSendBytes() const
     return m_sendBytes;
 }
 
+bool Node::isStream()
+{
+    if (!m_socketType)
+    {
+        socklen_t size = sizeof(m_socketType);
+        if (::getsockopt(m_socket, SOL_SOCKET, SO_TYPE, (char*)&m_socketType, &size) != 0)
+        {
+            return false;
+        }
+    }
+
+    return m_socketType == SOCK_STREAM;
+}
+
 RecvStatus Node::readFromSocket()
 {
-    std::vector<uint8_t> buff(m_maxRecvBuff * 2);
+    // The datagram must fit the buffer entirely
+    auto& slab = RecvSlab::local();
+    size_t size = m_maxRecvBuff * 2;
+    uint8_t* buff = slab.reserve(isStream() ? 0 : 0x10000, size);
     RecvStatus result = RecvStatus::Fault;
     sockaddr_in addr;
-    int addrSize = sizeof(addr);
+    socklen_t addrSize = sizeof(addr);
 
-    m_recvBytes = ::recvfrom(m_socket, (char*)buff.data(), (int)buff.size(), 0, (sockaddr*)&addr, &addrSize);
+    m_recvBytes = ::recvfrom(m_socket, (char*)buff, (int)size, 0, (sockaddr*)&addr, &addrSize);
 
-    if (::WSAGetLastError())
+    if (m_recvBytes < 0)
     {
-        return Fault;
-    }
+        int error = getSocketError();
 
-    if (m_recvBytes > 0)
-    {
-        result = recv(buff.data(), m_recvBytes, addr);
+        LOGSPD(m_log, "Socket %s, result %i, error %i", m_fullId.c_str(), m_recvBytes, error);
+        return isWouldBlock(error) ? NoComplited : Fault;
     }
 
-    if (m_recvBytes <= 0 && errno == ETIMEDOUT)
+    if (m_recvBytes > 0)
     {
-        LOGSPD(m_log, "Socket %s, result %i, errno %i (ETIMEDOUT)", m_fullId.c_str(), m_recvBytes, errno);
+        result = recv(slab.commit(m_recvBytes), addr);
     }
-
-    if (m_recvBytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+    else if (isStream())
     {
-        LOGSPD(m_log, "Socket %s, result %i, errno %i", m_fullId.c_str(), m_recvBytes, errno);
-        return NoComplited;
+        // the remote side has closed the connection
+        ++m_countOfRecvErrrors;
+        return Fault;
     }
 
-    // -1 - error
-    // 0 - may be it is keep-alive and remote socket was close
+    // 0 - empty datagram
     if (m_recvBytes <= 0 || result == Fault)
     {
         ++m_countOfRecvErrrors;
         return NoComplited;
-        //return Fault;
     }
 
     m_countOfRecvErrrors = 0;
@@ -355,24 +821,86 @@ RecvStatus Node::readFromSocket()
 
 bool Node::sendToSocket()
 {
-    std::lock_guard<std::mutex> guard(m_mutex);
+    std::unique_lock<std::mutex> guard(m_mutex);
 
     m_sendBytes = 0;
 
-    if (m_sendBuffer.empty())
+    // the coalesced data waits for the budget, the delay or flush()
+    if (m_sendQueue.empty() || (m_coalescingBudget && sendDelayLocked(std::chrono::steady_clock::now()) > 0))
     {
         return true;
     }
 
-    m_sendBytes = ::send(m_socket, (char*)m_sendBuffer.data(), (int)m_sendBuffer.size(), 0);
+    // Many segments are sent by one system call, the first one may be sent partially already
+    size_t count = std::min(m_sendQueue.size(), MaxSendSegments);
+
+#ifdef _WIN32
+    WSABUF buffers[MaxSendSegments];
+    DWORD sent = 0;
+
+    for (size_t ii = 0; ii < count; ++ii)
+    {
+        size_t offset = ii ? 0 : m_sendOffset;
+        buffers[ii].buf = (char*)m_sendQueue[ii].data() + offset;
+        buffers[ii].len = (ULONG)(m_sendQueue[ii].size() - offset);
+    }
+
+    m_sendBytes = ::WSASend(m_socket, buffers, (DWORD)count, &sent, 0, nullptr, nullptr) == SOCKET_ERROR ? -1 : (int32_t)sent;
+#else
+    iovec buffers[MaxSendSegments];
+    msghdr msg = {};
+
+    for (size_t ii = 0; ii < count; ++ii)
+    {
+        size_t offset = ii ? 0 : m_sendOffset;
+        buffers[ii].iov_base = (void*)(m_sendQueue[ii].data() + offset);
+        buffers[ii].iov_len = m_sendQueue[ii].size() - offset;
+    }
+
+    msg.msg_iov = buffers;
+    msg.msg_iovlen = count;
+
+    m_sendBytes = static_cast<int32_t>(::sendmsg(m_socket, &msg, SU_SEND_FLAGS));
+#endif
+
     if (m_sendBytes < 0)
     {
+        if (isWouldBlock(getSocketError()))
+        {
+            m_sendBytes = 0;
+            return true;
+        }
+
         ++m_countOfSendErrrors;
         return true;
     }
 
     m_countOfSendErrrors = 0;
-    m_sendBuffer.erase(m_sendBuffer.begin(), m_sendBuffer.begin() + m_sendBytes);
+
+    // the partial write only advances the offset in the first segment
+    size_t sent = m_sendBytes;
+
+    while (sent)
+    {
+        size_t rest = m_sendQueue.front().size() - m_sendOffset;
+
+        if (sent < rest)
+        {
+            m_sendOffset += sent;
+            break;
+        }
+
+        sent -= rest;
+        m_sendOffset = 0;
+        m_sendQueue.pop_front();
+    }
+
+    if (releaseSendLocked(m_sendBytes))
+    {
+        guard.unlock();
+        notifyBackpressure(true);
+    }
+
     return true;
 }
 
@@ -1,13 +1,17 @@
 #pragma once
-#define WIN32_LEAN_AND_MEAN
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <initializer_list>
 #include <mutex>
 #include <string>
 #include <vector>
 
-#include <winsock2.h>
-
 #include "log.h"
+#include "net/buffer.h"
 #include "net/net.h"
 
 namespace su
@@ -15,9 +19,27 @@ namespace su
 namespace Net
 {
 
+// The memory budget of the send queues of many nodes, it is owned by the owner of the nodes
+struct SendBudget
+{
+    bool isExceeded(size_t size) const { return m_limit && m_used.load(std::memory_order_relaxed) + size > m_limit; }
+
+    size_t m_limit = 0;     // 0 - unlimited
+    std::atomic<size_t> m_used = 0;
+};
+
 class Node
 {
 public:
+    // The sending over the limits of the queue
+    enum class SendPolicy
+    {
+        Drop,       // the data is refused, send() returns 0
+        Disconnect, // the data is refused and the owner disconnects the node (isSendOverflowed())
+        Block,      // the producer waits until the queue drains up to the timeout, then the data is refused.
+                    // It must not be the thread of the owner.
+    };
+
     Node(int32_t id = -1, Log* plog = nullptr) { m_id = id; m_log = plog; }
     Node(SOCKET socket, const sockaddr_in& addr, int32_t id = -1, Log* plog = nullptr);
     virtual ~Node();
@@ -34,13 +56,34 @@ public:
     Result configureNoBlock();
     Result configureKeepAlive();
     Result configureReuse();
+    // Several sockets may listen the same port, the kernel balances the connections between them
+    Result configureReusePort();
     Result configureImmediatelyClose();
     Result openTcpServer();
     Result openUdpServer(bool isMulticast);
     Result connectToTcpServer();
 
     virtual RecvStatus recv(uint8_t* read_buff, size_t read_size, const sockaddr_in& addr);
+    // The received data may be kept by the node without copying, by default it is passed to recv(uint8_t*, ...)
+    virtual RecvStatus recv(const Bytes& data, const sockaddr_in& addr);
+    // The data is queued and sent by sendToSocket(), the data of the Bytes is not copied
     virtual size_t send(const void *packet, size_t size);
+    virtual size_t send(const Bytes& data);
+
+    // The message framed once and sent to many nodes as is (broadcast)
+    struct Frame
+    {
+        Bytes m_header;
+        Bytes m_payload;
+        // false - the Block policy refuses the frame at once like Drop (the broadcast doesn't wait for one client)
+        bool m_canBlock = true;
+    };
+
+    // The nodes with the same non-zero key frame the payload identically, so the frame of one of them
+    // may be sent by the others. 0 - the frame of the node is not shared, it is made for the node only.
+    virtual uint64_t frameKey() const { return 0; }
+    virtual Frame frame(const Bytes& payload) { return { Bytes(), payload }; }
+    virtual size_t sendFrame(const Frame& frame) { return enqueueSend({ frame.m_header, frame.m_payload }, frame.m_canBlock); }
     virtual RecvStatus readFromSocket();
     virtual bool sendToSocket();
 
@@ -52,13 +95,88 @@ public:
     int32_t lastRecvBytes() const;
     int32_t lastSendBytes() const;
 
-    size_t sizeSendBuffer() const { return m_sendBuffer.size(); }
+    size_t sizeSendBuffer() const;
+    size_t countSendSegments() const;
+    void   clearSendQueue();
+    bool   isStream();
+
+    virtual bool hasPendingSend();
+
+    // The count of the segments sent by one system call
+    static constexpr size_t MaxSendSegments = 64;
+    // The payload of the full TCP segment on Ethernet (MTU 1500 without the IP, TCP and timestamps headers)
+    static constexpr size_t MtuBudget = 1448;
+
+    // The coalescing of the small messages: the queued data is written when `budget` bytes are queued,
+    // `delayUSec` has passed since the first of them or flush() is called. 0 budget - the data is written
+    // at once. The delay is kept by the owner of the node (TcpServer, TcpClient) with its precision.
+    void setCoalescing(size_t budget, uint32_t delayUSec);
+    size_t coalescingBudget() const { return m_coalescingBudget; }
+    // The queued data is written without waiting of the coalescing
+    void flush();
+    // Microseconds until the queued data should be written: 0 - now, -1 - nothing is queued
+    int64_t sendDelay() const;
+
+    // The limits of the send queue: the data is queued over `high` bytes or over the budget only if
+    // the queue is empty (the budget is checked always), otherwise the policy is applied.
+    // 0 high - unlimited. The budget must be set before the sending and outlive the node.
+    void setWaterMarks(size_t high, size_t low, SendPolicy policy, uint32_t blockTimeoutMSec = 1000);
+    void setSendBudget(SendBudget* budget) { m_sendBudget = budget; }
+    // The callback is called with false when the sending is refused or blocked by the limits (on the thread
+    // of the producer) and with true when the queue has drained to the low water mark (on the thread
+    // of the owner)
+    void setBackpressureNotify(const std::function<void(Node*, bool)>& func);
+    bool isBackpressured() const;
+    bool isSendOverflowed() const;
+    size_t countDroppedSends() const;
+
+    // Take away up to maxCount queued segments, it is used by the I/O engines owning the data
+    // while the sending is in progress. Returns the size of the taken data.
+    size_t takeSendSegments(std::vector<Bytes>& out, size_t maxCount = MaxSendSegments);
+    const sockaddr_in& socketAddress() const { return m_addr; }
+
+    // The callback is called when the data has been queued to the empty send buffer,
+    // it is used by the owner of the node to flush the node without polling of all nodes
+    void setSendNotify(const std::function<void(Node*)>& func);
+
+    // The callback is called by the worker thread when the data received earlier has been completed
+    // asynchronously (e.g. decompressed by the pool), the owner takes it by pollRecv() on its thread.
+    // The callback may be replaced while the node is working, nullptr - disabled.
+    void setRecvNotify(const std::function<void(Node*)>& func);
+    // Takes the asynchronously completed data: Complited - the new packets are ready, Fault - the data is broken
+    virtual RecvStatus pollRecv() { return NoComplited; }
+
+    // The owner releases the node which may outlive it (e.g. held by the sending thread): the callbacks
+    // are cleared after the calls in progress have returned and the send budget is detached
+    virtual void detachOwner();
 
     const std::string& address() const { return m_ip; }
     const std::string& fullId() const { return m_fullId; }
 
 private:
 
+protected:
+    // The callbacks are called under the lock, so they aren't called after they have been replaced
+    void notifySend();
+    void notifyRecv();
+    void notifyBackpressure(bool isWritable);
+    Result createSocket(int family, int type, int protocol);
+
+    // The segments are queued together, so the segments of the other threads can't get between them
+    size_t enqueueSend(std::initializer_list<Bytes> segments, bool canBlock = true);
+    // The data queued later (e.g. by the pool) is counted by the limits and the budget at once: the size
+    // is admitted by the policy now and its reservation is replaced by the segments without the limits
+    // later. The empty segments release the reservation only. The reserved data isn't dropped by clearSendQueue().
+    size_t reserveSend(size_t size, bool canBlock = true);
+    size_t enqueueReserved(std::initializer_list<Bytes> segments, size_t reserved);
+    // Applies the limits and the policy to the new data, the lock may be released meanwhile
+    bool admitSendLocked(std::unique_lock<std::mutex>& guard, size_t size, bool canBlock);
+    size_t pushSendLocked(std::initializer_list<Bytes> segments, bool& isNotify);
+    int64_t sendDelayLocked(std::chrono::steady_clock::time_point now) const;
+    bool isSendOverLimitLocked(size_t size) const;
+    // Returns true if the queue has drained to the low water mark after the back-pressure
+    bool releaseSendLocked(size_t size);
+
 protected:
     SOCKET m_socket = SOCKET_ERROR;
     sockaddr_in m_addr;
@@ -70,7 +188,7 @@ protected:
     size_t m_maxOfRecvErrrors = 0;//4096;
 
 private:
-    std::mutex m_mutex;
+    mutable std::mutex m_mutex;
     int32_t m_id = -1;
     Log* m_log = nullptr;
 
@@ -81,8 +199,36 @@ private:
     int32_t m_sendBytes = 0;
     size_t m_countOfSendErrrors = 0;
     size_t m_countOfRecvErrrors = 0;
-    std::vector<uint8_t> m_sendBuffer;
+    std::deque<Bytes> m_sendQueue;
+    size_t m_sendOffset = 0;                // the sent part of the first segment
+    size_t m_sendQueued = 0;                // with the reserved data
+    size_t m_sendReserved = 0;
+    size_t m_coalescingBudget = 0;
+    std::chrono::microseconds m_coalescingDelay{ 0 };
+    std::chrono::steady_clock::time_point m_coalescingStart;  // the queue has become non-empty
+    bool m_isFlushRequested = false;
+    size_t m_highWater = 0;
+    size_t m_lowWater = 0;
+    SendPolicy m_sendPolicy = SendPolicy::Disconnect;
+    std::chrono::milliseconds m_blockTimeout{ 1000 };
+    SendBudget* m_sendBudget = nullptr;
+    bool m_isBackpressured = false;
+    bool m_isSendOverflowed = false;
+    size_t m_droppedSends = 0;
+    // The blocked producers wait for the draining, they stop waiting if the queue is cleared or
+    // the node is disconnected (m_sendEpoch is changed)
+    std::condition_variable m_sendCV;
+    size_t m_blockedSends = 0;
+    uint64_t m_sendEpoch = 0;
+    // the sending to the closed socket is refused until the new socket is created
+    bool m_isDisconnected = false;
     bool m_immediatelyClose = false;
+    int m_socketType = 0;
+    // The callback may send to the node again, so the lock is recursive
+    std::recursive_mutex m_notifyMutex;
+    std::function<void(Node*)> m_sendNotify;
+    std::function<void(Node*)> m_recvNotify;
+    std::function<void(Node*, bool)> m_backpressureNotify;
 };
 
 } // namespace Net
@@ -1,6 +1,11 @@
 
 #include "net/packetnode.h"
 
+#include <algorithm>
+#include <cstring>
+#include "net/compress.h"
+#include "threadpool.h"
+
 namespace su
 {
 namespace Net
@@ -13,6 +18,29 @@ PacketNode::PacketNode(uint32_t magic, SOCKET socket, const sockaddr_in& addr, i
     clear();
 }
 
+PacketNode::~PacketNode()
+{
+    // the tasks of the pool may still frame the payloads or decompress the packets of this node
+    std::unique_lock<std::mutex> lock(m_sendMutex);
+    m_sendCV.wait(lock, [this]() { return !m_isSendRunning && !m_decompressTasks; });
+}
+
+void PacketNode::clearSendPackets()
+{
+    size_t reserved = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_sendMutex);
+
+        while (!m_sendJobs.empty())
+        {
+            auto job = m_sendJobs.pop_front();
+            reserved += job.m_header.size() + job.m_payload.size();
+        }
+    }
+    enqueueReserved({}, reserved);
+    clearSendQueue();
+}
+
 RawData PacketNode::extractRecvPacket()
 {
     if (m_recvPackets.empty())
@@ -20,48 +48,118 @@ RawData PacketNode::extractRecvPacket()
         return {};
     }
 
-    auto out = std::move(m_recvPackets.back());
-    m_recvPackets.pop_back();
-
-    return out;
+    return m_recvPackets.pop_front();
 }
 
 RecvStatus PacketNode::recv(uint8_t* data, size_t size, const sockaddr_in& addr)
 {
-    if (m_data.empty())
-    {
-        m_data.resize(size);
+    return recv(RecvSlab::local().copy(data, size), addr);
+}
 
-        memcpy(m_data.data(), data, size);
-    }
-    else
+RecvStatus PacketNode::recv(const Bytes& data, const sockaddr_in& addr)
+{
+    size_t pos = 0;
+    bool isFault = false;
+
+    while (pos < data.size() && !isFault)
     {
-        auto pos = m_data.size();
+        size_t rest = data.size() - pos;
+
+        if (!m_hasHeader)
+        {
+            size_t size = std::min(sizeof(PacketHeader) - m_headerSize, rest);
+
+            memcpy(m_headerData + m_headerSize, data.data() + pos, size);
+            m_headerSize += size;
+            pos += size;
+
+            if (m_headerSize < sizeof(PacketHeader))
+            {
+                break;
+            }
+
+            if (!parseHeader())
+            {
+                isFault = true;
+                break;
+            }
+
+            if (!m_header.m_size)
+            {
+                isFault = !completePacket(Bytes(), addr);
+            }
+            continue;
+        }
+
+        size_t need = m_header.m_size - (m_payload ? m_payload->size() : 0);
 
-        m_data.resize(m_data.size() + size);
+        // The payload is in the chunk entirely, it is passed without copying
+        if (!m_payload && rest >= need)
+        {
+            isFault = !completePacket(data.slice(pos, need), addr);
+            pos += need;
+            continue;
+        }
 
-        memcpy(m_data.data() + pos, data, size);
+        size_t size = std::min(need, rest);
+
+        if (!m_payload)
+        {
+            m_payload = m_payloadPool.acquire(std::min<size_t>(m_header.m_size, MaxPreallocation));
+        }
+
+        m_payload->insert(m_payload->end(), data.data() + pos, data.data() + pos + size);
+        pos += size;
+
+        if (m_payload->size() == m_header.m_size)
+        {
+            auto payload = BufferPool::view(m_payload);
+            m_payload.reset();
+            isFault = !completePacket(payload, addr);
+        }
     }
 
-    RecvStatus check = RecvStatus::Fault;
-    while ((check = checkData(addr)) == RecvStatus::Complited)
+    if (!isFault && m_compressionPool)
     {
+        decompressPending();
+        isFault = !deliverDecompressed();
     }
 
     // error
-    if (check == RecvStatus::Fault)
+    if (isFault)
     {
-        clear();
-        m_data.clear();
-        m_recvPackets.clear();
-        m_sendPackets.clear();
-        disconnect();
-        return check;
+        return fault();
     }
 
     return m_recvPackets.size() ? RecvStatus::Complited : RecvStatus::NoComplited;
 }
 
+RecvStatus PacketNode::pollRecv()
+{
+    size_t count = m_recvPackets.size();
+
+    if (!deliverDecompressed())
+    {
+        return fault();
+    }
+
+    return m_recvPackets.size() > count ? RecvStatus::Complited : RecvStatus::NoComplited;
+}
+
+RecvStatus PacketNode::fault()
+{
+    clear();
+    m_payload.reset();
+    m_chunk.clear();
+    m_pendingPackets.clear();
+    // the running tasks keep their chunks
+    m_decompressing.clear();
+    m_recvPackets.clear();
+    clearSendPackets();
+    disconnect();
+    return RecvStatus::Fault;
+}
+
 size_t PacketNode::send(const void* data, size_t size)
 {
     if (size >= 0xffffffff)
@@ -70,90 +168,454 @@ size_t PacketNode::send(const void* data, size_t size)
         return 0;
     }
 
+    // the payload is kept by the pool task or compressed into the separate buffer
+    if (m_compressionPool || shouldCompress(size))
+    {
+        return send(Bytes::copy(data, size));
+    }
+
     size_t fullSize = size + sizeof(PacketHeader);
-    std::vector<uint8_t> packet(fullSize);
-    PacketHeader* header = (PacketHeader*)packet.data();
+    std::shared_ptr<uint8_t[]> packet(new uint8_t[fullSize]);
 
-    header->m_magic = m_magic;
-    header->m_reserved = 0;
-    header->m_flags = 0;
-    header->m_version = m_version;
-    header->m_size = static_cast<uint32_t>(size);
-    header->m_dataHash = m_crc.get(data, size);
-    header->m_hash = m_crc.get(header, sizeof(PacketHeader) - sizeof(header->m_hash));
+    fillHeader(*(PacketHeader*)packet.get(), sendFlags(), data, size, 0);
+    memcpy(packet.get() + sizeof(PacketHeader), data, size);
 
-    memcpy(packet.data() + sizeof(PacketHeader), data, size);
+    auto ptr = packet.get();
+    return enqueueSend({ Bytes(std::move(packet), ptr, fullSize) });
+}
 
-    m_sendPackets.push_back(std::move(packet));
+size_t PacketNode::send(const Bytes& data)
+{
+    if (data.size() >= 0xffffffff)
+    {
+        LOGSPE(getLog(), "Received packet is to big");
+        return 0;
+    }
 
-    //auto out = Node::send(packet.data(), fullSize);
+    size_t sent = 0;
 
-    return fullSize;
+    if (postSend({ Bytes(), data }, shouldCompress(data.size()), sent))
+    {
+        return sent;
+    }
+    return sendFrame(frame(data));
 }
 
-bool PacketNode::sendToSocket()
+size_t PacketNode::sendFrame(const Frame& frame)
 {
-    if (!Node::sizeSendBuffer() && m_sendPackets.size())
+    size_t sent = 0;
+
+    // the frame can't overtake the packets which are being compressed
+    if (postSend(frame, false, sent))
     {
-        Node::send(m_sendPackets[0].data(), m_sendPackets[0].size());
-        m_sendPackets.erase(m_sendPackets.begin());
+        return sent;
     }
+    return Node::sendFrame(frame);
+}
+
+bool PacketNode::postSend(const Frame& job, bool isCompressed, size_t& sent)
+{
+    if (!m_compressionPool)
+    {
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_sendMutex);
 
-    return Node::sendToSocket();
+        if (!isCompressed && !m_isSendRunning)
+        {
+            return false;
+        }
+    }
+
+    // the job is counted by the limits while it is waiting for the pool, the producer may be blocked
+    // by the policy here, but not the worker
+    size_t size = job.m_header.size() + job.m_payload.size();
+
+    sent = reserveSend(size, job.m_canBlock);
+    if (!sent)
+    {
+        return true;
+    }
+
+    std::lock_guard<std::mutex> lock(m_sendMutex);
+
+    // the sending has finished meanwhile, the frame is queued directly
+    if (!isCompressed && !m_isSendRunning)
+    {
+        enqueueReserved({ job.m_header, job.m_payload }, size);
+        return true;
+    }
+
+    m_sendJobs.push_back(job);
+
+    if (!m_isSendRunning)
+    {
+        m_isSendRunning = true;
+        m_compressionPool->add_task([this]() { runSend(); });
+    }
+    return true;
 }
 
-RecvStatus PacketNode::checkData(const sockaddr_in& addr)
+void PacketNode::runSend()
 {
-    if (!m_header.m_size)
+    while (true)
     {
-        if (m_data.size() < sizeof(PacketHeader))
+        Frame job;
         {
-            return RecvStatus::NoComplited;
+            std::lock_guard<std::mutex> lock(m_sendMutex);
+
+            if (m_sendJobs.empty())
+            {
+                m_isSendRunning = false;
+                m_sendCV.notify_all();
+                return;
+            }
+            job = m_sendJobs.pop_front();
         }
 
-        m_header = *(PacketHeader*)m_data.data();
+        size_t reserved = job.m_header.size() + job.m_payload.size();
 
-        if (m_header.m_magic != m_magic || m_header.m_version != m_version)
+        // the payload without the header is framed here
+        if (job.m_header.empty())
         {
-            LOGSPE(getLog(), "The header of packet is unrecognizable");
-            return RecvStatus::Fault;
+            job = frame(job.m_payload);
         }
 
-        if (m_header.m_hash != m_crc.get(&m_header, sizeof(m_header) - sizeof(m_header.m_hash)))
+        // the job has been admitted by postSend(), the worker doesn't wait for the limits
+        enqueueReserved({ job.m_header, job.m_payload }, reserved);
+    }
+}
+
+uint64_t PacketNode::frameKey() const
+{
+    // the flags are in the header, so the nodes with the different checksums or compression
+    // don't share the frames
+    uint16_t flags = sendFlags() | (isCompressing() ? FlagCompressed : 0);
+    return (uint64_t(flags) << 48) | (uint64_t(m_version) << 32) | m_magic;
+}
+
+bool PacketNode::isCompressing() const
+{
+    return m_compressionThreshold && (m_peerAccepts.load(std::memory_order_relaxed) & FlagAcceptCompression);
+}
+
+bool PacketNode::shouldCompress(size_t size) const
+{
+    return size >= m_compressionThreshold && isCompressing();
+}
+
+Bytes PacketNode::compress(const Bytes& payload)
+{
+    thread_local std::vector<uint8_t> buffer;
+
+    // the compression must save 1/8 at least, otherwise the result doesn't fit into the buffer
+    size_t limit = payload.size() - payload.size() / 8;
+    if (buffer.size() < limit)
+    {
+        buffer.resize(limit);
+    }
+
+    size_t size = lzCompress(payload.data(), payload.size(), buffer.data(), limit);
+    return size ? Bytes::copy(buffer.data(), size) : Bytes();
+}
+
+bool PacketNode::decompress(RawData& packet, size_t originalSize)
+{
+    auto buffer = m_payloadPool.acquire(originalSize);
+    buffer->resize(originalSize);
+
+    if (!lzDecompress(packet.raw.data(), packet.raw.size(), buffer->data(), originalSize))
+    {
+        LOGSPE(getLog(), "The compressed packet is broken");
+        return false;
+    }
+
+    packet.raw = BufferPool::view(buffer);
+    return true;
+}
+
+void PacketNode::decompressPending()
+{
+    if (m_chunk.empty())
+    {
+        return;
+    }
+
+    // nothing to wait for, the chunk is delivered at once
+    if (m_pendingPackets.empty() && m_decompressing.empty())
+    {
+        for (auto& packet : m_chunk)
         {
-            LOGSPE(getLog(), "The hash of packet header is broken");
-            return RecvStatus::Fault;
+            m_recvPackets.push_back(std::move(packet));
         }
+        m_chunk.clear();
+        return;
+    }
 
-        m_data.erase(m_data.begin(), m_data.begin() + sizeof(PacketHeader));
+    auto chunk = std::make_shared<DecompressChunk>();
+    chunk->m_packets.swap(m_chunk);
+    chunk->m_pending.swap(m_pendingPackets);
+    chunk->m_remaining.store(chunk->m_pending.size());
+
+    for (auto& pending : chunk->m_pending)
+    {
+        chunk->m_buffers.push_back(m_payloadPool.acquire(pending.m_originalSize));
+        chunk->m_buffers.back()->resize(pending.m_originalSize);
+    }
+
+    m_decompressing.push_back(chunk);
+
+    {
+        std::lock_guard<std::mutex> lock(m_sendMutex);
+        m_decompressTasks += chunk->m_pending.size();
+    }
+
+    // The packets are decompressed in parallel, the task completing the chunk calls the owner back
+    for (size_t ii = 0; ii < chunk->m_pending.size(); ++ii)
+    {
+        m_compressionPool->post([this, chunk, ii]()
+        {
+            auto& packet = chunk->m_packets[chunk->m_pending[ii].m_index];
+            auto& buffer = *chunk->m_buffers[ii];
+
+            if (!lzDecompress(packet.raw.data(), packet.raw.size(), buffer.data(), buffer.size()))
+            {
+                chunk->m_isBroken.store(true, std::memory_order_relaxed);
+            }
+
+            if (chunk->m_remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            {
+                notifyRecv();
+            }
+
+            // the node may be destroyed as soon as the counter is released
+            std::lock_guard<std::mutex> lock(m_sendMutex);
+            --m_decompressTasks;
+            m_sendCV.notify_all();
+        });
+    }
+}
+
+// The decompressed chunks are moved to the received packets in order, false - the chunk is broken
+bool PacketNode::deliverDecompressed()
+{
+    while (!m_decompressing.empty() && !m_decompressing.front()->m_remaining.load(std::memory_order_acquire))
+    {
+        auto chunk = m_decompressing.pop_front();
+
+        if (chunk->m_isBroken.load(std::memory_order_relaxed))
+        {
+            LOGSPE(getLog(), "The compressed packet is broken");
+            return false;
+        }
+
+        for (size_t ii = 0; ii < chunk->m_pending.size(); ++ii)
+        {
+            chunk->m_packets[chunk->m_pending[ii].m_index].raw = BufferPool::view(chunk->m_buffers[ii]);
+        }
+
+        for (auto& packet : chunk->m_packets)
+        {
+            m_recvPackets.push_back(std::move(packet));
+        }
+    }
+
+    return true;
+}
+
+Checksum PacketNode::sendChecksum() const
+{
+    uint16_t accepts = m_peerAccepts.load(std::memory_order_relaxed);
+
+    if (m_checksum == Checksum::None && (accepts & FlagAcceptNone))
+    {
+        return Checksum::None;
+    }
+
+    if (m_checksum != Checksum::Crc32 && (accepts & FlagAcceptCrc32C))
+    {
+        return Checksum::Crc32C;
+    }
+    return Checksum::Crc32;
+}
+
+uint16_t PacketNode::sendFlags() const
+{
+    uint16_t flags = static_cast<uint16_t>(sendChecksum()) | FlagAcceptCrc32C;
+
+    if (m_checksum == Checksum::None)
+    {
+        flags |= FlagAcceptNone;
+    }
+
+    if (m_compressionThreshold)
+    {
+        flags |= FlagAcceptCompression;
+    }
+    return flags;
+}
+
+uint32_t PacketNode::hash(Checksum checksum, const void* data, size_t size)
+{
+    switch (checksum)
+    {
+        case Checksum::Crc32: return m_crc.get(data, size);
+        case Checksum::Crc32C: return crc32c(data, size);
+        case Checksum::None: return 0;
+    }
+    return 0;
+}
+
+uint32_t PacketNode::headerHash(Checksum checksum, const PacketHeader& header)
+{
+    // the header is small, it is checked always
+    size_t size = sizeof(PacketHeader) - sizeof(header.m_hash);
+    return checksum == Checksum::Crc32 ? m_crc.get(&header, size) : crc32c(&header, size);
+}
+
+Node::Frame PacketNode::frame(const Bytes& payload)
+{
+    auto header = std::make_shared<PacketHeader>();
+    uint16_t flags = sendFlags();
+    Bytes body = payload;
+
+    if (shouldCompress(payload.size()))
+    {
+        auto compressed = compress(payload);
+
+        if (!compressed.empty())
+        {
+            body = compressed;
+            flags |= FlagCompressed;
+        }
+    }
+
+    fillHeader(*header, flags, body.data(), body.size(), (flags & FlagCompressed) ? payload.size() : 0);
+
+    auto ptr = (const uint8_t*)header.get();
+    return { Bytes(std::move(header), ptr, sizeof(PacketHeader)), body };
+}
+
+void PacketNode::fillHeader(PacketHeader& header, uint16_t flags, const void* data, size_t size, size_t originalSize)
+{
+    auto checksum = static_cast<Checksum>(flags & FlagChecksumMask);
+
+    header.m_magic = m_magic;
+    header.m_reserved = static_cast<uint32_t>(originalSize);
+    header.m_flags = flags;
+    header.m_version = m_version;
+    header.m_size = static_cast<uint32_t>(size);
+    header.m_dataHash = hash(checksum, data, size);
+    header.m_hash = headerHash(checksum, header);
+}
+
+bool PacketNode::parseHeader()
+{
+    memcpy(&m_header, m_headerData, sizeof(PacketHeader));
+
+    if (m_header.m_magic != m_magic || m_header.m_version != m_version)
+    {
+        LOGSPE(getLog(), "The header of packet is unrecognizable");
+        return false;
+    }
+
+    auto checksum = static_cast<Checksum>(m_header.m_flags & FlagChecksumMask);
+
+    if (checksum > Checksum::None)
+    {
+        LOGSPE(getLog(), "The checksum of packet is unknown");
+        return false;
+    }
+
+    if (m_header.m_hash != headerHash(checksum, m_header))
+    {
+        LOGSPE(getLog(), "The hash of packet header is broken");
+        return false;
+    }
+
+    if (checksum == Checksum::None && m_checksum != Checksum::None)
+    {
+        LOGSPE(getLog(), "The packet without checksum isn't accepted");
+        return false;
     }
 
-    if (m_data.size() >= m_header.m_size)
+    if (m_header.m_size > m_maxPacketSize)
     {
-        RawData packet(addr, m_header.m_size);
+        LOGSPE(getLog(), "The packet is too big");
+        return false;
+    }
 
-        memcpy(packet.raw.data(), m_data.data(), m_header.m_size);
-        m_data.erase(m_data.begin(), m_data.begin() + m_header.m_size);
-        
-        if (m_header.m_dataHash != m_crc.get(packet.raw.data(), packet.raw.size()))
+    if (m_header.m_flags & FlagCompressed)
+    {
+        if (!m_compressionThreshold)
         {
-            LOGSPE(getLog(), "The hash of packet is broken");
-            return RecvStatus::Fault;
+            LOGSPE(getLog(), "The compressed packet isn't accepted");
+            return false;
         }
-        
-        m_recvPackets.push_back(std::move(packet));
 
-        clear();
-        return RecvStatus::Complited;
+        // the ratio of the compression is 255 at most, the buffer of the decompressed size is allocated
+        // before the decompression, so the size is limited too
+        if (m_header.m_reserved / 255 > m_header.m_size || m_header.m_reserved > m_maxPacketSize)
+        {
+            LOGSPE(getLog(), "The size of compressed packet is wrong");
+            return false;
+        }
+    }
+
+    uint16_t accepts = m_header.m_flags & FlagAcceptMask;
+    if (m_peerAccepts.load(std::memory_order_relaxed) != accepts)
+    {
+        m_peerAccepts.store(accepts, std::memory_order_relaxed);
+    }
+
+    m_hasHeader = true;
+    m_payload.reset();
+    return true;
+}
+
+bool PacketNode::completePacket(const Bytes& payload, const sockaddr_in& addr)
+{
+    auto checksum = static_cast<Checksum>(m_header.m_flags & FlagChecksumMask);
+
+    if (m_header.m_dataHash != hash(checksum, payload.data(), payload.size()))
+    {
+        LOGSPE(getLog(), "The hash of packet is broken");
+        return false;
     }
 
-    return RecvStatus::NoComplited;
+    // the decompressed size is known, so the buffer is allocated once
+    if (m_compressionPool)
+    {
+        m_chunk.emplace_back(addr, payload);
+
+        if (m_header.m_flags & FlagCompressed)
+        {
+            m_pendingPackets.push_back({ m_chunk.size() - 1, m_header.m_reserved });
+        }
+    }
+    else
+    {
+        m_recvPackets.emplace_back(addr, payload);
+
+        if ((m_header.m_flags & FlagCompressed) &&
+            !decompress(m_recvPackets[m_recvPackets.size() - 1], m_header.m_reserved))
+        {
+            return false;
+        }
+    }
+
+    clear();
+    return true;
 }
 
 void PacketNode::clear()
 {
     m_header.m_magic = 0;
     m_header.m_size = 0;
+    m_headerSize = 0;
+    m_hasHeader = false;
 }
 
 } // namespace Net
@@ -1,13 +1,19 @@
 
 #pragma once
 
+#include <atomic>
+#include <condition_variable>
 #include <vector>
+#include "net/checksum.h"
 #include "net/node.h"
-#include "crc32.h"
+#include "net/ring_queue.h"
+#include "crc.h"
 
 namespace su
 {
 
+class ThreadPool;
+
 namespace Net
 {
 
@@ -24,35 +30,156 @@ class PacketNode : public Node
         uint32_t m_hash = 0;
     };
 
+    // m_flags: the checksum of the packet, the checksums and the compression which the sender accepts
+    // and the compression of the packet. The old peers send zero flags (Crc32) and don't check the flags.
+    // m_reserved is the size of the decompressed payload of the compressed packet.
+    static constexpr uint16_t FlagChecksumMask = 0x000f;
+    static constexpr uint16_t FlagAcceptCrc32C = 0x0010;
+    static constexpr uint16_t FlagAcceptNone = 0x0020;
+    static constexpr uint16_t FlagAcceptCompression = 0x0040;
+    static constexpr uint16_t FlagCompressed = 0x0100;
+    static constexpr uint16_t FlagAcceptMask = FlagAcceptCrc32C | FlagAcceptNone | FlagAcceptCompression;
+
 public:
     PacketNode() = delete;
     PacketNode(uint32_t magic, SOCKET socket, const sockaddr_in& addr, int32_t id, Log* plog);
-    virtual ~PacketNode() = default;
+    virtual ~PacketNode();
+
+    // The preferred checksum. The packets are sent with Crc32 until the peer reports that it accepts
+    // the preferred one, so the old peers keep working. Checksum::None is also accepted from the peer
+    // only if it is set here.
+    void setChecksum(Checksum checksum) { m_checksum = checksum; }
+    Checksum checksum() const { return m_checksum; }
+    // The checksum of the sent packets
+    Checksum sendChecksum() const;
+
+    // The payloads from the threshold size are compressed (net/compress.h) if the peer has enabled
+    // the compression too, 0 - disabled. The payload is sent as is if it is compressed poorly.
+    // The nodes sharing the broadcast frame use the threshold of one of them.
+    void setCompression(size_t threshold) { m_compressionThreshold = threshold; }
+    size_t compression() const { return m_compressionThreshold; }
+    bool isCompressing() const;
 
+    // The compression of the sent packets and the decompression of the received ones run by the pool,
+    // the order of the packets is kept. The pool must outlive the node. The packets received after
+    // the compressed one are held until it is decompressed, then they are taken by pollRecv()
+    // (the owner is called back by setRecvNotify()) or by the next recv().
+    void setCompressionPool(ThreadPool* pool) { m_compressionPool = pool; }
+
+    // The bigger packets (and the compressed ones decompressing to the bigger size) break the stream
+    void setMaxPacketSize(size_t size) { m_maxPacketSize = size; }
+    size_t maxPacketSize() const { return m_maxPacketSize; }
+
+    // The packets are extracted in the order of receiving
     size_t countRecvPackets() const { return m_recvPackets.size(); }
     RawData extractRecvPacket();
     void clearRecvPackets() { m_recvPackets.clear(); }
 
-    size_t countSendPackets() const { return m_sendPackets.size(); }
-    void clearSendPackets() { m_sendPackets.clear(); }
+    // Passes all received packets to func(RawData&) in order and returns their count,
+    // the callback may keep the packet by moving it
+    template <typename Func>
+    size_t drainRecvPackets(Func&& func)
+    {
+        size_t count = 0;
+
+        while (!m_recvPackets.empty())
+        {
+            RawData packet = m_recvPackets.pop_front();
+            func(packet);
+            ++count;
+        }
+        return count;
+    }
+
+    // The count of the queued segments, the packet sent by send(const Bytes&) takes two segments.
+    // The packets which are being compressed by the pool aren't counted here, but they are counted
+    // by sizeSendBuffer(), the water marks and the budget.
+    size_t countSendPackets() const { return countSendSegments(); }
+    void clearSendPackets();
 
     // su::Net::Node
     virtual RecvStatus recv(uint8_t* data, size_t size, const sockaddr_in& addr) override;
+    virtual RecvStatus recv(const Bytes& data, const sockaddr_in& addr) override;
+    virtual RecvStatus pollRecv() override;
+    // The header and the payload are queued as the one segment
     virtual size_t send(const void* data, size_t size) override;
-    virtual bool sendToSocket() override;
+    // The payload is queued as the separate segment without copying
+    virtual size_t send(const Bytes& data) override;
+    virtual uint64_t frameKey() const override;
+    virtual Frame frame(const Bytes& payload) override;
+    virtual size_t sendFrame(const Frame& frame) override;
 
 protected:
-    RecvStatus checkData(const sockaddr_in& addr);
+    void fillHeader(PacketHeader& header, uint16_t flags, const void* data, size_t size, size_t originalSize);
+    uint16_t sendFlags() const;
+    bool shouldCompress(size_t size) const;
+    Bytes compress(const Bytes& payload);
+    bool decompress(RawData& packet, size_t originalSize);
+    void decompressPending();
+    bool deliverDecompressed();
+    RecvStatus fault();
+    bool postSend(const Frame& job, bool isCompressed, size_t& sent);
+    void runSend();
+    uint32_t hash(Checksum checksum, const void* data, size_t size);
+    uint32_t headerHash(Checksum checksum, const PacketHeader& header);
+    bool parseHeader();
+    bool completePacket(const Bytes& payload, const sockaddr_in& addr);
     void clear();
 
 protected:
+    // The payload is preallocated up to this size, the bigger payload grows while it is received
+    static constexpr size_t MaxPreallocation = 1024 * 1024;
+    static constexpr size_t DefaultMaxPacketSize = 64 * 1024 * 1024;
+
     uint32_t m_magic;
     const uint16_t m_version = 0x0100;
-    std::vector<uint8_t> m_data;
-    std::vector<RawData> m_recvPackets;
-    std::vector<std::vector<uint8_t>> m_sendPackets;
+    // The stream is parsed in place: the header is gathered into m_headerData, the payload lying in
+    // the received chunk entirely is passed as the view, the split one is gathered into m_payload
+    // taken from m_payloadPool
+    uint8_t m_headerData[sizeof(PacketHeader)];
+    size_t m_headerSize = 0;
+    bool m_hasHeader = false;
+    std::shared_ptr<std::vector<uint8_t>> m_payload;
+    BufferPool m_payloadPool;
+    RingQueue<RawData> m_recvPackets;
     PacketHeader m_header;
-    Crc32 m_crc;
+    Crc32 m_crc = Crc32(Polynomial::CRC32_IEEE);
+    Checksum m_checksum = Checksum::Crc32C;
+    // The accepting flags of the last packet of the peer, it is read by the sending threads
+    std::atomic<uint16_t> m_peerAccepts = 0;
+
+    size_t m_maxPacketSize = DefaultMaxPacketSize;
+
+    size_t m_compressionThreshold = 0;
+    ThreadPool* m_compressionPool = nullptr;
+    // With the pool the packets of the received chunk are gathered into m_chunk, its compressed packets
+    // are decompressed by the pool tasks, one per packet. The chunks are delivered to m_recvPackets in order
+    // when all their packets are decompressed, the chunk without the compressed packets waits for the earlier ones.
+    struct PendingPacket
+    {
+        size_t m_index;
+        size_t m_originalSize;
+    };
+    struct DecompressChunk
+    {
+        std::vector<RawData> m_packets;
+        std::vector<PendingPacket> m_pending;
+        // the buffers are taken by the thread of the node, the tasks only fill them
+        std::vector<std::shared_ptr<std::vector<uint8_t>>> m_buffers;
+        std::atomic<size_t> m_remaining = 0;
+        std::atomic<bool> m_isBroken = false;
+    };
+    std::vector<RawData> m_chunk;
+    std::vector<PendingPacket> m_pendingPackets;
+    RingQueue<std::shared_ptr<DecompressChunk>> m_decompressing;
+    // The payloads waiting for the compression by the pool (the frames without the header) and the frames
+    // queued after them, they are sent by one task in order
+    std::mutex m_sendMutex;
+    std::condition_variable m_sendCV;
+    RingQueue<Frame> m_sendJobs;
+    bool m_isSendRunning = false;
+    // The decompression tasks referring to this node, they are guarded by m_sendMutex
+    size_t m_decompressTasks = 0;
 };
 
 } // namespace Net
@@ -0,0 +1,131 @@
+#pragma once
+
+// The thin layer over the platform sockets: the socket handle type, the error codes,
+// the non-blocking mode and the closing of the socket.
+
+#ifdef _WIN32
+
+#define WIN32_LEAN_AND_MEAN
+#include <winsock2.h>
+#include <ws2tcpip.h>
+
+#define SU_SHUT_SEND  SD_SEND
+#define SU_SEND_FLAGS 0
+
+#else
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <netinet/udp.h>
+// The UDP offloads of the newer kernels, the older headers don't define them
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+#endif
+
+using SOCKET = int;
+
+#ifndef SOCKET_ERROR
+#define SOCKET_ERROR   (-1)
+#endif
+#ifndef INVALID_SOCKET
+#define INVALID_SOCKET (-1)
+#endif
+
+#define SU_SHUT_SEND  SHUT_WR
+
+// Don't raise SIGPIPE if the remote side has closed the connection
+#ifdef MSG_NOSIGNAL
+#define SU_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define SU_SEND_FLAGS 0
+#endif
+
+#endif
+
+namespace su
+{
+namespace Net
+{
+
+inline int closeSocket(SOCKET socket)
+{
+#ifdef _WIN32
+    return ::closesocket(socket);
+#else
+    return ::close(socket);
+#endif
+}
+
+inline int getSocketError()
+{
+#ifdef _WIN32
+    return ::WSAGetLastError();
+#else
+    return errno;
+#endif
+}
+
+inline bool isWouldBlock(int error)
+{
+#ifdef _WIN32
+    return error == WSAEWOULDBLOCK;
+#else
+    return error == EAGAIN || error == EWOULDBLOCK;
+#endif
+}
+
+inline bool setNoBlock(SOCKET socket)
+{
+#ifdef _WIN32
+    u_long uflag = 1;
+    return ::ioctlsocket(socket, FIONBIO, &uflag) != SOCKET_ERROR;
+#else
+    int flags = ::fcntl(socket, F_GETFL, 0);
+    return flags != -1 && ::fcntl(socket, F_SETFL, flags | O_NONBLOCK) != -1;
+#endif
+}
+
+// Accepts the connection in the non-blocking mode. On Linux the socket isn't inherited by the child processes and
+// it inherits the options of the listener (the buffers, TCP_NODELAY, the keepalive), INVALID_SOCKET - no connection
+inline SOCKET acceptNoBlock(SOCKET listener, sockaddr_in& addr)
+{
+    socklen_t size = sizeof(addr);
+
+#ifdef __linux__
+    return ::accept4(listener, (sockaddr*)&addr, &size, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+    SOCKET socket = ::accept(listener, (sockaddr*)&addr, &size);
+
+    if (socket != INVALID_SOCKET && !setNoBlock(socket))
+    {
+        closeSocket(socket);
+        return INVALID_SOCKET;
+    }
+    return socket;
+#endif
+}
+
+// Closes the socket by RST, so the rejected connection doesn't stay in TIME_WAIT
+inline void resetSocket(SOCKET socket)
+{
+    linger reset = { 1, 0 };
+
+    ::setsockopt(socket, SOL_SOCKET, SO_LINGER, (const char*)&reset, sizeof(reset));
+    closeSocket(socket);
+}
+
+} // namespace Net
+} // namespace su
@@ -0,0 +1,286 @@
+#include "net/poller.h"
+
+#include <algorithm>
+#include <limits.h>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+
+namespace su
+{
+namespace Net
+{
+
+#ifdef __linux__
+
+static uint32_t toEpoll(uint32_t events, bool edgeTriggered)
+{
+    uint32_t out = EPOLLRDHUP;
+
+    out |= (events & Poller::Read) ? uint32_t(EPOLLIN) : 0u;
+    out |= (events & Poller::Write) ? uint32_t(EPOLLOUT) : 0u;
+    out |= edgeTriggered ? uint32_t(EPOLLET) : 0u;
+
+    return out;
+}
+
+Poller::Poller()
+{
+    m_epoll = ::epoll_create1(EPOLL_CLOEXEC);
+    m_wake = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    // the wake event is reported with the poller itself as the data
+    if (m_epoll >= 0 && m_wake >= 0 && !add(m_wake, this, Read, false))
+    {
+        ::close(m_wake);
+        m_wake = -1;
+    }
+}
+
+Poller::~Poller()
+{
+    if (m_wake >= 0)
+    {
+        ::close(m_wake);
+    }
+
+    if (m_epoll >= 0)
+    {
+        ::close(m_epoll);
+    }
+}
+
+bool Poller::isValid() const
+{
+    return m_epoll >= 0 && m_wake >= 0;
+}
+
+void Poller::wake()
+{
+    uint64_t value = 1;
+
+    if (m_wake >= 0)
+    {
+        (void)!::write(m_wake, &value, sizeof(value));
+    }
+}
+
+void Poller::drainWake()
+{
+    uint64_t value = 0;
+    (void)!::read(m_wake, &value, sizeof(value));
+}
+
+bool Poller::add(SOCKET socket, void* data, uint32_t events, bool edgeTriggered)
+{
+    epoll_event ev = {};
+    ev.events = toEpoll(events, edgeTriggered);
+    ev.data.ptr = data;
+
+    return ::epoll_ctl(m_epoll, EPOLL_CTL_ADD, socket, &ev) == 0;
+}
+
+bool Poller::modify(SOCKET socket, void* data, uint32_t events, bool edgeTriggered)
+{
+    epoll_event ev = {};
+    ev.events = toEpoll(events, edgeTriggered);
+    ev.data.ptr = data;
+
+    return ::epoll_ctl(m_epoll, EPOLL_CTL_MOD, socket, &ev) == 0;
+}
+
+bool Poller::remove(SOCKET socket)
+{
+    epoll_event ev = {};
+    return ::epoll_ctl(m_epoll, EPOLL_CTL_DEL, socket, &ev) == 0;
+}
+
+int Poller::wait(std::vector<Event>& events, uint32_t timeoutUSec)
+{
+    epoll_event ready[256];
+
+    events.clear();
+
+    int timeout = static_cast<int>(std::min<uint64_t>((uint64_t(timeoutUSec) + 999) / 1000, INT_MAX));
+    int count = ::epoll_wait(m_epoll, ready, 256, timeout);
+    if (count < 0)
+    {
+        return errno == EINTR ? 0 : -1;
+    }
+
+    for (int ii = 0; ii < count; ++ii)
+    {
+        if (ready[ii].data.ptr == this)
+        {
+            drainWake();
+            continue;
+        }
+
+        Event item;
+
+        item.m_data = ready[ii].data.ptr;
+        item.m_events |= (ready[ii].events & EPOLLIN) ? uint32_t(Read) : 0u;
+        item.m_events |= (ready[ii].events & EPOLLOUT) ? uint32_t(Write) : 0u;
+        item.m_events |= (ready[ii].events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) ? uint32_t(Error) : 0u;
+
+        events.push_back(item);
+    }
+
+    return static_cast<int>(events.size());
+}
+
+#else
+
+Poller::Poller()
+{
+    sockaddr_in addr = {};
+    socklen_t size = sizeof(addr);
+
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    // select() waits only for the sockets, so the poller is woken by the datagram to its own socket
+    m_wake = ::socket(AF_INET, SOCK_DGRAM, 0);
+    if (m_wake == SOCKET_ERROR ||
+        ::bind(m_wake, (sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR ||
+        ::getsockname(m_wake, (sockaddr*)&addr, &size) == SOCKET_ERROR ||
+        ::connect(m_wake, (sockaddr*)&addr, sizeof(addr)) == SOCKET_ERROR ||
+        !setNoBlock(m_wake) ||
+        !add(m_wake, this, Read, false))
+    {
+        if (m_wake != SOCKET_ERROR)
+        {
+            closeSocket(m_wake);
+        }
+        m_wake = SOCKET_ERROR;
+    }
+}
+
+Poller::~Poller()
+{
+    if (m_wake != SOCKET_ERROR)
+    {
+        closeSocket(m_wake);
+    }
+}
+
+bool Poller::isValid() const
+{
+    return m_wake != SOCKET_ERROR;
+}
+
+void Poller::wake()
+{
+    char byte = 0;
+
+    if (m_wake != SOCKET_ERROR)
+    {
+        ::send(m_wake, &byte, 1, SU_SEND_FLAGS);
+    }
+}
+
+void Poller::drainWake()
+{
+    char buffer[64];
+
+    while (::recv(m_wake, buffer, sizeof(buffer), 0) > 0)
+    {
+    }
+}
+
+bool Poller::add(SOCKET socket, void* data, uint32_t events, bool)
+{
+    if (m_sockets.size() >= FD_SETSIZE)
+    {
+        return false;
+    }
+
+    return m_sockets.emplace(socket, Registration{data, events}).second;
+}
+
+bool Poller::modify(SOCKET socket, void* data, uint32_t events, bool)
+{
+    auto item = m_sockets.find(socket);
+    if (item == m_sockets.end())
+    {
+        return false;
+    }
+
+    item->second = Registration{data, events};
+    return true;
+}
+
+bool Poller::remove(SOCKET socket)
+{
+    return m_sockets.erase(socket) > 0;
+}
+
+int Poller::wait(std::vector<Event>& events, uint32_t timeoutUSec)
+{
+    fd_set readfds;
+    fd_set writefds;
+    fd_set exfds;
+    timeval tv;
+    SOCKET maxFd = 0;
+
+    events.clear();
+
+    FD_ZERO(&readfds);
+    FD_ZERO(&writefds);
+    FD_ZERO(&exfds);
+    tv.tv_sec = timeoutUSec / 1000000;
+    tv.tv_usec = timeoutUSec % 1000000;
+
+    for (auto& item : m_sockets)
+    {
+        if (item.second.m_events & Read)
+        {
+            FD_SET(item.first, &readfds);
+        }
+        if (item.second.m_events & Write)
+        {
+            FD_SET(item.first, &writefds);
+        }
+        FD_SET(item.first, &exfds);
+
+        maxFd = item.first > maxFd ? item.first : maxFd;
+    }
+
+    if (::select((int)maxFd + 1, &readfds, &writefds, &exfds, &tv) == SOCKET_ERROR)
+    {
+        return -1;
+    }
+
+    for (auto& item : m_sockets)
+    {
+        if (item.second.m_data == this)
+        {
+            if (FD_ISSET(item.first, &readfds))
+            {
+                drainWake();
+            }
+            continue;
+        }
+
+        Event ev;
+
+        ev.m_data = item.second.m_data;
+        ev.m_events |= FD_ISSET(item.first, &readfds) ? uint32_t(Read) : 0u;
+        ev.m_events |= FD_ISSET(item.first, &writefds) ? uint32_t(Write) : 0u;
+        ev.m_events |= FD_ISSET(item.first, &exfds) ? uint32_t(Error) : 0u;
+
+        if (ev.m_events)
+        {
+            events.push_back(ev);
+        }
+    }
+
+    return static_cast<int>(events.size());
+}
+
+#endif
+
+} // namespace Net
+} // namespace su
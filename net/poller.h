@@ -0,0 +1,81 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <unordered_map>
+
+#include "net/platform.h"
+
+namespace su
+{
+namespace Net
+{
+
+// Readiness notification for the many sockets: epoll on Linux, select() on the other platforms.
+// The socket is registered once and only the ready sockets are returned by wait().
+class Poller
+{
+public:
+    enum EventFlag : uint32_t
+    {
+        None  = 0,
+        Read  = 1,
+        Write = 2,
+        Error = 4, // error or hang up, the pending data can be still read
+    };
+
+    struct Event
+    {
+        void* m_data = nullptr;
+        uint32_t m_events = 0;
+    };
+
+    Poller();
+    virtual ~Poller();
+
+    Poller(const Poller&) = delete;
+    Poller& operator=(const Poller&) = delete;
+
+    bool isValid() const;
+
+    // The edge triggered socket is reported only when its state is changed, so the reader
+    // must read it until EWOULDBLOCK. The select() backend is always level triggered.
+    bool add(SOCKET socket, void* data, uint32_t events, bool edgeTriggered);
+    bool modify(SOCKET socket, void* data, uint32_t events, bool edgeTriggered);
+    bool remove(SOCKET socket);
+
+    // Returns the count of the ready sockets or -1 on error. The epoll timeout is rounded up to msec,
+    // so the waiting doesn't end before the deadline.
+    int wait(std::vector<Event>& events, uint32_t timeoutUSec);
+
+    // Wakes up wait() of the other thread, the wake up before the waiting isn't lost.
+    // It is the eventfd on Linux and the datagram to the own loopback socket on the other platforms.
+    void wake();
+
+#ifdef __linux__
+    // The epoll descriptor, it is readable while any registered socket is ready or the poller is woken
+    int fd() const { return m_epoll; }
+#endif
+
+private:
+    void drainWake();
+
+private:
+#ifdef __linux__
+    int m_epoll = -1;
+    int m_wake = -1;
+#else
+    SOCKET m_wake = SOCKET_ERROR;
+
+    struct Registration
+    {
+        void* m_data;
+        uint32_t m_events;
+    };
+
+    std::unordered_map<SOCKET, Registration> m_sockets;
+#endif
+};
+
+} // namespace Net
+} // namespace su
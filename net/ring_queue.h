@@ -0,0 +1,90 @@
+#pragma once
+
+#include <stddef.h>
+#include <utility>
+#include <vector>
+
+namespace su
+{
+namespace Net
+{
+
+// The FIFO queue over the ring of the slots. The capacity is the power of 2 and it grows
+// by doubling, the slots are reused, so the steady flow doesn't allocate.
+template <typename T>
+class RingQueue
+{
+public:
+    explicit RingQueue(size_t capacity = 16)
+    {
+        size_t size = 1;
+        while (size < capacity)
+        {
+            size <<= 1;
+        }
+        m_slots.resize(size);
+    }
+
+    size_t size() const { return m_tail - m_head; }
+    bool empty() const { return m_tail == m_head; }
+
+    T& front() { return m_slots[m_head & (m_slots.size() - 1)]; }
+    T& operator[](size_t index) { return m_slots[(m_head + index) & (m_slots.size() - 1)]; }
+
+    template <typename... Args>
+    T& emplace_back(Args&&... args)
+    {
+        if (size() == m_slots.size())
+        {
+            grow();
+        }
+
+        auto& slot = m_slots[m_tail & (m_slots.size() - 1)];
+        slot = T(std::forward<Args>(args)...);
+        ++m_tail;
+        return slot;
+    }
+
+    void push_back(T value) { emplace_back(std::move(value)); }
+
+    T pop_front()
+    {
+        auto out = std::move(front());
+        front() = T();
+        ++m_head;
+        return out;
+    }
+
+    void clear()
+    {
+        while (!empty())
+        {
+            pop_front();
+        }
+        m_head = m_tail = 0;
+    }
+
+private:
+    void grow()
+    {
+        std::vector<T> slots(m_slots.size() * 2);
+        size_t count = size();
+
+        for (size_t ii = 0; ii < count; ++ii)
+        {
+            slots[ii] = std::move((*this)[ii]);
+        }
+
+        m_slots.swap(slots);
+        m_head = 0;
+        m_tail = count;
+    }
+
+private:
+    std::vector<T> m_slots;
+    size_t m_head = 0;
+    size_t m_tail = 0;
+};
+
+} // namespace Net
+} // namespace su
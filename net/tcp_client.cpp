@@ -1,5 +1,5 @@
 
-#include "tcp_client.h"
+#include "net/tcp_client.h"
 
 namespace su
 {
@@ -83,7 +83,20 @@ bool TcpClient::doConnect()
 
 size_t TcpClient::send(void* packet, size_t size)
 {
-    return m_node.send(packet, size);
+    auto out = m_node.send(packet, size);
+
+    // flush the data without waiting of the thread delay
+    if (!m_node.sendDelay())
+    {
+        notify();
+    }
+    return out;
+}
+
+void TcpClient::flush()
+{
+    m_node.flush();
+    notify();
 }
 
 void TcpClient::restartKeepAliveTimer()
@@ -167,6 +180,29 @@ void TcpClient::doWork()
         }
     }
 
+    // The packets completed by the pool since the last tick (e.g. decompressed)
+    auto completed = m_node.pollRecv();
+
+    if (completed == Fault)
+    {
+        LOGSPW(m_log, "Can not receive the data from the server.");
+        destroy();
+        return;
+    }
+    else if (completed == Complited && !onRecvFromNode())
+    {
+        LOGSPW(m_log, "Can not process the data from the server.");
+        destroy();
+        return;
+    }
+
+    if (m_node.isSendOverflowed())
+    {
+        LOGSPW(m_log, "The send buffer is overflowed. Disconnecting");
+        destroy();
+        return;
+    }
+
     if (!m_node.sendToSocket())
     {
         LOGSPW(m_log, "Can not send data to server. Disconnecting");
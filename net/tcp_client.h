@@ -26,7 +26,10 @@ public:
     void disconnect();
     Node* getNode() { return &m_node; }
     void connect(const std::string& ip, uint16_t port);
+    // The coalesced data (Node::setCoalescing()) is written by the thread when it is due,
+    // the delay is checked with the period of the thread
     size_t send(void* packet, size_t size);
+    void flush();
     Result getLastError() const { return m_lastError; }
     void restartKeepAliveTimer();
 
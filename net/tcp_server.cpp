@@ -1,15 +1,31 @@
 
 #include "net/tcp_server.h"
+#include "net/io_uring.h"
 
 #include <algorithm>
-#include <WS2tcpip.h>
-#include <fcntl.h>
 
 namespace su
 {
 namespace Net
 {
 
+// The thread of the additional reactor
+class TcpServer::ReactorThread : public ThreadClass
+{
+public:
+    ReactorThread(TcpServer& server, Reactor& reactor) : m_server(server), m_reactor(reactor) {}
+    virtual ~ReactorThread() { close(); }
+
+protected:
+    virtual void doWork() override { m_server.doWorkReactor(m_reactor); }
+    virtual void doFinished() override {}
+    virtual void wakeUp() override { m_reactor.m_poller.wake(); }
+
+private:
+    TcpServer& m_server;
+    Reactor& m_reactor;
+};
+
 TcpServer::TcpServer(const std::string& ip, uint16_t port, uint32_t maxClients, Log *plog)
 {
     m_maxClients = maxClients ? maxClients : 0xffffffff;
@@ -20,9 +36,17 @@ TcpServer::TcpServer(const std::string& ip, uint16_t port, uint32_t maxClients,
 
 TcpServer::~TcpServer()
 {
+    // the thread of the first reactor is stopped before its state is destroyed
+    close();
     destroy();
 }
 
+std::thread* TcpServer::run(size_t delay)
+{
+    m_stoppedDelay = delay;
+    return ThreadClass::run(0);
+}
+
 void TcpServer::setIp(const std::string& ip, uint16_t port)
 {
     if (isStarted())
@@ -52,38 +76,175 @@ Result TcpServer::start(const std::string& ip, uint16_t port)
 
     std::lock_guard<std::mutex> lock(m_mutex);
 
-    m_node.configureAddress(m_hostIp, m_hostPort);
+    m_reactors.clear();
+    m_nextReactor = 0;
+
+#ifdef SO_REUSEPORT
+    m_isHandingOff = false;
+#else
+    m_isHandingOff = m_reactorCount > 1;
+#endif
 
-    if ((result = m_node.createTcpServer()) != OK)
+    for (uint32_t ii = 0; ii < m_reactorCount; ++ii)
     {
-        return result;
+        m_reactors.push_back(std::make_unique<Reactor>());
+        m_reactors.back()->m_index = ii;
+
+        if ((result = openReactor(*m_reactors.back())) != OK)
+        {
+            destroy();
+            return result;
+        }
     }
 
-    if ((result = m_node.configureParameters()) != OK)
+    m_isStarted = true;
+
+    // The first reactor works on the thread of the server
+    for (size_t ii = 1; ii < m_reactors.size(); ++ii)
     {
-        return result;
+        m_reactors[ii]->m_thread = std::make_unique<ReactorThread>(*this, *m_reactors[ii]);
+        m_reactors[ii]->m_thread->run(0);
     }
 
-    if ((result = m_node.openTcpServer()) != OK)
+    return OK;
+}
+
+Result TcpServer::openReactor(Reactor& reactor)
+{
+    Result result = OK;
+    bool isListener = !m_isHandingOff || reactor.m_index == 0;
+
+    if (isListener)
     {
-        return result;
+        reactor.m_node.configureAddress(m_hostIp, m_hostPort);
+
+        if ((result = reactor.m_node.createTcpServer()) != OK)
+        {
+            return result;
+        }
+
+        if ((result = reactor.m_node.configureParameters()) != OK)
+        {
+            return result;
+        }
+
+#ifdef __linux__
+        // The accepted sockets inherit the options of the listener, they aren't set per client
+        if ((result = reactor.m_node.configureKeepAlive()) != OK)
+        {
+            return result;
+        }
+#endif
+
+        if (m_reactorCount > 1 && !m_isHandingOff && (result = reactor.m_node.configureReusePort()) != OK)
+        {
+            return result;
+        }
+
+        if ((result = reactor.m_node.openTcpServer()) != OK)
+        {
+            return result;
+        }
     }
 
-    m_isStarted = true;
+    reactor.m_acceptTokens = std::max(1.0, double(m_acceptBurst) / m_reactorCount);
+    reactor.m_acceptTime = std::chrono::steady_clock::now();
+
+    if (m_ioEngine == IoEngine::Uring && !startUring(reactor))
+    {
+        LOGSPW(m_log, "The io_uring is not supported. The poller will be used");
+        m_ioEngine = IoEngine::Poller;
+
+        // the previous reactors are switched to the poller as well
+        for (auto& item : m_reactors)
+        {
+            if (item->m_uring && item.get() != &reactor)
+            {
+                item->m_uring.reset();
+
+                if (item->m_node.isConnected() && !item->m_poller.add(item->m_node.socket(), &item->m_node, Poller::Read, false))
+                {
+                    return CantListen;
+                }
+            }
+        }
+    }
+
+    if (!reactor.m_poller.isValid())
+    {
+        reactor.m_node.disconnect();
+        return CantListen;
+    }
+
+    // The listener is level triggered, so the not accepted clients will be reported on the next tick
+    if (m_ioEngine == IoEngine::Poller && isListener &&
+        !reactor.m_poller.add(reactor.m_node.socket(), &reactor.m_node, Poller::Read, false))
+    {
+        reactor.m_node.disconnect();
+        return CantListen;
+    }
 
     return OK;
 }
 
 void TcpServer::destroy()
 {
-    for (auto item: m_clients)
+    // The reactor threads are stopped before their state is cleared
+    for (auto& reactor : m_reactors)
     {
-        LOGSPI(m_log, "Delete client %s", item->fullId().c_str());
-        delete item;
+        reactor->m_thread.reset();
+    }
+
+    for (auto& reactor : m_reactors)
+    {
+        std::lock_guard<std::mutex> lock(reactor->m_mutex);
+
+        for (auto item: reactor->m_clients)
+        {
+            LOGSPI(m_log, "Delete client %s", item->fullId().c_str());
+
+            if (!reactor->m_uring)
+            {
+                reactor->m_poller.remove(item->socket());
+            }
+
+            // the node may be still held by the sending thread
+            item->detachOwner();
+            item->disconnect();
+        }
+
+        {
+            std::lock_guard<std::mutex> lockClients(reactor->m_clientsMutex);
+
+            reactor->m_clients.clear();
+            reactor->m_clientSet.clear();
+        }
+        reactor->m_writeWatched.clear();
+
+        {
+            std::lock_guard<std::mutex> lockSend(reactor->m_sendMutex);
+            reactor->m_pendingSend.clear();
+            reactor->m_pendingRecv.clear();
+
+            for (auto& item : reactor->m_incoming)
+            {
+                closeSocket(item.first);
+            }
+            reactor->m_incoming.clear();
+        }
+
+        if (reactor->m_node.isConnected() && !reactor->m_uring)
+        {
+            reactor->m_poller.remove(reactor->m_node.socket());
+        }
+
+        // The in-flight operations are canceled by closing of the ring
+        reactor->m_uring.reset();
+
+        reactor->m_node.disconnect();
+        reactor->m_clientsCount.store(0);
     }
-    m_clients.clear();
 
-    m_node.disconnect();
     m_isStarted = false;
 }
 
@@ -91,7 +252,7 @@ void TcpServer::doFinished()
 {
     std::lock_guard<std::mutex> lock(m_mutex);
 
-    LOGSPW(m_log, "TcpServer %s has been finished", m_node.fullId().c_str());
+    LOGSPW(m_log, "TcpServer %s has been finished", node() ? node()->fullId().c_str() : "");
     destroy();
 }
 
@@ -99,244 +260,879 @@ void TcpServer::doWork()
 {
     if (!isStarted())
     {
+        waitEvent(m_stoppedDelay.load(), false);
         return;
     }
 
-    std::lock_guard<std::mutex> lock(m_mutex);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (m_reactors.empty() || (m_reactors[0]->m_node.socket() == SOCKET_ERROR))
+        {
+            destroy();
+            finish();
+            return;
+        }
+    }
 
-    if (m_node.socket() == SOCKET_ERROR)
+    // The reactor waits without the lock, the reactors aren't changed while the server is started
+    doWorkReactor(*m_reactors[0]);
+}
+
+void TcpServer::wakeUp()
+{
+    if (isStarted() && m_reactors.size())
+    {
+        m_reactors[0]->m_poller.wake();
+    }
+}
+
+void TcpServer::doWorkReactor(Reactor& reactor)
+{
+    if (!isStarted())
     {
-        destroy();
-        finish();
         return;
     }
 
-    SOCKET sockAccept;
-    sockaddr_in sinAccept;
-    int sinSize = sizeof(sinAccept);
-    SOCKET maxFd;
-    fd_set readfds;
-    fd_set exfds;
-    timeval tv;
+    std::lock_guard<std::mutex> lock(reactor.m_mutex);
+
+    // The clients handed by the acceptor
+    if (m_isHandingOff)
+    {
+        std::vector<std::pair<SOCKET, sockaddr_in>> incoming;
+        {
+            std::lock_guard<std::mutex> lockSend(reactor.m_sendMutex);
+            incoming.swap(reactor.m_incoming);
+        }
 
-    FD_ZERO(&readfds);
-    FD_ZERO(&exfds);
-    FD_SET(m_node.socket(), &exfds);
-    tv.tv_sec = m_selectSec;
-    tv.tv_usec = m_selectUSec;
-    maxFd = m_node.socket();
+        for (auto& item : incoming)
+        {
+            addClient(reactor, item.first, item.second);
+        }
+    }
 
-    for (auto client: m_clients)
+    if (reactor.m_uring)
     {
-        FD_SET(client->socket(), &readfds);
-        FD_SET(client->socket(), &exfds);
+        doWorkUring(reactor);
+        pollRecv(reactor);
+        expireIdle(reactor);
+        reactor.m_clientsCount.store(static_cast<uint32_t>(reactor.m_clients.size()));
+        return;
+    }
 
-        maxFd = m_node.socket() > client->socket() ? m_node.socket() : client->socket();
+    if (reactor.m_poller.wait(reactor.m_events, waitTimeout(reactor)) < 0)
+    {
+        LOGSPE(m_log, "The poller fault. Error: %i", getSocketError());
+        return;
     }
 
-    if (select((int)maxFd + 1, &readfds, NULL, &exfds, &tv) != SOCKET_ERROR)
+    reactor.m_flushList.clear();
+
+    for (auto& event : reactor.m_events)
     {
-        if ((sockAccept = accept(m_node.socket(), (sockaddr *)&sinAccept, &sinSize)) != SOCKET_ERROR)
+        if (event.m_data == &reactor.m_node)
         {
-            uint8_t* ip = (uint8_t*)&sinAccept.sin_addr.s_addr;
-            LOGSPN(m_log, "Accepting the client from %u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+            acceptClient(reactor);
+            continue;
+        }
+
+        auto client = static_cast<Node*>(event.m_data);
 
-            if (!checkWhiteIp(sinAccept.sin_addr.s_addr))
+        if (event.m_events & (Poller::Read | Poller::Error))
+        {
+            if (!readClient(reactor, client))
             {
-                LOGSPN(m_log, "Accepting client not present in the `white list`. The %02i.%02i.%02i.%02i client has been disconted",
-                       ip[0], ip[1], ip[2], ip[3]);
-                //shutdown(sockAccept, SD_BOTH);
-                closesocket(sockAccept);
+                continue;
             }
-            else
-            {
-                Result result = OK;
-                auto acceptedClient = newClient(sockAccept, sinAccept);
-                LOGSPN(m_log, "The client %s has been created", acceptedClient->fullId().c_str());
+        }
 
-                if (acceptedClient && (result = acceptedClient->configureParameters()) != OK)
-                {
-                    LOGSPN(m_log, "Failed to configure the accepting client parameters. The %s client has been disconted",
-                           acceptedClient->fullId().c_str());
-                    delete acceptedClient;
-                    acceptedClient = nullptr;
-                }
+        if (event.m_events & Poller::Write)
+        {
+            reactor.m_flushList.push_back(client);
+        }
+    }
 
-                if (acceptedClient && (result = acceptedClient->configureKeepAlive()) != OK)
-                {
-                    LOGSPN(m_log, "Failed to configure the accepting client keep alive property. The %s client has been disconted",
-                           acceptedClient->fullId().c_str());
-                    delete acceptedClient;
-                    acceptedClient = nullptr;
-                }
+    pollRecv(reactor);
 
-                if (acceptedClient)
-                {
-                    if (m_immediatelyCloseClients)
-                    {
-                        acceptedClient->configureImmediatelyClose();
-                    }
-
-                    m_clients.push_back(acceptedClient);
-                    onClientJoin(acceptedClient);
-                    LOGSPN(m_log, "The client %s has been accepted", acceptedClient->fullId().c_str());
-
-                    if (m_clients.size() > m_maxClients)
-                    {
-                        onClientDisconnected(m_clients[0]);
-                        LOGSPW(m_log, "Maximum number of connected clients reached. The first client %s will be disconnected",
-                               m_clients[0]->fullId().c_str());
-
-                        delete m_clients[0];
-                        m_clients.erase(m_clients.begin());
-                    }
-                }
-            }
-        }
+    // The clients with the new data in the send buffer
+    {
+        std::lock_guard<std::mutex> lockSend(reactor.m_sendMutex);
+
+        reactor.m_flushList.insert(reactor.m_flushList.end(), reactor.m_pendingSend.begin(), reactor.m_pendingSend.end());
+        reactor.m_pendingSend.clear();
     }
 
-    if (FD_ISSET(m_node.socket(), &exfds))
+    reactor.m_flushList.insert(reactor.m_flushList.end(), reactor.m_coalescing.begin(), reactor.m_coalescing.end());
+    reactor.m_coalescing.clear();
+
+    for (auto client : reactor.m_flushList)
     {
-        //TRACEW(LogMask, "Ошибка обработки клиентов на '%s:%i/%i'.", m_hostIP.c_str(), m_hostPort, ServAddr.sin_port);
-        //break; // ERROR
+        // the client may be deleted already
+        if (!reactor.m_clientSet.count(client))
+        {
+            continue;
+        }
+
+        flushClient(reactor, client);
     }
 
-    for (unsigned int ii = 0; ii < m_clients.size(); ++ii)
+    expireIdle(reactor);
+    reactor.m_clientsCount.store(static_cast<uint32_t>(reactor.m_clients.size()));
+}
+
+void TcpServer::acceptClient(Reactor& reactor)
+{
+    // The backlog is drained by the batch, the listener is level triggered, so the rest is reported on the next tick
+    for (uint32_t ii = 0; ii < m_acceptBatch; ++ii)
     {
-        auto client = m_clients[ii];
+        sockaddr_in sinAccept;
+        SOCKET sockAccept = acceptNoBlock(reactor.m_node.socket(), sinAccept);
 
-        if (FD_ISSET(client->socket(), &exfds))
+        if (sockAccept == INVALID_SOCKET)
         {
-            onClientDisconnected(client);
+            return;
+        }
 
-            LOGSPN(m_log, "Disconnecting the client %s", client->fullId().c_str());
-            delete client;
-            m_clients.erase(m_clients.begin() + ii);
-            --ii;
+        if (!m_isHandingOff)
+        {
+            addClient(reactor, sockAccept, sinAccept);
             continue;
         }
-        else if (FD_ISSET(client->socket(), &readfds))
+
+        // The acceptor hands the clients round-robin
+        auto& target = *m_reactors[m_nextReactor++ % m_reactors.size()];
+        if (&target == &reactor)
         {
-            auto result = client->readFromSocket();
+            addClient(reactor, sockAccept, sinAccept);
+            continue;
+        }
 
-            if (result == Fault)
-            {
-                onClientDisconnected(client);
+        {
+            std::lock_guard<std::mutex> lockSend(target.m_sendMutex);
+            target.m_incoming.emplace_back(sockAccept, sinAccept);
+        }
+        wakeReactor(target);
+    }
+}
 
-                LOGSPN(m_log, "The client %s has been disconnected", client->fullId().c_str());
-                delete client;
-                m_clients.erase(m_clients.begin() + ii);
-                --ii;
-                continue;
-            }
-            else if (result == Complited && !onRecvFromNode(client))
-            {
-                onClientDisconnected(client);
+bool TcpServer::admitClient(Reactor& reactor)
+{
+    // The limit is common for all reactors
+    if (clientsCount() >= m_maxClients)
+    {
+        LOGSPW(m_log, "Maximum number of connected clients reached. The client has been rejected");
+        ++m_rejectedClients;
+        return false;
+    }
 
-                LOGSPN(m_log, "The client %s was disconnect", client->fullId().c_str());
-                delete client;
-                m_clients.erase(m_clients.begin() + ii);
-                --ii;
-                continue;
-            }
+    if (!m_acceptRate)
+    {
+        return true;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    double rate = double(m_acceptRate) / m_reactors.size();
+    double burst = std::max(1.0, double(m_acceptBurst) / m_reactors.size());
+    double elapsed = std::chrono::duration<double>(now - reactor.m_acceptTime).count();
+
+    reactor.m_acceptTokens = std::min(burst, reactor.m_acceptTokens + elapsed * rate);
+    reactor.m_acceptTime = now;
+
+    if (reactor.m_acceptTokens < 1)
+    {
+        LOGSPW(m_log, "The accepting rate is exceeded. The client has been rejected");
+        ++m_rejectedClients;
+        return false;
+    }
+
+    reactor.m_acceptTokens -= 1;
+    return true;
+}
+
+void TcpServer::setAcceptRate(uint32_t perSecond, uint32_t burst)
+{
+    if (isStarted())
+    {
+        return;
+    }
+
+    m_acceptRate = perSecond;
+    m_acceptBurst = burst ? burst : perSecond;
+}
+
+Node* TcpServer::addClient(Reactor& reactor, SOCKET sockAccept, const sockaddr_in& sinAccept)
+{
+    uint8_t* ip = (uint8_t*)&sinAccept.sin_addr.s_addr;
+    LOGSPN(m_log, "Accepting the client from %u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+
+    if (!checkWhiteIp(sinAccept.sin_addr.s_addr))
+    {
+        LOGSPN(m_log, "Accepting client is denied by the access list. The %02i.%02i.%02i.%02i client has been disconted",
+               ip[0], ip[1], ip[2], ip[3]);
+        //shutdown(sockAccept, SD_BOTH);
+        closeSocket(sockAccept);
+        return nullptr;
+    }
+
+    // The client over the limits is rejected before it is created
+    if (!admitClient(reactor))
+    {
+        resetSocket(sockAccept);
+        return nullptr;
+    }
+
+    auto acceptedClient = newClient(sockAccept, sinAccept);
+
+    // The options are set per client, Linux copies them from the listener on accepting
+#ifndef __linux__
+    Result result = OK;
+
+    if (acceptedClient && (result = acceptedClient->configureParameters()) != OK)
+    {
+        LOGSPN(m_log, "Failed to configure the accepting client parameters. The %s client has been disconted",
+               acceptedClient->fullId().c_str());
+        delete acceptedClient;
+        acceptedClient = nullptr;
+    }
+
+    if (acceptedClient && (result = acceptedClient->configureKeepAlive()) != OK)
+    {
+        LOGSPN(m_log, "Failed to configure the accepting client keep alive property. The %s client has been disconted",
+               acceptedClient->fullId().c_str());
+        delete acceptedClient;
+        acceptedClient = nullptr;
+    }
+#endif
+
+    if (acceptedClient && !(reactor.m_uring ? addUringClient(reactor, acceptedClient) :
+                                              reactor.m_poller.add(acceptedClient->socket(), acceptedClient, Poller::Read, true)))
+    {
+        LOGSPN(m_log, "Failed to register the accepting client in the I/O engine. The %s client has been disconted",
+               acceptedClient->fullId().c_str());
+        delete acceptedClient;
+        acceptedClient = nullptr;
+    }
+
+    if (!acceptedClient)
+    {
+        return nullptr;
+    }
+
+    LOGSPN(m_log, "The client %s has been created", acceptedClient->fullId().c_str());
+
+    if (m_immediatelyCloseClients)
+    {
+        acceptedClient->configureImmediatelyClose();
+    }
+
+    acceptedClient->setSendNotify([this, &reactor](Node* node) { queueSend(reactor, node); });
+    acceptedClient->setRecvNotify([this, &reactor](Node* node) { queueRecv(reactor, node); });
+    acceptedClient->setBackpressureNotify([this](Node* node, bool isWritable)
+    {
+        isWritable ? onClientWritable(node) : onClientBackpressure(node);
+    });
+
+    if (m_sendHighWater)
+    {
+        acceptedClient->setWaterMarks(m_sendHighWater, m_sendLowWater, m_sendPolicy);
+    }
+
+    if (m_sendBudget.m_limit)
+    {
+        acceptedClient->setSendBudget(&m_sendBudget);
+    }
+
+    if (hasIdleTimeouts())
+    {
+        auto& state = reactor.m_idle[acceptedClient];
+        Idle idle;
+
+        state.m_node = acceptedClient;
+        state.m_created = state.m_lastRecv = state.m_lastSend = reactor.m_wheel.now();
+        reactor.m_wheel.schedule(state, idleDeadline(reactor, state, idle));
+    }
+
+    {
+        std::lock_guard<std::mutex> lockClients(reactor.m_clientsMutex);
+
+        reactor.m_clients.push_back(acceptedClient);
+        reactor.m_clientSet.emplace(acceptedClient, std::shared_ptr<Node>(acceptedClient));
+    }
+    reactor.m_clientsCount.store(static_cast<uint32_t>(reactor.m_clients.size()));
+
+    onClientJoin(acceptedClient);
+    LOGSPN(m_log, "The client %s has been accepted", acceptedClient->fullId().c_str());
+
+    return acceptedClient;
+}
+
+bool TcpServer::readClient(Reactor& reactor, Node* client)
+{
+    // The client socket is edge triggered, so it is read until it is empty
+    while (1)
+    {
+        auto result = client->readFromSocket();
+
+        if (result == Fault)
+        {
+            dropClient(reactor, client, "has been disconnected");
+            return false;
+        }
+        else if (result == Complited && !onRecvFromNode(client))
+        {
+            dropClient(reactor, client, "was disconnect");
+            return false;
+        }
+
+        if (!client->isConnected())
+        {
+            dropClient(reactor, client, "has been disconnected");
+            return false;
         }
 
+        if (client->lastRecvBytes() <= 0)
+        {
+            return true;
+        }
+
+        touchClient(reactor, client, true);
+    }
+}
+
+bool TcpServer::flushClient(Reactor& reactor, Node* client)
+{
+    if (client->isSendOverflowed())
+    {
+        dropClient(reactor, client, "has overflowed the send buffer. Disconnect it");
+        return false;
+    }
+
+    // The coalesced data is written later, the client may be in the list twice
+    if (client->sendDelay() > 0)
+    {
+        reactor.m_coalescing.insert(client);
+        return true;
+    }
+
+    // The socket is edge triggered, so it is written until it would block or the data is over
+    do
+    {
         if (!client->sendToSocket())
         {
-            onClientDisconnected(client);
+            dropClient(reactor, client, "can not receive the data. Disconnect it");
+            return false;
+        }
 
-            LOGSPN(m_log, "Can not send data to client %s. Disconnect it", client->fullId().c_str());
-            delete client;
-            m_clients.erase(m_clients.begin() + ii);
-            --ii;
-            continue;
+        if (client->lastSendBytes() > 0)
+        {
+            touchClient(reactor, client, false);
         }
     }
+    while (client->lastSendBytes() > 0 && client->hasPendingSend());
 
+    // The writable event is watched only while the send buffer is not empty
+    bool isPending = client->hasPendingSend();
+    bool isWatched = reactor.m_writeWatched.count(client) > 0;
+
+    if (isPending != isWatched)
+    {
+        reactor.m_poller.modify(client->socket(), client, isPending ? Poller::Read | Poller::Write : Poller::Read, true);
+
+        if (isPending)
+        {
+            reactor.m_writeWatched.insert(client);
+        }
+        else
+        {
+            reactor.m_writeWatched.erase(client);
+        }
+    }
 
-    m_clientsCount.store(static_cast<uint32_t>(m_clients.size()));
+    return true;
 }
 
-Node* TcpServer::newClient(SOCKET socket, const sockaddr_in& addr)
+void TcpServer::deleteClient(Reactor& reactor, Node* client)
 {
-    return new Node(socket, addr);
+    std::shared_ptr<Node> owner;
+    {
+        std::lock_guard<std::mutex> lockClients(reactor.m_clientsMutex);
+
+        auto item = std::find(reactor.m_clients.begin(), reactor.m_clients.end(), client);
+        if (item != reactor.m_clients.end())
+        {
+            reactor.m_clients.erase(item);
+        }
+
+        auto owned = reactor.m_clientSet.find(client);
+        if (owned != reactor.m_clientSet.end())
+        {
+            owner = std::move(owned->second);
+            reactor.m_clientSet.erase(owned);
+        }
+    }
+    reactor.m_clientsCount.store(static_cast<uint32_t>(reactor.m_clients.size()));
+
+    // the producers and the decompressing tasks of the node don't call the reactor and the server anymore
+    client->detachOwner();
+
+    {
+        std::lock_guard<std::mutex> lock(reactor.m_sendMutex);
+        reactor.m_pendingSend.erase(client);
+        reactor.m_pendingRecv.erase(client);
+    }
+
+    reactor.m_writeWatched.erase(client);
+    reactor.m_coalescing.erase(client);
+
+    auto idle = reactor.m_idle.find(client);
+    if (idle != reactor.m_idle.end())
+    {
+        reactor.m_wheel.cancel(idle->second);
+        reactor.m_idle.erase(idle);
+    }
+
+    if (reactor.m_uring)
+    {
+        deleteUringClient(reactor, client);
+    }
+    else if (client->isConnected())
+    {
+        reactor.m_poller.remove(client->socket());
+    }
+
+    // The producers blocked by the client stop waiting, the node is deleted by the last owner
+    if (owner)
+    {
+        client->disconnect();
+    }
+    else
+    {
+        delete client;
+    }
 }
 
-bool TcpServer::send(Node* target, const void* packet, size_t size)
+void TcpServer::dropClient(Reactor& reactor, Node* client, const char* reason)
 {
-    bool result = true;
+    onClientDisconnected(client);
 
-    if (!size)
+    LOGSPN(m_log, "The client %s %s", client->fullId().c_str(), reason);
+    deleteClient(reactor, client);
+}
+
+void TcpServer::queueSend(Reactor& reactor, Node* client)
+{
+    bool isFirst = false;
     {
-        return false;
+        std::lock_guard<std::mutex> lock(reactor.m_sendMutex);
+
+        isFirst = reactor.m_pendingSend.empty();
+        reactor.m_pendingSend.insert(client);
+    }
+
+    // The reactor is woken up once for the batch of the sendings
+    if (isFirst)
+    {
+        wakeReactor(reactor);
     }
+}
 
-    for (auto client : m_clients)
+void TcpServer::setSendLimits(size_t high, size_t low, Node::SendPolicy policy)
+{
+    if (isStarted())
+    {
+        return;
+    }
+
+    m_sendHighWater = high;
+    m_sendLowWater = low;
+    m_sendPolicy = policy;
+}
+
+void TcpServer::setIdleTimeouts(uint32_t readMSec, uint32_t writeMSec, uint32_t handshakeMSec)
+{
+    if (isStarted())
     {
-        if (!target || target == client)
+        return;
+    }
+
+    m_readIdleMSec = readMSec;
+    m_writeIdleMSec = writeMSec;
+    m_handshakeMSec = handshakeMSec;
+}
+
+void TcpServer::touchClient(Reactor& reactor, Node* client, bool isRecv)
+{
+    if (!hasIdleTimeouts())
+    {
+        return;
+    }
+
+    auto item = reactor.m_idle.find(client);
+    if (item == reactor.m_idle.end())
+    {
+        return;
+    }
+
+    // O(1), the entry isn't moved in the wheel
+    if (isRecv)
+    {
+        item->second.m_lastRecv = reactor.m_wheel.now();
+        item->second.m_hasReceived = true;
+    }
+    else
+    {
+        item->second.m_lastSend = reactor.m_wheel.now();
+    }
+}
+
+uint64_t TcpServer::idleDeadline(Reactor& reactor, const IdleState& state, Idle& idle) const
+{
+    uint64_t deadline = UINT64_MAX;
+
+    auto check = [&reactor, &deadline, &idle](uint32_t msec, uint64_t from, Idle kind)
+    {
+        uint64_t value = from + reactor.m_wheel.toTicks(std::chrono::milliseconds(msec));
+
+        if (msec && value < deadline)
         {
-            result &= client->send(packet, size) == size;
+            deadline = value;
+            idle = kind;
         }
+    };
+
+    if (!state.m_hasReceived)
+    {
+        check(m_handshakeMSec, state.m_created, Idle::Handshake);
     }
+    check(m_readIdleMSec, state.m_lastRecv, Idle::Read);
+    check(m_writeIdleMSec, state.m_lastSend, Idle::Write);
 
-    return result;
+    return deadline;
 }
 
-bool TcpServer::checkWhiteIp(uint32_t ip)
+void TcpServer::expireIdle(Reactor& reactor)
 {
-    if (m_whiteList.empty())
+    if (!hasIdleTimeouts())
     {
-        return true;
+        return;
+    }
+
+    auto& wheel = reactor.m_wheel;
+    reactor.m_idleExpired.clear();
+
+    // The expired entries are rescheduled if the client has been active meanwhile
+    wheel.advance(std::chrono::steady_clock::now(), [this, &reactor, &wheel](TimingWheel::Entry& entry)
+    {
+        auto& state = static_cast<IdleState&>(entry);
+        Idle idle = Idle::Read;
+        uint64_t deadline = idleDeadline(reactor, state, idle);
+
+        if (deadline > wheel.now())
+        {
+            wheel.schedule(state, deadline);
+            return;
+        }
+
+        reactor.m_idleExpired.emplace_back(state.m_node, idle);
+    });
+
+    // The clients are dropped after the batch, so the entries of the batch stay valid
+    for (auto& item : reactor.m_idleExpired)
+    {
+        auto state = reactor.m_idle.find(item.first);
+        if (state == reactor.m_idle.end())
+        {
+            continue;
+        }
+
+        if (!onClientIdle(item.first, item.second))
+        {
+            dropClient(reactor, item.first, "has been idle too long. Disconnect it");
+            continue;
+        }
+
+        // the expired timeout is restarted
+        uint64_t now = wheel.now();
+        switch (item.second)
+        {
+            case Idle::Handshake: state->second.m_created = now; break;
+            case Idle::Read: state->second.m_lastRecv = now; break;
+            case Idle::Write: state->second.m_lastSend = now; break;
+        }
+
+        Idle idle;
+        wheel.schedule(state->second, idleDeadline(reactor, state->second, idle));
     }
+}
+
+uint32_t TcpServer::waitTimeout(Reactor& reactor)
+{
+    int64_t timeout = int64_t(m_selectSec) * 1000000 + m_selectUSec;
 
-    for (auto item: m_whiteList)
+    for (auto client : reactor.m_coalescing)
     {
-        if (item == ip)
+        int64_t delay = client->sendDelay();
+
+        if (delay >= 0 && delay < timeout)
         {
-            return true;
+            timeout = delay;
         }
     }
 
-    return false;
+    // the timing wheel is advanced at least once per tick
+    if (reactor.m_wheel.size())
+    {
+        timeout = std::min<int64_t>(timeout, std::chrono::microseconds(IdleResolution).count());
+    }
+
+    return static_cast<uint32_t>(std::min<int64_t>(timeout, 0xffffffff));
 }
 
-bool TcpServer::addWhiteIp(uint32_t ip)
+void TcpServer::queueRecv(Reactor& reactor, Node* client)
+{
+    bool isFirst = false;
+    {
+        std::lock_guard<std::mutex> lock(reactor.m_sendMutex);
+
+        isFirst = reactor.m_pendingRecv.empty();
+        reactor.m_pendingRecv.insert(client);
+    }
+
+    if (isFirst)
+    {
+        wakeReactor(reactor);
+    }
+}
+
+void TcpServer::pollRecv(Reactor& reactor)
 {
-    for (auto item: m_whiteList)
     {
-        if (item == ip)
+        std::lock_guard<std::mutex> lock(reactor.m_sendMutex);
+
+        if (reactor.m_pendingRecv.empty())
         {
-            return false;
+            return;
         }
+
+        reactor.m_recvList.assign(reactor.m_pendingRecv.begin(), reactor.m_pendingRecv.end());
+        reactor.m_pendingRecv.clear();
     }
 
-    m_whiteList.push_back(ip);
+    for (auto client : reactor.m_recvList)
+    {
+        if (!reactor.m_clientSet.count(client))
+        {
+            continue;
+        }
+
+        auto result = client->pollRecv();
 
-    return true;
+        if (result == Fault)
+        {
+            dropClient(reactor, client, "has been disconnected");
+        }
+        else if (result == Complited && !onRecvFromNode(client))
+        {
+            dropClient(reactor, client, "was disconnect");
+        }
+    }
 }
 
-bool TcpServer::addWhiteIp(uint8_t* ip)
+void TcpServer::wakeReactor(Reactor& reactor)
 {
-    return addWhiteIp(*(uint32_t*)ip);
+    reactor.m_poller.wake();
 }
 
-bool TcpServer::addWhiteIp(const std::string& ip)
+std::vector<std::shared_ptr<Node>> TcpServer::clients() const
 {
-    uint32_t value = 0;
-    // Parsing string "XXX.XXX.XXX.XXX"
-    if (!inet_pton(AF_INET, ip.c_str(), &value))
+    std::vector<std::shared_ptr<Node>> out;
+
+    for (auto& reactor : m_reactors)
+    {
+        std::lock_guard<std::mutex> lock(reactor->m_clientsMutex);
+
+        for (auto client : reactor->m_clients)
+        {
+            auto item = reactor->m_clientSet.find(client);
+            if (item != reactor->m_clientSet.end())
+            {
+                out.push_back(item->second);
+            }
+        }
+    }
+    return out;
+}
+
+uint32_t TcpServer::clientsCount() const
+{
+    uint32_t count = 0;
+
+    for (auto& reactor : m_reactors)
+    {
+        count += reactor->m_clientsCount.load();
+    }
+    return count;
+}
+
+Node* TcpServer::newClient(SOCKET socket, const sockaddr_in& addr)
+{
+    return new Node(socket, addr);
+}
+
+bool TcpServer::send(Node* target, const void* packet, size_t size)
+{
+    if (!size)
     {
         return false;
     }
 
-    return addWhiteIp(value);
+    // the payload is copied once for all clients
+    return send(target, Bytes::copy(packet, size));
+}
+
+bool TcpServer::send(Node* target, const Bytes& data)
+{
+    bool result = true;
+
+    if (data.empty())
+    {
+        return false;
+    }
+
+    // The clients are taken under the lock of the reactor and sent without it, so the blocking sending
+    // to the slow client doesn't stall the reactor. The taken node can't be deleted meanwhile.
+    std::vector<std::shared_ptr<Node>> clients;
+
+    for (auto& reactor : m_reactors)
+    {
+        std::lock_guard<std::mutex> lockClients(reactor->m_clientsMutex);
+
+        if (target)
+        {
+            auto item = reactor->m_clientSet.find(target);
+            if (item != reactor->m_clientSet.end())
+            {
+                clients.push_back(item->second);
+                break;
+            }
+            continue;
+        }
+
+        for (auto client : reactor->m_clients)
+        {
+            clients.push_back(reactor->m_clientSet[client]);
+        }
+    }
+
+    if (target)
+    {
+        return clients.size() && target->send(data) != 0;
+    }
+
+    // The frames of the broadcast, there are a few kinds of the nodes usually.
+    // The nodes may queue the other count of bytes than the size of the packet (framing, compression).
+    // The broadcast doesn't wait for the slow clients, the Block policy refuses the frame at once.
+    // The reactors are woken up by the notification of the nodes.
+    std::vector<std::pair<uint64_t, Node::Frame>> frames;
+
+    for (auto& client : clients)
+    {
+        uint64_t key = client->frameKey();
+
+        // the node without the frames is framed by itself, but it doesn't wait too
+        if (!key)
+        {
+            auto frame = client->frame(data);
+
+            frame.m_canBlock = false;
+            result &= client->sendFrame(frame) != 0;
+            continue;
+        }
+
+        auto item = std::find_if(frames.begin(), frames.end(), [key](const auto& frame) { return frame.first == key; });
+        if (item == frames.end())
+        {
+            frames.emplace_back(key, client->frame(data));
+            frames.back().second.m_canBlock = false;
+            item = frames.end() - 1;
+        }
+
+        result &= client->sendFrame(item->second) != 0;
+    }
+
+    return result;
+}
+
+bool TcpServer::checkWhiteIp(uint32_t ip)
+{
+    auto list = acl();
+    return !list || list->isAllowed(ip);
+}
+
+void TcpServer::setAcl(std::shared_ptr<const IpAcl> acl)
+{
+    std::lock_guard<std::mutex> lockUpdate(m_aclUpdateMutex);
+    std::lock_guard<std::mutex> lock(m_aclMutex);
+
+    m_acl = std::move(acl);
+}
+
+std::shared_ptr<const IpAcl> TcpServer::acl() const
+{
+    std::lock_guard<std::mutex> lock(m_aclMutex);
+    return m_acl;
+}
+
+template <typename Func>
+size_t TcpServer::updateAcl(Func&& func)
+{
+    std::lock_guard<std::mutex> lockUpdate(m_aclUpdateMutex);
+
+    // The copy is changed and swapped, the readers keep using the current list meanwhile
+    auto current = acl();
+    auto list = current ? std::make_shared<IpAcl>(*current) : std::make_shared<IpAcl>();
+    size_t count = func(*list);
+
+    if (count)
+    {
+        std::lock_guard<std::mutex> lock(m_aclMutex);
+        m_acl = std::move(list);
+    }
+    return count;
+}
+
+bool TcpServer::addAclRule(const std::string& rule, IpAcl::Action action)
+{
+    return updateAcl([&rule, action](IpAcl& acl) { return acl.add(rule, action) ? 1 : 0; });
+}
+
+size_t TcpServer::addAclRules(const std::vector<std::string>& rules, IpAcl::Action action)
+{
+    return updateAcl([&rules, action](IpAcl& acl)
+    {
+        size_t count = 0;
+
+        for (auto& rule : rules)
+        {
+            count += acl.add(rule, action) ? 1 : 0;
+        }
+        return count;
+    });
+}
+
+bool TcpServer::addWhiteIp(uint32_t ip)
+{
+    return updateAcl([ip](IpAcl& acl) { return acl.add(ip, 32, IpAcl::Action::Allow) ? 1 : 0; });
+}
+
+bool TcpServer::addWhiteIp(uint8_t* ip)
+{
+    return addWhiteIp(*(uint32_t*)ip);
 }
 
 int32_t TcpServer::getNextClientId()
 {
-    auto out = m_clientNum;
-    ++m_clientNum;
-    return out;
+    return m_clientNum.fetch_add(1);
 }
 
 } // namespace Net
@@ -2,9 +2,15 @@
 
 #include <string>
 #include <vector>
+#include <memory>
 #include <mutex>
+#include <unordered_map>
+#include <unordered_set>
 #include "thread_class.h"
+#include "net/ip_acl.h"
 #include "net/node.h"
+#include "net/poller.h"
+#include "net/timing_wheel.h"
 #include "log.h"
 
 namespace su
@@ -12,65 +18,251 @@ namespace su
 namespace Net
 {
 
+struct UringState;
+
 class TcpServer : public ThreadClass
 {
 public:
+    enum class IoEngine
+    {
+        Poller, // epoll or select
+        Uring,  // io_uring, falls back to Poller if the kernel doesn't support it
+    };
+
+    enum class Idle
+    {
+        Handshake, // nothing has been received since the accepting
+        Read,      // nothing has been received since the last data
+        Write,     // nothing has been sent since the last data
+    };
+
     TcpServer(const std::string& ip, uint16_t port, uint32_t maxclient, Log *plog);
     virtual ~TcpServer();
 
     Result start();
     Result start(const std::string& ip, uint16_t port);
 
-    const Node* node() const { return &m_node; }
+    // The reactor waits for the events in the poller (or io_uring) until the nearest deadline and it is woken
+    // by the sending and the commands, so the thread doesn't sleep between the calls of doWork().
+    // The delay is the sleep of the thread while the server isn't started.
+    using ThreadClass::run;
+    virtual std::thread* run(size_t delay) override;
+
+    // The listening node of the first reactor
+    const Node* node() const { return m_reactors.size() ? &m_reactors[0]->m_node : nullptr; }
+
+    // The engine must be set before start(), ioEngine() returns the really used engine after start()
+    void setIoEngine(IoEngine engine) { if (!isStarted()) m_ioEngine = engine; }
+    IoEngine ioEngine() const { return m_ioEngine; }
+
+    // The count of the reactors must be set before start(). Every reactor owns the part of the clients and
+    // runs its own thread (the first one runs on the thread of the server), so newClient(), onClientJoin(),
+    // onClientDisconnected() and onRecvFromNode() are called concurrently by the reactor threads.
+    // The reactors listen the port by the own sockets (SO_REUSEPORT) or, if it isn't supported,
+    // the first reactor accepts the clients and hands them round-robin to the others.
+    void setReactorCount(uint32_t count) { if (!isStarted()) m_reactorCount = count ? count : 1; }
+    uint32_t reactorCount() const { return m_reactorCount; }
 
     void setIp(const std::string& ip, uint16_t port);
 
+    // The access list is replaced atomically, the accepting threads keep using the previous one
+    // until they load the new one, nullptr - all addresses are allowed. Every call of addAclRule(),
+    // addWhiteIp() and addBlackIp() copies the whole list, so the long list is built by addAclRules()
+    // or as IpAcl passed to setAcl().
+    void setAcl(std::shared_ptr<const IpAcl> acl);
+    std::shared_ptr<const IpAcl> acl() const;
+    bool addAclRule(const std::string& rule, IpAcl::Action action);
+    // The rules are added by one copy of the list. Returns the count of the added rules,
+    // the wrong and the existing rules are skipped
+    size_t addAclRules(const std::vector<std::string>& rules, IpAcl::Action action);
+
+    // The limit of the accepted connections per second and the burst over it, 0 - unlimited. It must be set
+    // before start(), the reactors share it equally. The connections over the rate or over the maximum count
+    // of the clients are reset at once.
+    void setAcceptRate(uint32_t perSecond, uint32_t burst = 0);
+    uint64_t countRejectedClients() const { return m_rejectedClients.load(); }
+
+    // The rule is "a.b.c.d" or "a.b.c.d/prefix"
     bool addWhiteIp(uint32_t ip);
     bool addWhiteIp(uint8_t* ip);
-    bool addWhiteIp(const std::string& ip);
+    bool addWhiteIp(const std::string& ip) { return addAclRule(ip, IpAcl::Action::Allow); }
+    bool addBlackIp(const std::string& ip) { return addAclRule(ip, IpAcl::Action::Deny); }
 
     bool isStarted() const { return m_isStarted.load(); }
-    uint32_t clientsCount() const { return m_clientsCount.load(); }
+    uint32_t clientsCount() const;
+    // The snapshot of the clients of all reactors in the order of accepting, it replaces the former protected
+    // m_clients. The nodes are kept alive by the pointers, but they may be disconnected by their reactors meanwhile.
+    std::vector<std::shared_ptr<Node>> clients() const;
 
+    // The limits of the send queues of the clients (Node::setWaterMarks()), they must be set before start().
+    // The budget limits the memory of the queues of all clients, 0 - unlimited.
+    void setSendLimits(size_t high, size_t low, Node::SendPolicy policy);
+    void setSendBudget(size_t size) { if (!isStarted()) m_sendBudget.m_limit = size; }
+    size_t sendBudgetUsed() const { return m_sendBudget.m_used.load(); }
+
+    // The idle timeouts of the clients, they must be set before start(), 0 - disabled. The deadlines
+    // of all clients of the reactor are kept by its timing wheel with IdleResolution precision.
+    void setIdleTimeouts(uint32_t readMSec, uint32_t writeMSec, uint32_t handshakeMSec = 0);
+    static constexpr std::chrono::milliseconds IdleResolution{ 10 };
+
+    // The target may belong to any reactor, nullptr - send to all clients.
+    // The broadcast is framed once per the kind of the nodes (Node::frameKey()) and the same buffers
+    // are queued to all clients. The broadcast doesn't wait for the slow clients, the Block policy drops
+    // the frame like Drop.
     bool send(Node* target, const void* packet, size_t size);
+    bool send(Node* target, const Bytes& data);
 
 protected:
     // ThreadClass
     virtual void doWork() override;
     virtual void doFinished() override;
+    virtual void wakeUp() override;
 
     // TcpServer
     virtual bool checkWhiteIp(uint32_t ip);
     virtual void onClientJoin(Node*) {}
     virtual void onClientDisconnected(Node*) {}
     virtual bool onRecvFromNode(Node* node) { return true; }
+    // The sending to the client is refused or blocked by the limits, it is called by the producer thread
+    virtual void onClientBackpressure(Node*) {}
+    // The send queue of the client has drained to the low water mark, it is called by the reactor thread
+    virtual void onClientWritable(Node*) {}
+    // The idle timeout of the client has expired: true - keep the client (e.g. the keepalive packet has been
+    // sent), the timeout is restarted; false - disconnect it. By default only the write idle client is kept.
+    virtual bool onClientIdle(Node*, Idle idle) { return idle == Idle::Write; }
     virtual Node* newClient(SOCKET socket, const sockaddr_in& addr);
 
+    // The mutex guards start() and stop of the server. Unlike the single threaded server it doesn't serialize
+    // the work of the reactors, so it doesn't guard the clients and the callbacks (use clients() instead).
     std::mutex& getMutex() { return m_mutex; }
     Log* getLog() { return m_log; }
     int32_t getNextClientId();
 
 private:
+    struct Reactor;
+    class ReactorThread;
+
+    Result openReactor(Reactor& reactor);
     void destroy();
+    void doWorkReactor(Reactor& reactor);
+    void acceptClient(Reactor& reactor);
+    Node* addClient(Reactor& reactor, SOCKET socket, const sockaddr_in& addr);
+    bool admitClient(Reactor& reactor);
+    bool readClient(Reactor& reactor, Node* client);
+    bool flushClient(Reactor& reactor, Node* client);
+    void deleteClient(Reactor& reactor, Node* client);
+    void queueSend(Reactor& reactor, Node* client);
+    // The packets completed asynchronously by the clients (Node::pollRecv())
+    void queueRecv(Reactor& reactor, Node* client);
+    void pollRecv(Reactor& reactor);
+    void dropClient(Reactor& reactor, Node* client, const char* reason);
+    void wakeReactor(Reactor& reactor);
+    // The wait of the reactor is shortened to the nearest deadline of the coalesced sendings
+    uint32_t waitTimeout(Reactor& reactor);
+    // The rules are added to a copy of the access list, func(IpAcl&) returns the count of the added rules
+    template <typename Func>
+    size_t updateAcl(Func&& func);
+
+    // The idle timeouts
+    struct IdleState;
+    bool hasIdleTimeouts() const { return m_readIdleMSec || m_writeIdleMSec || m_handshakeMSec; }
+    void touchClient(Reactor& reactor, Node* client, bool isRecv);
+    uint64_t idleDeadline(Reactor& reactor, const IdleState& state, Idle& idle) const;
+    void expireIdle(Reactor& reactor);
+
+    // io_uring engine, tcp_server_uring.cpp
+    bool startUring(Reactor& reactor);
+    void doWorkUring(Reactor& reactor);
+    bool addUringClient(Reactor& reactor, Node* client);
+    void deleteUringClient(Reactor& reactor, Node* client);
+    void sendUring(Reactor& reactor, Node* client);
+    void processUring(Reactor& reactor, uint64_t userData, int32_t result, uint32_t flags);
 
 protected:
-    std::vector<Node*> m_clients;
-    std::vector<uint32_t> m_whiteList;
+    // The list is read by the accepting threads under m_aclMutex, the changes are serialized by m_aclUpdateMutex
+    // and copy the list without blocking the readers
+    std::shared_ptr<const IpAcl> m_acl;
+    mutable std::mutex m_aclMutex;
+    std::mutex m_aclUpdateMutex;
     std::vector<uint32_t> m_hosts;
     std::string m_hostIp = "127.0.0.1";
     uint16_t m_hostPort = 1024;
-    uint32_t m_selectSec = 0;
-    uint32_t m_selectUSec = 100;
+    // The longest wait of the reactor without the events
+    uint32_t m_selectSec = 1;
+    uint32_t m_selectUSec = 0;
     uint32_t m_maxClients = 0xffffffff;
+    // The count of the connections accepted by one tick, the rest is accepted on the next one
+    uint32_t m_acceptBatch = 256;
+    uint32_t m_acceptRate = 0;
+    uint32_t m_acceptBurst = 0;
     bool m_immediatelyCloseClients = false;
+    uint32_t m_uringEntries = 4096;
+    uint32_t m_uringBufferCount = 512;
+    uint32_t m_uringBufferSize = 16 * 1024;
+    uint32_t m_readIdleMSec = 0;
+    uint32_t m_writeIdleMSec = 0;
+    uint32_t m_handshakeMSec = 0;
+    size_t m_sendHighWater = 0;
+    size_t m_sendLowWater = 0;
+    Node::SendPolicy m_sendPolicy = Node::SendPolicy::Disconnect;
 
 private:
+    // The activity only updates the time, the deadline is checked when the entry expires (lazy rescheduling)
+    struct IdleState : TimingWheel::Entry
+    {
+        Node* m_node = nullptr;
+        uint64_t m_created = 0;
+        uint64_t m_lastRecv = 0;
+        uint64_t m_lastSend = 0;
+        bool m_hasReceived = false;
+    };
+
+    // The state of the reactor is changed by its thread only, the other threads only queue the sending
+    // (m_sendMutex) and look up the clients (m_clientsMutex)
+    struct Reactor
+    {
+        uint32_t m_index = 0;
+        Node m_node;
+        // The token bucket of the accepting rate
+        double m_acceptTokens = 0;
+        std::chrono::steady_clock::time_point m_acceptTime;
+        std::mutex m_mutex;
+        Poller m_poller;
+        std::vector<Poller::Event> m_events;
+        std::mutex m_clientsMutex;
+        std::vector<Node*> m_clients;
+        // The clients are owned by the reactor and shared with the sending threads (send()), so the node
+        // deleted by the reactor is destroyed when the last sender releases it
+        std::unordered_map<Node*, std::shared_ptr<Node>> m_clientSet;
+        std::unordered_set<Node*> m_writeWatched;
+        std::mutex m_sendMutex;
+        std::unordered_set<Node*> m_pendingSend;
+        std::unordered_set<Node*> m_pendingRecv;
+        std::vector<Node*> m_recvList;
+        std::vector<std::pair<SOCKET, sockaddr_in>> m_incoming;
+        std::vector<Node*> m_flushList;
+        // The clients holding the small messages until the coalescing deadline (Node::setCoalescing())
+        std::unordered_set<Node*> m_coalescing;
+        TimingWheel m_wheel{ IdleResolution };
+        std::unordered_map<Node*, IdleState> m_idle;
+        std::vector<std::pair<Node*, Idle>> m_idleExpired;
+        std::unique_ptr<UringState> m_uring;
+        std::unique_ptr<ReactorThread> m_thread;
+        std::atomic<uint32_t> m_clientsCount = 0;
+    };
+
     Log* m_log = nullptr;
-    Node m_node;
     std::mutex m_mutex;
+    std::vector<std::unique_ptr<Reactor>> m_reactors;
+    uint32_t m_reactorCount = 1;
+    uint32_t m_nextReactor = 0;
+    bool m_isHandingOff = false;
+    IoEngine m_ioEngine = IoEngine::Poller;
     std::atomic<bool> m_isStarted = false;
-    int32_t m_clientNum = 0;
-    std::atomic<uint32_t> m_clientsCount = 0;
+    std::atomic<size_t> m_stoppedDelay = 100;
+    std::atomic<int32_t> m_clientNum = 0;
+    std::atomic<uint64_t> m_rejectedClients = 0;
+    SendBudget m_sendBudget;
 };
 
 } // namespace Net
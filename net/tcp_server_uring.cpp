@@ -0,0 +1,466 @@
+#include "net/tcp_server.h"
+#include "net/io_uring.h"
+
+#include <cstring>
+#include <poll.h>
+
+namespace su
+{
+namespace Net
+{
+
+#ifdef SU_NET_IOURING
+
+namespace
+{
+
+// The multishot receiving into the provided buffers
+bool armRecv(UringState& state, uint64_t key)
+{
+    auto sqe = state.m_ring.getSqe();
+    if (!sqe)
+    {
+        return false;
+    }
+
+    auto& conn = state.m_connections[key];
+
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = conn.m_socket;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = state.m_ring.bufferGroup();
+    sqe->user_data = UringState::userData(key, UringState::Recv);
+
+    conn.m_isReceiving = true;
+    return true;
+}
+
+} // namespace
+
+bool TcpServer::startUring(Reactor& reactor)
+{
+    if (!IoUring::isSupported())
+    {
+        return false;
+    }
+
+    reactor.m_uring = std::make_unique<UringState>();
+
+    if (!reactor.m_uring->m_ring.init(m_uringEntries) ||
+        !reactor.m_uring->m_ring.initBuffers(1, m_uringBufferCount, m_uringBufferSize))
+    {
+        reactor.m_uring.reset();
+        return false;
+    }
+
+    return true;
+}
+
+void TcpServer::doWorkUring(Reactor& reactor)
+{
+    auto& ring = reactor.m_uring->m_ring;
+
+    // The multishot accept is rearmed if the kernel has stopped it
+    if (!reactor.m_uring->m_isAccepting && reactor.m_node.isConnected())
+    {
+        if (auto sqe = ring.getSqe())
+        {
+            sqe->opcode = IORING_OP_ACCEPT;
+            sqe->fd = reactor.m_node.socket();
+            sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+            sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+            sqe->user_data = UringState::userData(0, UringState::Accept);
+
+            reactor.m_uring->m_isAccepting = true;
+        }
+    }
+
+    // The ring waits for the wake up of the reactor by the readiness of the epoll descriptor of its poller
+    if (!reactor.m_uring->m_isWakeArmed)
+    {
+        if (auto sqe = ring.getSqe())
+        {
+            sqe->opcode = IORING_OP_POLL_ADD;
+            sqe->fd = reactor.m_poller.fd();
+            sqe->poll32_events = POLLIN;
+            sqe->user_data = UringState::userData(0, UringState::Wake);
+
+            reactor.m_uring->m_isWakeArmed = true;
+        }
+    }
+
+    // The sends of all clients are submitted by the one system call
+    {
+        std::lock_guard<std::mutex> lockSend(reactor.m_sendMutex);
+
+        reactor.m_flushList.assign(reactor.m_pendingSend.begin(), reactor.m_pendingSend.end());
+        reactor.m_pendingSend.clear();
+    }
+
+    reactor.m_flushList.insert(reactor.m_flushList.end(), reactor.m_coalescing.begin(), reactor.m_coalescing.end());
+    reactor.m_coalescing.clear();
+
+    for (auto client : reactor.m_flushList)
+    {
+        if (reactor.m_clientSet.count(client))
+        {
+            sendUring(reactor, client);
+        }
+    }
+
+    // The receiving stopped by the lack of the buffers is restarted after the buffers are returned
+    ring.provideBuffers();
+
+    for (auto key : reactor.m_uring->m_rearm)
+    {
+        auto item = reactor.m_uring->m_connections.find(key);
+        if (item == reactor.m_uring->m_connections.end() || !item->second.m_node || item->second.m_isReceiving)
+        {
+            continue;
+        }
+
+        if (!armRecv(*reactor.m_uring, key))
+        {
+            dropClient(reactor, item->second.m_node, "can not be read");
+        }
+    }
+    reactor.m_uring->m_rearm.clear();
+
+    int result = ring.submitAndWait(waitTimeout(reactor));
+    if (result < 0 && result != -EBUSY)
+    {
+        LOGSPE(m_log, "The io_uring enter fault. Error: %i", -result);
+        return;
+    }
+
+    ring.forEachCqe([this, &reactor](const io_uring_cqe& cqe)
+    {
+        processUring(reactor, cqe.user_data, cqe.res, cqe.flags);
+    });
+}
+
+bool TcpServer::addUringClient(Reactor& reactor, Node* client)
+{
+    uint64_t key = reactor.m_uring->m_nextKey++;
+    auto& conn = reactor.m_uring->m_connections[key];
+
+    conn.m_node = client;
+    conn.m_socket = client->socket();
+
+    if (!armRecv(*reactor.m_uring, key))
+    {
+        reactor.m_uring->m_connections.erase(key);
+        return false;
+    }
+
+    reactor.m_uring->m_keys[client] = key;
+    return true;
+}
+
+void TcpServer::deleteUringClient(Reactor& reactor, Node* client)
+{
+    auto item = reactor.m_uring->m_keys.find(client);
+    if (item == reactor.m_uring->m_keys.end())
+    {
+        return;
+    }
+
+    uint64_t key = item->second;
+    auto& conn = reactor.m_uring->m_connections[key];
+
+    reactor.m_uring->m_keys.erase(item);
+    conn.m_node = nullptr;
+
+    if (conn.m_isReceiving)
+    {
+        if (auto sqe = reactor.m_uring->m_ring.getSqe())
+        {
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->fd = -1;
+            sqe->addr = UringState::userData(key, UringState::Recv);
+            sqe->user_data = UringState::userData(key, UringState::Cancel);
+        }
+    }
+
+    if (!conn.m_isReceiving && !conn.m_isSending)
+    {
+        reactor.m_uring->m_connections.erase(key);
+    }
+}
+
+void TcpServer::sendUring(Reactor& reactor, Node* client)
+{
+    auto item = reactor.m_uring->m_keys.find(client);
+    if (item == reactor.m_uring->m_keys.end())
+    {
+        return;
+    }
+
+    if (client->isSendOverflowed())
+    {
+        dropClient(reactor, client, "has overflowed the send buffer. Disconnect it");
+        return;
+    }
+
+    uint64_t key = item->second;
+    auto& conn = reactor.m_uring->m_connections[key];
+
+    // The only one send is in flight for the connection to keep the order of the data
+    if (conn.m_isSending)
+    {
+        return;
+    }
+
+    if (conn.m_sendOffset >= conn.m_sendSize)
+    {
+        // The coalesced data is sent later, the client may be in the list twice
+        if (client->sendDelay() > 0)
+        {
+            reactor.m_coalescing.insert(client);
+            return;
+        }
+
+        conn.m_sendOffset = 0;
+        conn.m_sendSize = client->takeSendSegments(conn.m_sending);
+
+        if (!conn.m_sendSize)
+        {
+            return;
+        }
+    }
+
+    auto sqe = reactor.m_uring->m_ring.getSqe();
+    if (!sqe)
+    {
+        queueSend(reactor, client);
+        return;
+    }
+
+    // The segments are sent by one request, the sent part is skipped
+    size_t skip = conn.m_sendOffset;
+
+    conn.m_iov.clear();
+    for (auto& segment : conn.m_sending)
+    {
+        if (skip >= segment.size())
+        {
+            skip -= segment.size();
+            continue;
+        }
+
+        conn.m_iov.push_back({ (void*)(segment.data() + skip), segment.size() - skip });
+        skip = 0;
+    }
+
+    conn.m_msg = {};
+    conn.m_msg.msg_iov = conn.m_iov.data();
+    conn.m_msg.msg_iovlen = conn.m_iov.size();
+
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = conn.m_socket;
+    sqe->addr = reinterpret_cast<uint64_t>(&conn.m_msg);
+    sqe->len = 1;
+    sqe->msg_flags = SU_SEND_FLAGS;
+    sqe->user_data = UringState::userData(key, UringState::Send);
+
+    conn.m_isSending = true;
+}
+
+void TcpServer::processUring(Reactor& reactor, uint64_t userData, int32_t result, uint32_t flags)
+{
+    bool hasMore = flags & IORING_CQE_F_MORE;
+
+    switch (UringState::operation(userData))
+    {
+        case UringState::Accept:
+        {
+            if (!hasMore)
+            {
+                reactor.m_uring->m_isAccepting = false;
+            }
+
+            if (result < 0)
+            {
+                LOGSPW(m_log, "The io_uring accept fault. Error: %i", -result);
+                return;
+            }
+
+            sockaddr_in addr;
+            socklen_t addrSize = sizeof(addr);
+
+            memset(&addr, 0, sizeof(addr));
+            ::getpeername(result, (sockaddr*)&addr, &addrSize);
+
+            addClient(reactor, result, addr);
+            return;
+        }
+
+        case UringState::Recv:
+        {
+            uint64_t key = UringState::key(userData);
+            auto item = reactor.m_uring->m_connections.find(key);
+            if (item == reactor.m_uring->m_connections.end())
+            {
+                return;
+            }
+
+            auto& conn = item->second;
+            Node* client = conn.m_node;
+            bool hasBuffer = flags & IORING_CQE_F_BUFFER;
+            uint16_t bid = static_cast<uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT);
+
+            if (!hasMore)
+            {
+                conn.m_isReceiving = false;
+            }
+
+            if (client && result > 0 && hasBuffer)
+            {
+                // The provided buffer is recycled at once, so the data is moved to the slab the node may keep
+                auto data = RecvSlab::local().copy(reactor.m_uring->m_ring.buffer(bid), result);
+                auto status = client->recv(data, client->socketAddress());
+
+                reactor.m_uring->m_ring.recycleBuffer(bid);
+                touchClient(reactor, client, true);
+
+                if (status == Fault || !client->isConnected())
+                {
+                    dropClient(reactor, client, "has been disconnected");
+                    client = nullptr;
+                }
+                else if (status == Complited && !onRecvFromNode(client))
+                {
+                    dropClient(reactor, client, "was disconnect");
+                    client = nullptr;
+                }
+            }
+            else
+            {
+                if (hasBuffer)
+                {
+                    reactor.m_uring->m_ring.recycleBuffer(bid);
+                }
+
+                // 0 - the remote side has closed the connection, ENOBUFS - no free buffers, try again
+                if (client && result != -ENOBUFS)
+                {
+                    dropClient(reactor, client, "has been disconnected");
+                    client = nullptr;
+                }
+            }
+
+            // the connection may be erased by dropClient()
+            item = reactor.m_uring->m_connections.find(key);
+            if (item == reactor.m_uring->m_connections.end())
+            {
+                return;
+            }
+
+            // The multishot receiving has been stopped, it is restarted on the next tick
+            if (client && !hasMore)
+            {
+                reactor.m_uring->m_rearm.push_back(key);
+                return;
+            }
+
+            if (!item->second.m_node && !item->second.m_isReceiving && !item->second.m_isSending)
+            {
+                reactor.m_uring->m_connections.erase(item);
+            }
+            return;
+        }
+
+        case UringState::Wake:
+        {
+            // the wake up is drained, the poll is armed again on the next tick
+            reactor.m_uring->m_isWakeArmed = false;
+            reactor.m_poller.wait(reactor.m_events, 0);
+            return;
+        }
+
+        case UringState::Send:
+        {
+            uint64_t key = UringState::key(userData);
+            auto item = reactor.m_uring->m_connections.find(key);
+            if (item == reactor.m_uring->m_connections.end())
+            {
+                return;
+            }
+
+            auto& conn = item->second;
+            Node* client = conn.m_node;
+
+            conn.m_isSending = false;
+
+            if (!client)
+            {
+                if (!conn.m_isReceiving)
+                {
+                    reactor.m_uring->m_connections.erase(item);
+                }
+                return;
+            }
+
+            if (result < 0 && result != -EAGAIN)
+            {
+                dropClient(reactor, client, "can not receive the data. Disconnect it");
+                return;
+            }
+
+            conn.m_sendOffset += result > 0 ? result : 0;
+
+            if (result > 0)
+            {
+                touchClient(reactor, client, false);
+            }
+
+            if (conn.m_sendOffset >= conn.m_sendSize)
+            {
+                conn.m_sending.clear();
+            }
+
+            if (conn.m_sendOffset < conn.m_sendSize || client->hasPendingSend())
+            {
+                queueSend(reactor, client);
+            }
+            return;
+        }
+
+        default:
+            return;
+    }
+}
+
+#else
+
+bool TcpServer::startUring(Reactor&)
+{
+    return false;
+}
+
+void TcpServer::doWorkUring(Reactor&)
+{
+}
+
+bool TcpServer::addUringClient(Reactor&, Node*)
+{
+    return false;
+}
+
+void TcpServer::deleteUringClient(Reactor&, Node*)
+{
+}
+
+void TcpServer::sendUring(Reactor&, Node*)
+{
+}
+
+void TcpServer::processUring(Reactor&, uint64_t, int32_t, uint32_t)
+{
+}
+
+#endif
+
+} // namespace Net
+} // namespace su
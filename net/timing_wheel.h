@@ -0,0 +1,203 @@
+#pragma once
+
+#include <chrono>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace su
+{
+namespace Net
+{
+
+// The hierarchical timing wheel: 4 levels of 64 slots, the slot of the level N spans 64^N ticks.
+// The entries are intrusive, so the scheduling and the cancelling are O(1) without allocations.
+// The expired entries are returned by the batch. The entries of the far levels cascade down while
+// the time goes. The deadlines over 64^4 ticks are clamped to the farthest slot and cascade again.
+class TimingWheel
+{
+public:
+    struct Entry
+    {
+        bool isScheduled() const { return m_slot != nullptr; }
+        uint64_t deadline() const { return m_deadline; }
+
+    private:
+        friend class TimingWheel;
+
+        uint64_t m_deadline = 0;
+        Entry* m_prev = nullptr;
+        Entry* m_next = nullptr;
+        Entry** m_slot = nullptr;
+    };
+
+    static constexpr size_t SlotBits = 6;
+    static constexpr size_t CountOfSlots = size_t(1) << SlotBits;
+    static constexpr size_t CountOfLevels = 4;
+
+    explicit TimingWheel(std::chrono::milliseconds resolution = std::chrono::milliseconds(10))
+        : m_resolution(resolution.count() > 0 ? resolution : std::chrono::milliseconds(1)),
+          m_start(std::chrono::steady_clock::now())
+    {
+    }
+
+    TimingWheel(const TimingWheel&) = delete;
+    TimingWheel& operator=(const TimingWheel&) = delete;
+
+    // The current tick, the deadlines are in the ticks
+    uint64_t now() const { return m_current; }
+    uint64_t toTicks(std::chrono::milliseconds duration) const
+    {
+        auto ticks = std::chrono::duration_cast<std::chrono::steady_clock::duration>(duration);
+        return (ticks + m_resolution - std::chrono::steady_clock::duration(1)) / m_resolution;
+    }
+    size_t size() const { return m_size; }
+
+    void schedule(Entry& entry, uint64_t deadline)
+    {
+        cancel(entry);
+
+        entry.m_deadline = deadline > m_current ? deadline : m_current + 1;
+        link(entry);
+        ++m_size;
+    }
+
+    void cancel(Entry& entry)
+    {
+        if (!entry.isScheduled())
+        {
+            return;
+        }
+
+        unlink(entry);
+        --m_size;
+    }
+
+    // Moves the wheel to the time and passes the expired entries to func(Entry&) in order of the ticks.
+    // The callback may schedule or cancel any entry. Returns the count of the expired entries.
+    template <typename Func>
+    size_t advance(std::chrono::steady_clock::time_point time, Func&& func)
+    {
+        uint64_t target = static_cast<uint64_t>((time - m_start) / m_resolution);
+        size_t count = 0;
+
+        while (m_current < target)
+        {
+            // the empty wheel jumps to the time
+            if (!m_size)
+            {
+                m_current = target;
+                break;
+            }
+
+            ++m_current;
+            cascade();
+
+            auto& slot = m_slots[0][m_current & (CountOfSlots - 1)];
+            if (!slot)
+            {
+                continue;
+            }
+
+            m_expired.clear();
+            while (slot)
+            {
+                Entry* entry = slot;
+                unlink(*entry);
+                --m_size;
+                m_expired.push_back(entry);
+            }
+
+            // the entries of the batch are unlinked already, so the callback may reschedule them
+            for (auto entry : m_expired)
+            {
+                func(*entry);
+            }
+            count += m_expired.size();
+        }
+
+        return count;
+    }
+
+private:
+    void link(Entry& entry)
+    {
+        uint64_t delta = entry.m_deadline - m_current;
+        size_t level = 0;
+
+        while (level + 1 < CountOfLevels && delta >= (uint64_t(1) << (SlotBits * (level + 1))))
+        {
+            ++level;
+        }
+
+        // the deadline beyond the wheel waits in the farthest slot
+        uint64_t deadline = entry.m_deadline;
+        uint64_t span = uint64_t(1) << (SlotBits * CountOfLevels);
+        if (delta >= span)
+        {
+            deadline = m_current + span - 1;
+        }
+
+        auto& slot = m_slots[level][(deadline >> (SlotBits * level)) & (CountOfSlots - 1)];
+
+        entry.m_slot = &slot;
+        entry.m_prev = nullptr;
+        entry.m_next = slot;
+        if (slot)
+        {
+            slot->m_prev = &entry;
+        }
+        slot = &entry;
+    }
+
+    void unlink(Entry& entry)
+    {
+        if (entry.m_prev)
+        {
+            entry.m_prev->m_next = entry.m_next;
+        }
+        else
+        {
+            *entry.m_slot = entry.m_next;
+        }
+
+        if (entry.m_next)
+        {
+            entry.m_next->m_prev = entry.m_prev;
+        }
+
+        entry.m_prev = entry.m_next = nullptr;
+        entry.m_slot = nullptr;
+    }
+
+    // The slot of the upper level is spread over the lower levels when the lower level wraps
+    void cascade()
+    {
+        for (size_t level = 1; level < CountOfLevels; ++level)
+        {
+            if (m_current & ((uint64_t(1) << (SlotBits * level)) - 1))
+            {
+                break;
+            }
+
+            auto& slot = m_slots[level][(m_current >> (SlotBits * level)) & (CountOfSlots - 1)];
+            while (slot)
+            {
+                Entry* entry = slot;
+                unlink(*entry);
+                link(*entry);
+            }
+        }
+    }
+
+private:
+    std::chrono::steady_clock::duration m_resolution;
+    std::chrono::steady_clock::time_point m_start;
+    uint64_t m_current = 0;
+    size_t m_size = 0;
+    Entry* m_slots[CountOfLevels][CountOfSlots] = {};
+    std::vector<Entry*> m_expired;
+};
+
+} // namespace Net
+} // namespace su
@@ -0,0 +1,404 @@
+#include "net/udp_batch.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace su
+{
+namespace Net
+{
+
+RecvBatch::RecvBatch(size_t count, size_t slotSize) :
+    m_slotSize(slotSize ? slotSize : 1),
+    m_addrs(count ? count : 1)
+{
+    init();
+}
+
+void RecvBatch::init()
+{
+    m_buffer.assign(m_addrs.size() * m_slotSize, 0);
+    m_datagrams.reserve(m_addrs.size());
+
+#ifdef __linux__
+    m_headers.resize(m_addrs.size());
+    m_iovs.resize(m_addrs.size());
+    m_controls.resize(m_addrs.size());
+
+    for (size_t ii = 0; ii < m_headers.size(); ++ii)
+    {
+        m_iovs[ii] = { m_buffer.data() + ii * m_slotSize, m_slotSize };
+
+        m_headers[ii] = {};
+        m_headers[ii].msg_hdr.msg_name = &m_addrs[ii];
+        m_headers[ii].msg_hdr.msg_iov = &m_iovs[ii];
+        m_headers[ii].msg_hdr.msg_iovlen = 1;
+    }
+#endif
+}
+
+bool RecvBatch::enableGro(SOCKET socket)
+{
+#ifdef __linux__
+    int flag = 1;
+    if (::setsockopt(socket, SOL_UDP, UDP_GRO, (const char*)&flag, sizeof(flag)) == SOCKET_ERROR)
+    {
+        return false;
+    }
+
+    // the coalesced data must fit the slot entirely
+    if (m_slotSize < MaxUdpPayload)
+    {
+        m_slotSize = MaxUdpPayload;
+        init();
+    }
+
+    m_isGro = true;
+    return true;
+#else
+    (void)socket;
+    return false;
+#endif
+}
+
+// The coalesced message is split by the size of the segment, the last datagram may be shorter
+void RecvBatch::split(size_t message, size_t size, size_t segment, bool isTruncated)
+{
+    const uint8_t* data = m_buffer.data() + message * m_slotSize;
+    size_t offset = 0;
+
+    segment = segment && segment < size ? segment : size;
+
+    do
+    {
+        Datagram datagram;
+
+        datagram.m_addr = m_addrs[message];
+        datagram.m_data = data + offset;
+        datagram.m_size = std::min(segment, size - offset);
+        datagram.m_isTruncated = isTruncated && offset + segment >= size;
+        m_datagrams.push_back(datagram);
+
+        offset += segment;
+    }
+    while (offset < size);
+}
+
+int RecvBatch::recv(SOCKET socket)
+{
+    m_datagrams.clear();
+    m_countOfMessages = 0;
+
+#ifdef __linux__
+    // the lengths are overwritten by the kernel
+    for (size_t ii = 0; ii < m_headers.size(); ++ii)
+    {
+        auto& header = m_headers[ii].msg_hdr;
+
+        header.msg_namelen = sizeof(sockaddr_in);
+        header.msg_flags = 0;
+        header.msg_control = m_isGro ? m_controls[ii].m_data : nullptr;
+        header.msg_controllen = m_isGro ? sizeof(m_controls[ii].m_data) : 0;
+    }
+
+    int count = ::recvmmsg(socket, m_headers.data(), static_cast<unsigned int>(m_headers.size()), MSG_DONTWAIT, nullptr);
+    if (count < 0)
+    {
+        return isWouldBlock(getSocketError()) ? 0 : -1;
+    }
+
+    for (; m_countOfMessages < size_t(count); ++m_countOfMessages)
+    {
+        auto& header = m_headers[m_countOfMessages].msg_hdr;
+        size_t segment = 0;
+
+        for (auto cmsg = CMSG_FIRSTHDR(&header); m_isGro && cmsg; cmsg = CMSG_NXTHDR(&header, cmsg))
+        {
+            if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO)
+            {
+                int value = 0;
+                memcpy(&value, CMSG_DATA(cmsg), sizeof(value));
+                segment = value > 0 ? value : 0;
+            }
+        }
+
+        split(m_countOfMessages, m_headers[m_countOfMessages].msg_len, segment, header.msg_flags & MSG_TRUNC);
+    }
+#else
+    for (; m_countOfMessages < m_addrs.size(); ++m_countOfMessages)
+    {
+        uint8_t* data = m_buffer.data() + m_countOfMessages * m_slotSize;
+        socklen_t addrSize = sizeof(sockaddr_in);
+        bool isTruncated = false;
+
+        int result = ::recvfrom(socket, (char*)data, (int)m_slotSize, 0, (sockaddr*)&m_addrs[m_countOfMessages], &addrSize);
+        if (result < 0)
+        {
+            int error = getSocketError();
+#ifdef _WIN32
+            // the rest of the longer datagram is lost
+            isTruncated = error == WSAEMSGSIZE;
+            result = isTruncated ? (int)m_slotSize : result;
+#endif
+            if (!isTruncated)
+            {
+                if (!isWouldBlock(error) && !m_countOfMessages)
+                {
+                    return -1;
+                }
+                break;
+            }
+        }
+
+        split(m_countOfMessages, result, 0, isTruncated);
+    }
+#endif
+
+    return static_cast<int>(m_datagrams.size());
+}
+
+SendBatch::SendBatch(size_t count, size_t slotSize) :
+    m_slotSize(slotSize ? slotSize : 1),
+    m_buffer((count ? count : 1) * m_slotSize),
+    m_lengths(count ? count : 1),
+    m_addrs(count ? count : 1),
+    m_hasAddr(count ? count : 1)
+{
+#ifdef __linux__
+    m_headers.resize(m_lengths.size());
+    m_iovs.resize(m_lengths.size());
+    m_controls.resize(m_lengths.size());
+    m_counts.resize(m_lengths.size());
+#endif
+}
+
+bool SendBatch::setGso(bool isEnabled)
+{
+#ifdef __linux__
+    m_isGso = isEnabled;
+    m_countOfGsoFaults = 0;
+    return true;
+#else
+    return !isEnabled;
+#endif
+}
+
+bool SendBatch::add(const sockaddr_in* addr, const void* data, size_t size)
+{
+    if (size > m_slotSize)
+    {
+        return false;
+    }
+
+    if (m_size == m_lengths.size())
+    {
+        if (!m_first)
+        {
+            return false;
+        }
+        compact();
+    }
+
+    if (size)
+    {
+        memcpy(slot(m_size), data, size);
+    }
+
+    m_lengths[m_size] = size;
+    m_hasAddr[m_size] = addr != nullptr;
+    if (addr)
+    {
+        m_addrs[m_size] = *addr;
+    }
+
+    ++m_size;
+    return true;
+}
+
+// The not sent datagrams are moved to the beginning
+void SendBatch::compact()
+{
+    size_t count = m_size - m_first;
+
+    if (count)
+    {
+        memmove(slot(0), slot(m_first), count * m_slotSize);
+    }
+
+    for (size_t ii = 0; ii < count; ++ii)
+    {
+        m_lengths[ii] = m_lengths[m_first + ii];
+        m_addrs[ii] = m_addrs[m_first + ii];
+        m_hasAddr[ii] = m_hasAddr[m_first + ii];
+    }
+
+    m_first = 0;
+    m_size = count;
+}
+
+bool SendBatch::isSameAddress(size_t first, size_t second) const
+{
+    if (m_hasAddr[first] != m_hasAddr[second])
+    {
+        return false;
+    }
+
+    return !m_hasAddr[first] || (m_addrs[first].sin_addr.s_addr == m_addrs[second].sin_addr.s_addr &&
+                                 m_addrs[first].sin_port == m_addrs[second].sin_port);
+}
+
+// The GSO segments are of the size of the first datagram, only the last one may be shorter
+size_t SendBatch::countOfSegments(size_t index, size_t count) const
+{
+    size_t segment = m_lengths[index];
+    size_t total = segment;
+    size_t result = 1;
+
+    if (!m_isGso || !segment)
+    {
+        return 1;
+    }
+
+    while (result < count && result < MaxGsoSegments)
+    {
+        size_t next = index + result;
+
+        if (!isSameAddress(index, next) || !m_lengths[next] || m_lengths[next] > segment ||
+            total + m_lengths[next] > MaxUdpPayload)
+        {
+            break;
+        }
+
+        total += m_lengths[next];
+        ++result;
+
+        if (m_lengths[next] < segment)
+        {
+            break;
+        }
+    }
+
+    return result;
+}
+
+size_t SendBatch::send(SOCKET socket)
+{
+    size_t sent = 0;
+    // the datagrams before it are sent one by one, the segmentation of their run has been rejected
+    size_t splitEnd = m_first;
+
+    while (!empty())
+    {
+#ifdef __linux__
+        size_t count = m_size - m_first;
+        size_t countOfHeaders = 0;
+
+        // The runs of the datagrams are sent by one header with all their buffers
+        for (size_t ii = 0; ii < count; ++countOfHeaders)
+        {
+            size_t index = m_first + ii;
+            size_t segments = index < splitEnd ? 1 : countOfSegments(index, count - ii);
+            auto& header = m_headers[countOfHeaders].msg_hdr;
+
+            for (size_t jj = 0; jj < segments; ++jj)
+            {
+                m_iovs[ii + jj] = { slot(index + jj), m_lengths[index + jj] };
+            }
+
+            header = {};
+            header.msg_name = m_hasAddr[index] ? &m_addrs[index] : nullptr;
+            header.msg_namelen = m_hasAddr[index] ? sizeof(sockaddr_in) : 0;
+            header.msg_iov = &m_iovs[ii];
+            header.msg_iovlen = segments;
+
+            if (segments > 1)
+            {
+                header.msg_control = m_controls[countOfHeaders].m_data;
+                header.msg_controllen = sizeof(m_controls[countOfHeaders].m_data);
+
+                auto cmsg = CMSG_FIRSTHDR(&header);
+                uint16_t segment = static_cast<uint16_t>(m_lengths[index]);
+
+                cmsg->cmsg_level = SOL_UDP;
+                cmsg->cmsg_type = UDP_SEGMENT;
+                cmsg->cmsg_len = CMSG_LEN(sizeof(segment));
+                memcpy(CMSG_DATA(cmsg), &segment, sizeof(segment));
+            }
+
+            m_counts[countOfHeaders] = segments;
+            ii += segments;
+        }
+
+        int result = ::sendmmsg(socket, m_headers.data(), static_cast<unsigned int>(countOfHeaders), SU_SEND_FLAGS);
+
+        // the datagrams of the sent headers
+        if (result > 0)
+        {
+            size_t datagrams = 0;
+            for (int ii = 0; ii < result; ++ii)
+            {
+                datagrams += m_counts[ii];
+
+                // the device has segmented the run, its faults aren't successive
+                if (m_counts[ii] > 1)
+                {
+                    m_countOfGsoFaults = 0;
+                }
+            }
+            result = static_cast<int>(datagrams);
+        }
+        else if (result < 0 && m_counts[0] > 1)
+        {
+            // The kernel doesn't support the segmentation at all, or the device has failed it repeatedly.
+            // EINVAL (e.g. the segment is over the path MTU) and the single EIO split only this run,
+            // the other errors (e.g. ECONNREFUSED, EMSGSIZE) drop the failed datagram below.
+            int error = getSocketError();
+            if (error == EOPNOTSUPP || error == ENOPROTOOPT ||
+                (error == EIO && ++m_countOfGsoFaults >= MaxGsoFaults))
+            {
+                m_isGso = false;
+                continue;
+            }
+
+            if (error == EINVAL || error == EIO)
+            {
+                splitEnd = m_first + m_counts[0];
+                continue;
+            }
+        }
+#else
+        size_t index = m_first;
+        int result = ::sendto(socket, (const char*)slot(index), (int)m_lengths[index], SU_SEND_FLAGS,
+                              m_hasAddr[index] ? (const sockaddr*)&m_addrs[index] : nullptr,
+                              m_hasAddr[index] ? (int)sizeof(sockaddr_in) : 0);
+        result = result < 0 ? -1 : 1;
+#endif
+
+        if (result < 0)
+        {
+            m_lastError = getSocketError();
+
+            if (isWouldBlock(m_lastError))
+            {
+                break;
+            }
+
+            // the failed datagram is dropped, the rest is sent
+            ++m_countOfErrors;
+            ++m_first;
+            continue;
+        }
+
+        m_first += result;
+        sent += result;
+    }
+
+    if (empty())
+    {
+        clear();
+    }
+    return sent;
+}
+
+} // namespace Net
+} // namespace su
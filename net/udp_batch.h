@@ -0,0 +1,150 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "net/platform.h"
+
+namespace su
+{
+namespace Net
+{
+
+// The received datagram, the data is the view of the slot of the batch until the next receiving
+struct Datagram
+{
+    sockaddr_in m_addr;
+    const uint8_t* m_data = nullptr;
+    size_t m_size = 0;
+    // the datagram was longer than the slot, the rest is lost
+    bool m_isTruncated = false;
+};
+
+// The UDP payload of one IPv4 packet, the limit of the data coalesced by GSO/GRO
+static constexpr size_t MaxUdpPayload = 65507;
+
+// The datagrams are received by one recvmmsg() into the fixed slots which are allocated once.
+// The other platforms receive them by recvfrom() one by one.
+class RecvBatch
+{
+public:
+    RecvBatch(size_t count, size_t slotSize);
+
+    RecvBatch(const RecvBatch&) = delete;
+    RecvBatch& operator=(const RecvBatch&) = delete;
+
+    // The kernel coalesces the datagrams of one flow (UDP_GRO, Linux 5.0), the slots are enlarged to hold
+    // the coalesced data and it is split back into the datagrams. false - it isn't supported
+    bool enableGro(SOCKET socket);
+    bool isGro() const { return m_isGro; }
+
+    // The socket must be non-blocking. Returns the count of the received datagrams, 0 - nothing, -1 - the error
+    int recv(SOCKET socket);
+
+    const Datagram* data() const { return m_datagrams.data(); }
+    const Datagram& operator[](size_t index) const { return m_datagrams[index]; }
+    size_t size() const { return m_datagrams.size(); }
+    // All slots have been filled, there may be more datagrams in the socket
+    bool isFull() const { return m_countOfMessages == m_addrs.size(); }
+    size_t countOfMessages() const { return m_countOfMessages; }
+    size_t capacity() const { return m_addrs.size(); }
+    size_t slotSize() const { return m_slotSize; }
+
+private:
+    void init();
+    void split(size_t message, size_t size, size_t segment, bool isTruncated);
+
+private:
+    size_t m_slotSize;
+    size_t m_countOfMessages = 0;
+    bool m_isGro = false;
+    std::vector<uint8_t> m_buffer;
+    std::vector<sockaddr_in> m_addrs;
+    std::vector<Datagram> m_datagrams;
+#ifdef __linux__
+    struct Control
+    {
+        alignas(cmsghdr) char m_data[CMSG_SPACE(sizeof(int))];
+    };
+
+    std::vector<mmsghdr> m_headers;
+    std::vector<iovec> m_iovs;
+    std::vector<Control> m_controls;
+#endif
+};
+
+// The datagrams are copied into the fixed slots and sent by one sendmmsg(). The datagrams without
+// the address are sent to the peer of the connected socket.
+class SendBatch
+{
+public:
+    // The segments of one GSO send, the kernel limit (UDP_MAX_SEGMENTS)
+    static constexpr size_t MaxGsoSegments = 64;
+    // The successive EIO of the segmented sends turning it off
+    static constexpr size_t MaxGsoFaults = 3;
+
+    SendBatch(size_t count, size_t slotSize);
+
+    SendBatch(const SendBatch&) = delete;
+    SendBatch& operator=(const SendBatch&) = delete;
+
+    // The successive datagrams of the same size to the same address are sent as one buffer which is segmented
+    // by the kernel or the NIC (UDP_SEGMENT, Linux 4.18). It is turned off if the kernel doesn't support it
+    // (EOPNOTSUPP, ENOPROTOOPT) or the device fails it MaxGsoFaults times in a row (EIO). The run rejected
+    // by EINVAL (e.g. the segment over the path MTU) or EIO is sent one by one by this call only,
+    // the other errors drop the datagram as without it. false - it isn't supported by the platform
+    bool setGso(bool isEnabled);
+    bool isGso() const { return m_isGso; }
+
+    // false - the batch is full or the data doesn't fit the slot
+    bool add(const sockaddr_in& addr, const void* data, size_t size) { return add(&addr, data, size); }
+    bool add(const void* data, size_t size) { return add(nullptr, data, size); }
+
+    // Sends the queued datagrams, the sent ones are removed. The datagram failed by the error other than
+    // EAGAIN is dropped, so the batch never stalls. Returns the count of the sent datagrams
+    size_t send(SOCKET socket);
+    void clear() { m_first = m_size = 0; }
+
+    size_t size() const { return m_size - m_first; }
+    bool empty() const { return m_first == m_size; }
+    bool isFull() const { return m_size == m_lengths.size() && !m_first; }
+    size_t slotSize() const { return m_slotSize; }
+    size_t countOfErrors() const { return m_countOfErrors; }
+    int lastError() const { return m_lastError; }
+
+private:
+    bool add(const sockaddr_in* addr, const void* data, size_t size);
+    uint8_t* slot(size_t index) { return m_buffer.data() + index * m_slotSize; }
+    void compact();
+    size_t countOfSegments(size_t index, size_t count) const;
+    bool isSameAddress(size_t first, size_t second) const;
+
+private:
+    size_t m_slotSize;
+    size_t m_first = 0;
+    size_t m_size = 0;
+    size_t m_countOfErrors = 0;
+    int m_lastError = 0;
+    bool m_isGso = false;
+    size_t m_countOfGsoFaults = 0;
+    std::vector<uint8_t> m_buffer;
+    std::vector<size_t> m_lengths;
+    std::vector<sockaddr_in> m_addrs;
+    std::vector<bool> m_hasAddr;
+#ifdef __linux__
+    struct Control
+    {
+        alignas(cmsghdr) char m_data[CMSG_SPACE(sizeof(uint16_t))];
+    };
+
+    std::vector<mmsghdr> m_headers;
+    std::vector<iovec> m_iovs;
+    std::vector<Control> m_controls;
+    // the count of the datagrams sent by the header
+    std::vector<size_t> m_counts;
+#endif
+};
+
+} // namespace Net
+} // namespace su
@@ -1,8 +1,7 @@
 
-#include "udp_node.h"
+#include "net/udp_node.h"
 
-#define WIN32_LEAN_AND_MEAN
-#include <WinSock2.h>
+#include <cstring>
 
 #include "log.h"
 
@@ -21,11 +20,13 @@ UdpNode::UdpNode(SOCKET socket, const sockaddr_in& addr, int32_t id, Log* plog)
 
 RecvStatus UdpNode::recv(uint8_t* data, size_t size, const sockaddr_in& addr)
 {
-    RawData packet(addr, size);
-
-    memcpy(packet.raw.data(), data, size);
+    return recv(Bytes::copy(data, size), addr);
+}
 
-    m_packets.push_back(std::move(packet));
+RecvStatus UdpNode::recv(const Bytes& data, const sockaddr_in& addr)
+{
+    // the datagram is kept without copying
+    m_packets.emplace_back(addr, data);
 
     return su::Net::RecvStatus::Complited;
 }
@@ -37,10 +38,7 @@ RawData UdpNode::extractPacket()
         return RawData();
     }
 
-    auto out = std::move(m_packets.back());
-    m_packets.pop_back();
-
-    return out;
+    return m_packets.pop_front();
 }
 
 } // namespace Net
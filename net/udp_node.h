@@ -2,6 +2,7 @@
 #pragma once
 
 #include "net/node.h"
+#include "net/ring_queue.h"
 
 namespace su
 {
@@ -14,15 +15,18 @@ public:
     UdpNode(int32_t id = -1, su::Log* plog = nullptr);
     UdpNode(SOCKET socket, const sockaddr_in& addr, int32_t id = -1, su::Log* plog = nullptr);
 
+    // The packets are extracted in the order of receiving
     size_t countOfPackets() const { return m_packets.size(); }
     RawData extractPacket();
     void clearPackets() { m_packets.clear(); }
 
     // su::Net::Node
+    using Node::recv;
     virtual su::Net::RecvStatus recv(uint8_t* read_buff, size_t read_size, const sockaddr_in& addr) override;
+    virtual su::Net::RecvStatus recv(const Bytes& data, const sockaddr_in& addr) override;
 
 protected:
-    std::vector<RawData> m_packets;
+    RingQueue<RawData> m_packets;
 };
 
 } // namespace Net
@@ -0,0 +1,370 @@
+#include "net/udp_sender.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace su
+{
+namespace Net
+{
+
+Result UdpSender::open()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return openLocked();
+}
+
+Result UdpSender::openLocked()
+{
+    if (isOpen())
+    {
+        return OK;
+    }
+
+    m_socket = ::socket(AF_INET, SOCK_DGRAM, 0);
+    if (m_socket == SOCKET_ERROR)
+    {
+        LOGSPE(m_log, "Can not create the UDP socket. Error: %i", getSocketError());
+        return CantCreateSocket;
+    }
+
+    // the options are restored after the reopening
+    if (m_broadcast)
+    {
+        setOption(SOL_SOCKET, SO_BROADCAST, &m_broadcast, sizeof(m_broadcast));
+    }
+    if (m_multicastTtl >= 0)
+    {
+        setOption(IPPROTO_IP, IP_MULTICAST_TTL, &m_multicastTtl, sizeof(m_multicastTtl));
+    }
+    if (m_multicastLoopback >= 0)
+    {
+        setOption(IPPROTO_IP, IP_MULTICAST_LOOP, &m_multicastLoopback, sizeof(m_multicastLoopback));
+    }
+    if (m_hasMulticastInterface)
+    {
+        setOption(IPPROTO_IP, IP_MULTICAST_IF, &m_multicastInterface, sizeof(m_multicastInterface));
+    }
+
+    return OK;
+}
+
+void UdpSender::close()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (isOpen())
+    {
+        closeSocket(m_socket);
+        m_socket = SOCKET_ERROR;
+    }
+
+    m_isConnected = false;
+    if (m_batch)
+    {
+        m_batch->clear();
+    }
+}
+
+bool UdpSender::setOption(int level, int name, const void* value, size_t size)
+{
+    return ::setsockopt(m_socket, level, name, (const char*)value, (int)size) != SOCKET_ERROR;
+}
+
+bool UdpSender::setBroadcast(bool isEnabled)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // the same option isn't set again
+    if (m_broadcast == int(isEnabled) && isOpen())
+    {
+        return true;
+    }
+
+    m_broadcast = isEnabled;
+    return openLocked() == OK && setOption(SOL_SOCKET, SO_BROADCAST, &m_broadcast, sizeof(m_broadcast));
+}
+
+bool UdpSender::setMulticastTtl(uint8_t ttl)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_multicastTtl == int(ttl) && isOpen())
+    {
+        return true;
+    }
+
+    m_multicastTtl = ttl;
+    return openLocked() == OK && setOption(IPPROTO_IP, IP_MULTICAST_TTL, &m_multicastTtl, sizeof(m_multicastTtl));
+}
+
+bool UdpSender::setMulticastLoopback(bool isEnabled)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_multicastLoopback == int(isEnabled) && isOpen())
+    {
+        return true;
+    }
+
+    m_multicastLoopback = isEnabled;
+    return openLocked() == OK &&
+           setOption(IPPROTO_IP, IP_MULTICAST_LOOP, &m_multicastLoopback, sizeof(m_multicastLoopback));
+}
+
+bool UdpSender::setMulticastInterface(const std::string& ip)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    uint32_t value = 0;
+
+    if (inet_pton(AF_INET, ip.c_str(), &value) != 1)
+    {
+        return false;
+    }
+
+    // the same interface isn't set again
+    if (m_hasMulticastInterface && value == m_multicastInterface && isOpen())
+    {
+        return true;
+    }
+
+    m_multicastInterface = value;
+    m_hasMulticastInterface = true;
+    return openLocked() == OK &&
+           setOption(IPPROTO_IP, IP_MULTICAST_IF, &m_multicastInterface, sizeof(m_multicastInterface));
+}
+
+Result UdpSender::connect(const std::string& host, uint16_t port)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Result result = openLocked();
+
+    if (result != OK)
+    {
+        return result;
+    }
+
+    if (!resolveLocked(host, port, m_peer) || ::connect(m_socket, (sockaddr*)&m_peer, sizeof(m_peer)) == SOCKET_ERROR)
+    {
+        LOGSPW(m_log, "Can not connect the UDP socket to %s:%u. Error: %i", host.c_str(), port, getSocketError());
+        m_isConnected = false;
+        return CantConnect;
+    }
+
+    m_isConnected = true;
+    return OK;
+}
+
+bool UdpSender::resolve(const std::string& host, uint16_t port, sockaddr_in& addr)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return resolveLocked(host, port, addr);
+}
+
+bool UdpSender::resolveLocked(const std::string& host, uint16_t port, sockaddr_in& addr)
+{
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+
+    auto now = std::chrono::steady_clock::now();
+    auto item = m_hosts.find(host);
+    if (item != m_hosts.end() && (!m_cacheTtl.count() || now - item->second.m_resolved < m_cacheTtl))
+    {
+        addr.sin_addr = item->second.m_addr;
+        return true;
+    }
+
+    // The address is parsed, the name is resolved by the system
+    if (inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1)
+    {
+        addrinfo hints = {};
+        addrinfo* info = nullptr;
+
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_DGRAM;
+
+        if (getaddrinfo(host.c_str(), nullptr, &hints, &info) != 0 || !info)
+        {
+            LOGSPW(m_log, "Can not resolve the host %s", host.c_str());
+            return false;
+        }
+
+        addr.sin_addr = reinterpret_cast<sockaddr_in*>(info->ai_addr)->sin_addr;
+        freeaddrinfo(info);
+    }
+
+    m_hosts[host] = Host{ addr.sin_addr, now };
+    return true;
+}
+
+void UdpSender::clearCache()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_hosts.clear();
+}
+
+void UdpSender::setCacheTtl(std::chrono::seconds ttl)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_cacheTtl = ttl;
+}
+
+int UdpSender::send(const void* data, size_t size)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_isConnected ? sendLocked(nullptr, data, size) : -1;
+}
+
+int UdpSender::sendTo(const std::string& host, uint16_t port, const void* data, size_t size)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    sockaddr_in addr;
+
+    return resolveLocked(host, port, addr) ? sendLocked(&addr, data, size) : -1;
+}
+
+int UdpSender::sendTo(const sockaddr_in& addr, const void* data, size_t size)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return sendLocked(&addr, data, size);
+}
+
+int UdpSender::sendLocked(const sockaddr_in* addr, const void* data, size_t size)
+{
+    if (openLocked() != OK)
+    {
+        return -1;
+    }
+
+    return ::sendto(m_socket, (const char*)data, (int)size, SU_SEND_FLAGS,
+                    (const sockaddr*)addr, addr ? (int)sizeof(sockaddr_in) : 0);
+}
+
+int UdpSender::sendSegments(const sockaddr_in* addr, const void* data, size_t size, size_t segmentSize)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (!segmentSize || segmentSize >= size)
+    {
+        return sendLocked(addr, data, size);
+    }
+
+    if (openLocked() != OK)
+    {
+        return -1;
+    }
+
+    // The segments are sent by the chunks of the maximum GSO size or one by one
+    auto ptr = static_cast<const uint8_t*>(data);
+    size_t sent = 0;
+    size_t chunk = segmentSize;
+
+#ifdef __linux__
+    if (segmentSize <= MaxUdpPayload)
+    {
+        chunk = std::min(SendBatch::MaxGsoSegments, MaxUdpPayload / segmentSize) * segmentSize;
+    }
+#endif
+
+    while (sent < size)
+    {
+        size_t length = std::min(chunk, size - sent);
+        int result = 0;
+
+#ifdef __linux__
+        if (chunk != segmentSize && length > segmentSize)
+        {
+            alignas(cmsghdr) char control[CMSG_SPACE(sizeof(uint16_t))] = {};
+            iovec iov = { (void*)(ptr + sent), length };
+            msghdr msg = {};
+            uint16_t segment = static_cast<uint16_t>(segmentSize);
+
+            msg.msg_name = (void*)addr;
+            msg.msg_namelen = addr ? sizeof(sockaddr_in) : 0;
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            msg.msg_control = control;
+            msg.msg_controllen = sizeof(control);
+
+            auto cmsg = CMSG_FIRSTHDR(&msg);
+            cmsg->cmsg_level = SOL_UDP;
+            cmsg->cmsg_type = UDP_SEGMENT;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(segment));
+            memcpy(CMSG_DATA(cmsg), &segment, sizeof(segment));
+
+            result = ::sendmsg(m_socket, &msg, SU_SEND_FLAGS);
+
+            // the kernel or the device doesn't support the segmentation
+            if (result < 0 && !isWouldBlock(getSocketError()))
+            {
+                chunk = segmentSize;
+                continue;
+            }
+        }
+        else
+#endif
+        {
+            result = ::sendto(m_socket, (const char*)ptr + sent, (int)length, SU_SEND_FLAGS,
+                              (const sockaddr*)addr, addr ? (int)sizeof(sockaddr_in) : 0);
+        }
+
+        if (result < 0)
+        {
+            break;
+        }
+        sent += length;
+    }
+
+    return sent ? (int)sent : -1;
+}
+
+void UdpSender::setBatch(size_t count, size_t slotSize, bool isGso)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_batch = count ? std::make_unique<SendBatch>(count, slotSize) : nullptr;
+    if (m_batch)
+    {
+        m_batch->setGso(isGso);
+    }
+}
+
+bool UdpSender::queue(const std::string& host, uint16_t port, const void* data, size_t size)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    sockaddr_in addr;
+
+    return resolveLocked(host, port, addr) && queueLocked(&addr, data, size);
+}
+
+bool UdpSender::queue(const void* data, size_t size)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_isConnected && queueLocked(nullptr, data, size);
+}
+
+bool UdpSender::queueLocked(const sockaddr_in* addr, const void* data, size_t size)
+{
+    if (!m_batch || size > m_batch->slotSize() || openLocked() != OK)
+    {
+        return false;
+    }
+
+    // the full batch is sent to free the slots
+    if (m_batch->isFull())
+    {
+        m_batch->send(m_socket);
+    }
+
+    return addr ? m_batch->add(*addr, data, size) : m_batch->add(data, size);
+}
+
+size_t UdpSender::flush()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_batch && isOpen() ? m_batch->send(m_socket) : 0;
+}
+
+} // namespace Net
+} // namespace su
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "net/net.h"
+#include "net/udp_batch.h"
+#include "log.h"
+
+namespace su
+{
+namespace Net
+{
+
+// The UDP sender keeps the socket open between the sendings. The options are set once, the addresses of the hosts
+// are resolved once and cached. The sender may be connected to the fixed peer, then the datagrams are sent without
+// the address. The methods may be called by many threads.
+class UdpSender
+{
+public:
+    explicit UdpSender(Log* plog = nullptr) : m_log(plog) {}
+    ~UdpSender() { close(); }
+
+    UdpSender(const UdpSender&) = delete;
+    UdpSender& operator=(const UdpSender&) = delete;
+
+    // The socket is opened by the first sending if it isn't opened explicitly
+    Result open();
+    void close();
+    bool isOpen() const { return m_socket != SOCKET_ERROR; }
+
+    // The options are applied to the opened socket and kept for the reopening, the same value isn't set again
+    bool setBroadcast(bool isEnabled);
+    bool setMulticastTtl(uint8_t ttl);
+    bool setMulticastLoopback(bool isEnabled);
+    bool setMulticastInterface(const std::string& ip);
+
+    // The connected UDP: the kernel doesn't look up the route for every datagram, send() goes to the peer
+    Result connect(const std::string& host, uint16_t port);
+    bool isConnected() const { return m_isConnected; }
+
+    // Return the count of the sent bytes, -1 - the error
+    int send(const void* data, size_t size);
+    int sendTo(const std::string& host, uint16_t port, const void* data, size_t size);
+    int sendTo(const sockaddr_in& addr, const void* data, size_t size);
+    // The data is split into the datagrams of segmentSize bytes, they are sent by UDP_SEGMENT where it is supported.
+    // nullptr addr - to the connected peer
+    int sendSegments(const sockaddr_in* addr, const void* data, size_t size, size_t segmentSize);
+
+    // The host is the address or the name, it is resolved once. false - it can't be resolved.
+    // The cached addresses don't follow the changes of DNS: the names are resolved again after the TTL
+    // (0 - never, by default) or clearCache(), it must be called when the addresses of the hosts change.
+    bool resolve(const std::string& host, uint16_t port, sockaddr_in& addr);
+    void clearCache();
+    void setCacheTtl(std::chrono::seconds ttl);
+
+    // The queued datagrams are sent by one sendmmsg() when the batch is full or by flush()
+    void setBatch(size_t count, size_t slotSize, bool isGso = false);
+    bool queue(const std::string& host, uint16_t port, const void* data, size_t size);
+    bool queue(const void* data, size_t size);
+    size_t flush();
+
+private:
+    Result openLocked();
+    bool setOption(int level, int name, const void* value, size_t size);
+    bool resolveLocked(const std::string& host, uint16_t port, sockaddr_in& addr);
+    bool queueLocked(const sockaddr_in* addr, const void* data, size_t size);
+    int sendLocked(const sockaddr_in* addr, const void* data, size_t size);
+
+private:
+    Log* m_log = nullptr;
+    std::mutex m_mutex;
+    SOCKET m_socket = SOCKET_ERROR;
+    bool m_isConnected = false;
+    sockaddr_in m_peer = {};
+    // the options for the reopening
+    int m_broadcast = 0;
+    int m_multicastTtl = -1;
+    int m_multicastLoopback = -1;
+    uint32_t m_multicastInterface = 0;
+    bool m_hasMulticastInterface = false;
+    struct Host
+    {
+        in_addr m_addr;
+        std::chrono::steady_clock::time_point m_resolved;
+    };
+    std::unordered_map<std::string, Host> m_hosts;
+    std::chrono::seconds m_cacheTtl{ 0 };
+    std::unique_ptr<SendBatch> m_batch;
+};
+
+} // namespace Net
+} // namespace su
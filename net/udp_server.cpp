@@ -2,8 +2,6 @@
 #include "net/udp_server.h"
 
 #include <algorithm>
-#include <WS2tcpip.h>
-#include <fcntl.h>
 
 namespace su
 {
@@ -70,6 +68,18 @@ Result UdpServer::start(const std::string& ip, uint16_t port, bool isMulticast)
         return result;
     }
 
+    if (m_recvBatch && m_isRecvGro && !m_recvBatch->enableGro(m_node.socket()))
+    {
+        LOGSPW(m_log, "The UDP GRO is not supported. The datagrams will be received one by one");
+    }
+
+    uint32_t recvBufferSize = m_recvBufferSize.load();
+
+    if (recvBufferSize && !setRecvBufferSize(recvBufferSize))
+    {
+        LOGSPW(m_log, "Can not set the receive buffer size %u. Error: %i", recvBufferSize, getSocketError());
+    }
+
     m_isStarted = true;
 
     return OK;
@@ -133,7 +143,11 @@ void UdpServer::doWork()
         return;
     }
 
-    if (FD_ISSET(m_node.socket(), &readfds))
+    if (FD_ISSET(m_node.socket(), &readfds) && m_recvBatch)
+    {
+        recvBatches();
+    }
+    else if (FD_ISSET(m_node.socket(), &readfds))
     {
         auto result = m_node.readFromSocket();
 
@@ -150,6 +164,99 @@ void UdpServer::doWork()
             return;
         }
     }
+
+    // The packets completed by the pool since the last tick (e.g. decompressed)
+    auto completed = m_node.pollRecv();
+
+    if (completed == Fault)
+    {
+        LOGSPW(m_log, "Can not receive the data from multicast.");
+        destroy();
+    }
+    else if (completed == Complited && !onRecvFromNode())
+    {
+        LOGSPW(m_log, "Can not process the data from multicast.");
+        destroy();
+    }
+}
+
+bool UdpServer::recvBatches()
+{
+    // The socket is read until it is empty, but not longer than the batches of one tick
+    for (size_t ii = 0; ii < m_maxBatchesPerTick; ++ii)
+    {
+        int count = m_recvBatch->recv(m_node.socket());
+
+        if (count < 0)
+        {
+            LOGSPW(m_log, "Can not receive the data from multicast. Error: %i", getSocketError());
+            destroy();
+            return false;
+        }
+
+        if (count && !onRecvBatch(m_recvBatch->data(), count))
+        {
+            LOGSPW(m_log, "Can not process the data from multicast.");
+            destroy();
+            return false;
+        }
+
+        if (!m_recvBatch->isFull())
+        {
+            break;
+        }
+    }
+
+    return true;
+}
+
+void UdpServer::setRecvBatch(size_t count, size_t slotSize, bool isGro)
+{
+    if (isStarted())
+    {
+        return;
+    }
+
+    m_isRecvGro = isGro;
+    m_recvBatch = count ? std::make_unique<RecvBatch>(count, slotSize) : nullptr;
+}
+
+uint32_t UdpServer::setRecvBufferSize(uint32_t size)
+{
+    m_recvBufferSize.store(size);
+
+    if (m_node.socket() == SOCKET_ERROR)
+    {
+        return 0;
+    }
+
+    int value = static_cast<int>(size);
+#ifdef SO_RCVBUFFORCE
+    // over net.core.rmem_max if the process has CAP_NET_ADMIN
+    if (::setsockopt(m_node.socket(), SOL_SOCKET, SO_RCVBUFFORCE, (const char*)&value, sizeof(value)) == 0)
+    {
+        return recvBufferSize();
+    }
+#endif
+
+    if (::setsockopt(m_node.socket(), SOL_SOCKET, SO_RCVBUF, (const char*)&value, sizeof(value)) == SOCKET_ERROR)
+    {
+        return 0;
+    }
+    return recvBufferSize();
+}
+
+uint32_t UdpServer::recvBufferSize() const
+{
+    int value = 0;
+    socklen_t size = sizeof(value);
+
+    if (m_node.socket() == SOCKET_ERROR ||
+        ::getsockopt(m_node.socket(), SOL_SOCKET, SO_RCVBUF, (char*)&value, &size) == SOCKET_ERROR)
+    {
+        return 0;
+    }
+    return static_cast<uint32_t>(value);
 }
 
 } // namespace Net
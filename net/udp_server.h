@@ -1,10 +1,12 @@
 #pragma once
 
+#include <memory>
 #include <string>
 #include <vector>
 #include <mutex>
 #include "thread_class.h"
 #include "net/node.h"
+#include "net/udp_batch.h"
 #include "log.h"
 
 namespace su
@@ -28,6 +30,20 @@ public:
 
     bool isStarted() const { return m_isStarted.load(); }
 
+    // The batch mode must be set before start(): the datagrams are received by recvmmsg() into count slots
+    // of slotSize bytes and passed to onRecvBatch() instead of the node, 0 - the node receives them one by one.
+    // GRO receives the datagrams coalesced by the kernel, the slots are enlarged to 64 KB then (RecvBatch::enableGro())
+    void setRecvBatch(size_t count, size_t slotSize = DefaultSlotSize, bool isGro = false);
+    static constexpr size_t DefaultSlotSize = 2048;
+
+    // The kernel receive buffer of the socket, it may be changed while the server works. Returns the real size
+    // (Linux doubles the value and clamps it by net.core.rmem_max if there is no CAP_NET_ADMIN), 0 - the error
+    uint32_t setRecvBufferSize(uint32_t size);
+    uint32_t recvBufferSize() const;
+
+    // The replies are sent by the socket of the server, returns the count of the sent datagrams
+    size_t send(SendBatch& batch) { return batch.send(m_node.socket()); }
+
 protected:
     // ThreadClass
     virtual void doWork() override;
@@ -35,11 +51,14 @@ protected:
 
     // McServer
     virtual bool onRecvFromNode() { return true; }
+    // The batch mode, the data of the datagrams is valid until the return
+    virtual bool onRecvBatch(const Datagram*, size_t) { return true; }
 
     Log* getLog() { return m_log; }
 
 private:
     void destroy();
+    bool recvBatches();
 
 protected:
     std::string m_hostIp = "127.0.0.1";
@@ -51,6 +70,12 @@ private:
     Log* m_log = nullptr;
     Node& m_node;
     std::mutex m_mutex;
+    std::unique_ptr<RecvBatch> m_recvBatch;
+    // The count of recvmmsg() by one tick, the rest is received on the next one
+    size_t m_maxBatchesPerTick = 64;
+    // it is set by any thread and applied by start() again
+    std::atomic<uint32_t> m_recvBufferSize = 0;
+    bool m_isRecvGro = false;
     std::atomic<bool> m_isStarted = false;
 };
 
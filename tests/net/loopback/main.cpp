@@ -0,0 +1,1667 @@
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <thread>
+
+#include "crc.h"
+#include "log.h"
+#include "threadpool.h"
+#include "net/compress.h"
+#include "net/packetnode.h"
+#include "net/tcp_client.h"
+#include "net/tcp_server.h"
+#include "net/timing_wheel.h"
+#include "net/udp_node.h"
+#include "net/udp_sender.h"
+#include "net/udp_server.h"
+
+namespace
+{
+
+const uint32_t Magic = 0x4c4f4f50;
+const uint16_t TcpPort = 27401;
+const uint16_t UdpPort = 27402;
+const uint16_t IdlePort = 27403;
+const uint16_t BroadcastPort = 27405;
+const uint16_t WaitPort = 27407;
+const uint16_t RefusedPort = 27409;        // nobody listens it
+const uint16_t DetachPort = 27410;
+
+int g_failed = 0;
+
+#define CHECK(exp) { if (!(exp)) { printf("FAILED %s:%i: %s\n", __FILE__, __LINE__, #exp); ++g_failed; } }
+
+bool waitFor(const std::function<bool()>& cond, size_t msec = 5000)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(msec);
+
+    while (!cond())
+    {
+        if (std::chrono::steady_clock::now() > deadline)
+        {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+std::vector<uint8_t> makePacket(size_t idx)
+{
+    std::vector<uint8_t> packet(1 + (idx * 977) % 70000);
+
+    for (size_t ii = 0; ii < packet.size(); ++ii)
+    {
+        packet[ii] = static_cast<uint8_t>(idx + ii * 7);
+    }
+    return packet;
+}
+
+std::vector<uint8_t> makeText(size_t idx, size_t size)
+{
+    std::string text;
+
+    while (text.size() < size)
+    {
+        text += "packet " + std::to_string(idx) + " line " + std::to_string(text.size() % 97) + "; ";
+    }
+    return std::vector<uint8_t>(text.begin(), text.begin() + size);
+}
+
+// The bytes which the node would send to the socket
+std::vector<uint8_t> takeStream(su::Net::Node& node)
+{
+    std::vector<uint8_t> stream;
+    std::vector<su::Net::Bytes> segments;
+
+    while (node.takeSendSegments(segments))
+    {
+        for (auto& segment : segments)
+        {
+            stream.insert(stream.end(), segment.begin(), segment.end());
+        }
+    }
+    return stream;
+}
+
+class EchoServer : public su::Net::TcpServer
+{
+public:
+    EchoServer(su::Log* plog) : su::Net::TcpServer("127.0.0.1", TcpPort, 0, plog) {}
+
+    // The echoed packets of the clients are coalesced
+    void setCoalescing(size_t budget, uint32_t delayUSec) { m_budget = budget; m_delayUSec = delayUSec; }
+    // The clients compress and decompress the packets by the pool
+    void setCompression(size_t threshold, su::ThreadPool* pool) { m_compression = threshold; m_pool = pool; }
+
+    std::atomic<int> m_backpressured = 0;
+
+protected:
+    virtual su::Net::Node* newClient(SOCKET socket, const sockaddr_in& addr) override
+    {
+        auto node = new su::Net::PacketNode(Magic, socket, addr, getNextClientId(), getLog());
+        node->setCoalescing(m_budget, m_delayUSec);
+        node->setCompression(m_compression);
+        node->setCompressionPool(m_pool);
+        return node;
+    }
+
+    virtual bool onRecvFromNode(su::Net::Node* node) override
+    {
+        auto client = static_cast<su::Net::PacketNode*>(node);
+
+        // the received view is sent back without copying
+        client->drainRecvPackets([client](su::Net::RawData& packet) { client->send(packet.raw); });
+        return true;
+    }
+
+    virtual void onClientBackpressure(su::Net::Node*) override { ++m_backpressured; }
+
+private:
+    size_t m_budget = 0;
+    uint32_t m_delayUSec = 0;
+    size_t m_compression = 0;
+    su::ThreadPool* m_pool = nullptr;
+};
+
+class EchoClient : public su::Net::TcpClient
+{
+public:
+    EchoClient(su::Net::PacketNode& node, su::Log* plog) : su::Net::TcpClient(node, plog), m_packetNode(node) {}
+
+    std::mutex m_mutex;
+    std::vector<std::vector<uint8_t>> m_received;
+
+protected:
+    virtual bool onRecvFromNode() override
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        while (m_packetNode.countRecvPackets())
+        {
+            auto packet = m_packetNode.extractRecvPacket();
+            m_received.emplace_back(packet.raw.begin(), packet.raw.end());
+        }
+        return true;
+    }
+
+private:
+    su::Net::PacketNode& m_packetNode;
+};
+
+void testTcpEcho(su::Log& log, su::Net::TcpServer::IoEngine engine)
+{
+    const size_t count = 200;
+
+    EchoServer server(&log);
+    server.setIoEngine(engine);
+    CHECK(server.start() == su::Net::OK);
+    server.run(1);
+
+    sockaddr_in addr = {};
+    su::Net::PacketNode node(Magic, SOCKET_ERROR, addr, -1, &log);
+    EchoClient client(node, &log);
+
+    client.connect("127.0.0.1", TcpPort);
+    client.run(1);
+
+    CHECK(waitFor([&client]() { return client.isConnected(); }));
+    CHECK(waitFor([&server]() { return server.clientsCount() == 1; }));
+
+    for (size_t ii = 0; ii < count; ++ii)
+    {
+        auto packet = makePacket(ii);
+        client.send(packet.data(), packet.size());
+    }
+
+    CHECK(waitFor([&client]() { std::lock_guard<std::mutex> lock(client.m_mutex); return client.m_received.size() == count; }));
+
+    {
+        std::lock_guard<std::mutex> lock(client.m_mutex);
+        std::vector<bool> found(count, false);
+
+        // the packets are compared by size and content, the order is not checked here
+        for (auto& packet : client.m_received)
+        {
+            for (size_t ii = 0; ii < count; ++ii)
+            {
+                if (!found[ii] && packet == makePacket(ii))
+                {
+                    found[ii] = true;
+                    break;
+                }
+            }
+        }
+
+        for (size_t ii = 0; ii < count; ++ii)
+        {
+            CHECK(found[ii]);
+        }
+    }
+
+    client.disconnect();
+    CHECK(waitFor([&server]() { return server.clientsCount() == 0; }));
+
+    client.close();
+    server.close();
+}
+
+void testCoalescing(su::Log& log, su::Net::TcpServer::IoEngine engine)
+{
+    sockaddr_in addr = {};
+    su::Net::Node node(SOCKET_ERROR, addr);
+    size_t notifications = 0;
+
+    node.setSendNotify([&notifications](su::Net::Node*) { ++notifications; });
+    node.setCoalescing(100, 50000);
+
+    // the owner is notified by the first data and by reaching of the budget
+    auto text = makeText(0, 40);
+    node.send(text.data(), text.size());
+    CHECK(node.sendDelay() > 0 && node.sendDelay() <= 50000);
+    node.send(text.data(), text.size());
+    CHECK(node.sendDelay() > 0);
+    CHECK(notifications == 1);
+    node.send(text.data(), text.size());
+    CHECK(node.sendDelay() == 0);
+    CHECK(notifications == 2);
+    CHECK(takeStream(node).size() == 3 * text.size());
+    CHECK(node.sendDelay() == -1);
+
+    // flush() doesn't wait the budget or the delay
+    node.send(text.data(), text.size());
+    CHECK(node.sendDelay() > 0);
+    node.flush();
+    CHECK(node.sendDelay() == 0);
+    CHECK(notifications == 4);
+    takeStream(node);
+
+    // the small packets are echoed by the coalesced writes of both sides
+    const size_t count = 300;
+
+    EchoServer server(&log);
+    server.setIoEngine(engine);
+    server.setCoalescing(su::Net::Node::MtuBudget, 2000);
+    CHECK(server.start() == su::Net::OK);
+    server.run(1);
+
+    su::Net::PacketNode packetNode(Magic, SOCKET_ERROR, addr, -1, &log);
+    packetNode.setCoalescing(su::Net::Node::MtuBudget, 2000);
+    EchoClient client(packetNode, &log);
+
+    client.connect("127.0.0.1", TcpPort);
+    client.run(1);
+
+    CHECK(waitFor([&client]() { return client.isConnected(); }));
+    CHECK(waitFor([&server]() { return server.clientsCount() == 1; }));
+
+    for (size_t ii = 0; ii < count; ++ii)
+    {
+        auto packet = makeText(ii, 10 + ii % 30);
+        client.send(packet.data(), packet.size());
+    }
+
+    CHECK(waitFor([&client]() { std::lock_guard<std::mutex> lock(client.m_mutex); return client.m_received.size() == count; }));
+
+    {
+        std::lock_guard<std::mutex> lock(client.m_mutex);
+
+        for (size_t ii = 0; ii < client.m_received.size(); ++ii)
+        {
+            CHECK(client.m_received[ii] == makeText(ii, 10 + ii % 30));
+        }
+    }
+
+    // the last small packet isn't held after flush()
+    auto last = makeText(count, 10);
+    client.send(last.data(), last.size());
+    client.flush();
+    CHECK(waitFor([&client]() { std::lock_guard<std::mutex> lock(client.m_mutex); return client.m_received.size() == count + 1; }));
+
+    client.disconnect();
+    CHECK(waitFor([&server]() { return server.clientsCount() == 0; }));
+
+    client.close();
+    server.close();
+}
+
+void testBackpressure()
+{
+    using Policy = su::Net::Node::SendPolicy;
+
+    sockaddr_in addr = {};
+    std::vector<uint8_t> data(60, 'x');
+    std::vector<bool> events;
+
+    // the data over the high water mark is dropped, the queue is writable again at the low water mark
+    su::Net::Node node(SOCKET_ERROR, addr);
+    node.setBackpressureNotify([&events](su::Net::Node*, bool isWritable) { events.push_back(isWritable); });
+    node.setWaterMarks(100, 40, Policy::Drop);
+
+    CHECK(node.send(data.data(), data.size()) == data.size());
+    CHECK(node.send(data.data(), data.size()) == 0);
+    CHECK(node.isBackpressured() && node.countDroppedSends() == 1);
+    CHECK(events == std::vector<bool>({ false }));
+    CHECK(takeStream(node).size() == data.size());
+    CHECK(!node.isBackpressured());
+    CHECK(events == std::vector<bool>({ false, true }));
+
+    // the big packet is queued alone
+    std::vector<uint8_t> big(500, 'y');
+    CHECK(node.send(big.data(), big.size()) == big.size());
+    CHECK(node.send(data.data(), data.size()) == 0);
+    takeStream(node);
+
+    // the overflowed node is reported to the owner
+    su::Net::Node overflowed(SOCKET_ERROR, addr);
+    size_t notifications = 0;
+    overflowed.setSendNotify([&notifications](su::Net::Node*) { ++notifications; });
+    overflowed.setWaterMarks(100, 0, Policy::Disconnect);
+    overflowed.send(data.data(), data.size());
+    CHECK(overflowed.send(data.data(), data.size()) == 0);
+    CHECK(overflowed.isSendOverflowed() && notifications == 2);
+
+    // the producer is blocked until the queue drains or the timeout
+    su::Net::Node blocking(SOCKET_ERROR, addr);
+    blocking.setWaterMarks(100, 0, Policy::Block, 5000);
+    blocking.send(data.data(), data.size());
+
+    std::atomic<size_t> sent = 1;
+    std::thread producer([&blocking, &data, &sent]() { sent = blocking.send(data.data(), data.size()); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    CHECK(sent == 1);
+
+    // only the queued data is taken, the producer queues its data after that
+    std::vector<su::Net::Bytes> segments;
+    CHECK(blocking.takeSendSegments(segments) == data.size());
+    producer.join();
+    CHECK(sent == data.size());
+
+    blocking.setWaterMarks(100, 0, Policy::Block, 20);
+    CHECK(blocking.send(data.data(), data.size()) == 0);
+    takeStream(blocking);
+
+    // the frame of the broadcast is refused at once
+    su::Net::Node::Frame frame = { su::Net::Bytes(), su::Net::Bytes::copy(data.data(), data.size()), false };
+    blocking.setWaterMarks(100, 0, Policy::Block, 5000);
+    blocking.send(data.data(), data.size());
+
+    auto start = std::chrono::steady_clock::now();
+    CHECK(blocking.sendFrame(frame) == 0);
+    CHECK(std::chrono::steady_clock::now() - start < std::chrono::seconds(1));
+    takeStream(blocking);
+
+    // the budget is shared by the nodes
+    su::Net::SendBudget budget;
+    budget.m_limit = 200;
+    {
+        su::Net::Node first(SOCKET_ERROR, addr);
+        su::Net::Node second(SOCKET_ERROR, addr);
+        first.setSendBudget(&budget);
+        second.setSendBudget(&budget);
+        second.setWaterMarks(0, 0, Policy::Drop);
+
+        std::vector<uint8_t> packet(150, 'z');
+        CHECK(first.send(packet.data(), packet.size()) == packet.size());
+        CHECK(second.send(packet.data(), packet.size()) == 0);
+        CHECK(budget.m_used == packet.size());
+    }
+    CHECK(budget.m_used == 0);
+}
+
+void testSlowReader(su::Log& log, su::Net::TcpServer::IoEngine engine)
+{
+    EchoServer server(&log);
+    server.setIoEngine(engine);
+    server.setSendLimits(256 * 1024, 64 * 1024, su::Net::Node::SendPolicy::Disconnect);
+    server.setSendBudget(1024 * 1024);
+    CHECK(server.start() == su::Net::OK);
+    server.run(1);
+
+    // the client doesn't read
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(TcpPort);
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+
+    SOCKET socket = ::socket(AF_INET, SOCK_STREAM, 0);
+    CHECK(::connect(socket, (sockaddr*)&addr, sizeof(addr)) == 0);
+    CHECK(waitFor([&server]() { return server.clientsCount() == 1; }));
+
+    // the queue of the slow client is limited, it is disconnected
+    auto data = su::Net::Bytes::copy(std::vector<uint8_t>(16 * 1024, 's').data(), 16 * 1024);
+    size_t maxUsed = 0;
+
+    for (size_t ii = 0; ii < 10000 && server.clientsCount(); ++ii)
+    {
+        server.send(nullptr, data);
+        maxUsed = std::max(maxUsed, server.sendBudgetUsed());
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+
+    CHECK(server.clientsCount() == 0);
+    CHECK(server.m_backpressured > 0);
+    CHECK(maxUsed <= 256 * 1024 + 16 * 1024 + 64);
+    CHECK(waitFor([&server]() { return server.sendBudgetUsed() == 0; }));
+
+    su::Net::closeSocket(socket);
+    server.close();
+}
+
+class IdleServer : public EchoServer
+{
+public:
+    using Idle = su::Net::TcpServer::Idle;
+
+    IdleServer(su::Log* plog) : EchoServer(plog) {}
+
+    std::atomic<int> m_idle[3] = {};
+
+protected:
+    virtual bool onClientIdle(su::Net::Node* node, Idle idle) override
+    {
+        ++m_idle[static_cast<int>(idle)];
+        return su::Net::TcpServer::onClientIdle(node, idle);
+    }
+};
+
+void testTimingWheel()
+{
+    using namespace std::chrono;
+    using Entry = su::Net::TimingWheel::Entry;
+
+    // the ticks of the wheel are counted from its creation, so the time is approximated from below
+    auto base = steady_clock::now();
+    su::Net::TimingWheel wheel(milliseconds(1));
+    std::vector<Entry*> expired;
+    auto collect = [&expired](Entry& entry) { expired.push_back(&entry); };
+
+    Entry first, cancelled, middle, far;
+    wheel.schedule(first, 5);
+    wheel.schedule(cancelled, 5);
+    wheel.schedule(middle, 200);
+    wheel.schedule(far, 70000);
+    wheel.cancel(cancelled);
+    CHECK(wheel.size() == 3);
+    CHECK(!cancelled.isScheduled());
+
+    CHECK(wheel.advance(base + milliseconds(3), collect) == 0);
+    CHECK(wheel.advance(base + milliseconds(10), collect) == 1);
+    CHECK(expired.size() == 1 && expired[0] == &first);
+    CHECK(!first.isScheduled());
+
+    // the entries of the upper levels cascade down to their ticks
+    CHECK(wheel.advance(base + milliseconds(199), collect) == 0);
+    CHECK(wheel.advance(base + milliseconds(210), collect) == 1);
+    CHECK(expired.back() == &middle);
+
+    // the batch of the same tick, the callback reschedules the entries
+    std::vector<Entry> batch(100);
+    for (auto& entry : batch)
+    {
+        wheel.schedule(entry, 300);
+    }
+
+    size_t rescheduled = 0;
+    CHECK(wheel.advance(base + milliseconds(310), [&wheel, &rescheduled](Entry& entry)
+    {
+        wheel.schedule(entry, wheel.now() + 100);
+        ++rescheduled;
+    }) == 100);
+    CHECK(rescheduled == 100);
+    CHECK(wheel.size() == 101);
+
+    expired.clear();
+    CHECK(wheel.advance(base + milliseconds(420), collect) == 100);
+    CHECK(wheel.advance(base + milliseconds(69990), collect) == 0);
+    CHECK(wheel.advance(base + milliseconds(70010), collect) == 1);
+    CHECK(expired.back() == &far);
+    CHECK(wheel.size() == 0);
+}
+
+// The raw client, it is reset on closing, so the dropped connections don't keep the port in TIME_WAIT
+SOCKET connectRaw(uint16_t port)
+{
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+
+    SOCKET socket = ::socket(AF_INET, SOCK_STREAM, 0);
+    linger reset = { 1, 0 };
+    setsockopt(socket, SOL_SOCKET, SO_LINGER, (const char*)&reset, sizeof(reset));
+
+    CHECK(::connect(socket, (sockaddr*)&addr, sizeof(addr)) == 0);
+    return socket;
+}
+
+void testIdleTimeouts(su::Log& log, su::Net::TcpServer::IoEngine engine)
+{
+    using Idle = su::Net::TcpServer::Idle;
+    const uint16_t port = IdlePort + static_cast<uint16_t>(engine);
+
+    IdleServer server(&log);
+    server.setIoEngine(engine);
+    server.setIdleTimeouts(300, 50, 100);
+    CHECK(server.start("127.0.0.1", port) == su::Net::OK);
+    server.run(1);
+
+    // the silent connection is dropped by the handshake timeout
+    SOCKET socket = connectRaw(port);
+    CHECK(waitFor([&server]() { return server.clientsCount() == 1; }));
+    CHECK(waitFor([&server]() { return server.clientsCount() == 0; }, 2000));
+    CHECK(server.m_idle[static_cast<int>(Idle::Handshake)] == 1);
+    su::Net::closeSocket(socket);
+
+    // the active client stays, the write idle is reported and kept by default
+    sockaddr_in addr = {};
+    su::Net::PacketNode node(Magic, SOCKET_ERROR, addr, -1, &log);
+    auto packet = makePacket(1);
+    node.send(packet.data(), packet.size());
+    auto stream = takeStream(node);
+
+    socket = connectRaw(port);
+    CHECK(waitFor([&server]() { return server.clientsCount() == 1; }));
+
+    for (size_t ii = 0; ii < 20; ++ii)
+    {
+        CHECK(::send(socket, (const char*)stream.data(), stream.size(), MSG_NOSIGNAL) == (ssize_t)stream.size());
+        std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    }
+
+    CHECK(server.clientsCount() == 1);
+    CHECK(server.m_idle[static_cast<int>(Idle::Read)] == 0);
+    CHECK(waitFor([&server]() { return server.m_idle[static_cast<int>(Idle::Write)] >= 2; }));
+
+    // the silent client is dropped by the read timeout
+    CHECK(waitFor([&server]() { return server.clientsCount() == 0; }, 2000));
+    CHECK(server.m_idle[static_cast<int>(Idle::Read)] == 1);
+    CHECK(server.m_idle[static_cast<int>(Idle::Handshake)] == 1);
+
+    su::Net::closeSocket(socket);
+    server.close();
+}
+
+void testAcl(su::Log& log)
+{
+    using Action = su::Net::IpAcl::Action;
+
+    auto ip = [](const char* text)
+    {
+        uint32_t value = 0;
+        inet_pton(AF_INET, text, &value);
+        return value;
+    };
+
+    su::Net::IpAcl acl;
+    CHECK(acl.isAllowed(ip("1.2.3.4")));
+    CHECK(!acl.allow("10.0.0.0/33"));
+    CHECK(!acl.allow("10.0.0/8"));
+    CHECK(!acl.allow("10.0.0.0/"));
+
+    CHECK(acl.allow("10.0.0.0/8"));
+    CHECK(!acl.allow("10.1.2.3/8"));
+    CHECK(acl.deny("10.1.0.0/16"));
+    CHECK(acl.allow("10.1.2.0/24"));
+    CHECK(acl.deny("10.1.2.7"));
+    CHECK(acl.allow("192.168.1.1"));
+    CHECK(acl.allow("0.0.0.0/1"));
+    CHECK(acl.size() == 6);
+
+    // the longest prefix decides, the exact address wins
+    CHECK(acl.find(ip("10.200.0.1")) == Action::Allow);
+    CHECK(acl.find(ip("10.1.3.1")) == Action::Deny);
+    CHECK(acl.find(ip("10.1.2.1")) == Action::Allow);
+    CHECK(acl.find(ip("10.1.2.7")) == Action::Deny);
+    CHECK(acl.find(ip("11.0.0.1")) == Action::Allow);
+    CHECK(acl.find(ip("200.0.0.1")) == Action::None);
+    CHECK(acl.isAllowed(ip("192.168.1.1")));
+    CHECK(!acl.isAllowed(ip("192.168.1.2")));
+
+    // the deny replaces the allow of the same range
+    CHECK(acl.deny("10.0.0.0/8"));
+    CHECK(!acl.allow("10.0.0.0/8"));
+    CHECK(!acl.isAllowed(ip("10.200.0.1")));
+    CHECK(acl.isAllowed(ip("10.1.2.1")));
+
+    // only the deny rules allow the rest
+    su::Net::IpAcl blackList;
+    CHECK(blackList.deny("172.16.0.0/12"));
+    CHECK(!blackList.isAllowed(ip("172.20.1.1")));
+    CHECK(blackList.isAllowed(ip("172.32.1.1")));
+
+    // the rules of the server are swapped atomically
+    EchoServer server(&log);
+    CHECK(server.addBlackIp("127.0.0.0/8"));
+    CHECK(server.start() == su::Net::OK);
+    server.run(1);
+
+    auto before = server.acl();
+    CHECK(server.addWhiteIp("127.0.0.2"));
+    CHECK(before->size() == 1 && server.acl()->size() == 2);
+
+    SOCKET socket = connectRaw(TcpPort);
+    char byte;
+    CHECK(::recv(socket, &byte, 1, 0) <= 0);
+    CHECK(server.clientsCount() == 0);
+    su::Net::closeSocket(socket);
+
+    // the list of the rules is copied once, the wrong and the existing rules are skipped
+    CHECK(server.addAclRules({ "10.0.0.1", "10.1.0.0/16", "bad", "127.0.0.2" }, su::Net::IpAcl::Action::Allow) == 2);
+    CHECK(server.acl()->size() == 4);
+    CHECK(server.addAclRules({ "bad" }, su::Net::IpAcl::Action::Deny) == 0);
+
+    server.setAcl(nullptr);
+    socket = connectRaw(TcpPort);
+    CHECK(waitFor([&server]() { return server.clientsCount() == 1; }));
+    su::Net::closeSocket(socket);
+
+    server.close();
+}
+
+class AdmissionServer : public su::Net::TcpServer
+{
+public:
+    AdmissionServer(uint32_t maxClients, su::Log* plog) : su::Net::TcpServer("127.0.0.1", TcpPort, maxClients, plog) {}
+
+    std::atomic<int> m_configured = 0;
+
+protected:
+    // the options are inherited from the listener
+    virtual void onClientJoin(su::Net::Node* node) override
+    {
+        int noDelay = 0;
+        int keepAlive = 0;
+        socklen_t size = sizeof(int);
+
+        getsockopt(node->socket(), IPPROTO_TCP, TCP_NODELAY, (char*)&noDelay, &size);
+        getsockopt(node->socket(), SOL_SOCKET, SO_KEEPALIVE, (char*)&keepAlive, &size);
+        m_configured += noDelay && keepAlive;
+    }
+};
+
+void testAdmission(su::Log& log, su::Net::TcpServer::IoEngine engine)
+{
+    // the clients over the maximum are rejected, the connected ones stay
+    {
+        AdmissionServer server(2, &log);
+        server.setIoEngine(engine);
+        CHECK(server.start() == su::Net::OK);
+        server.run(1);
+
+        std::vector<SOCKET> sockets;
+        for (size_t ii = 0; ii < 4; ++ii)
+        {
+            sockets.push_back(connectRaw(TcpPort));
+        }
+
+        CHECK(waitFor([&server]() { return server.countRejectedClients() == 2; }));
+        CHECK(server.clientsCount() == 2);
+        CHECK(server.m_configured == 2);
+
+        char byte;
+        CHECK(::recv(sockets[0], &byte, 1, MSG_DONTWAIT) < 0 && su::Net::isWouldBlock(su::Net::getSocketError()));
+        CHECK(::recv(sockets[3], &byte, 1, 0) <= 0);
+
+        for (auto socket : sockets)
+        {
+            su::Net::closeSocket(socket);
+        }
+        CHECK(waitFor([&server]() { return server.clientsCount() == 0; }));
+        server.close();
+    }
+
+    // the storm is accepted by the batches up to the rate
+    {
+        AdmissionServer server(0, &log);
+        server.setIoEngine(engine);
+        server.setAcceptRate(10, 20);
+        CHECK(server.start() == su::Net::OK);
+        server.run(1);
+
+        std::vector<SOCKET> sockets;
+        for (size_t ii = 0; ii < 30; ++ii)
+        {
+            sockets.push_back(connectRaw(TcpPort));
+        }
+
+        CHECK(waitFor([&server]() { return server.clientsCount() + server.countRejectedClients() == 30; }));
+        CHECK(server.clientsCount() >= 20 && server.clientsCount() <= 22);
+
+        // the tokens are refilled by the time
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        sockets.push_back(connectRaw(TcpPort));
+        CHECK(waitFor([&server]() { return server.clientsCount() + server.countRejectedClients() == 31; }));
+        CHECK(server.clientsCount() >= 21);
+
+        for (auto socket : sockets)
+        {
+            su::Net::closeSocket(socket);
+        }
+        CHECK(waitFor([&server]() { return server.clientsCount() == 0; }));
+        server.close();
+    }
+}
+
+void testMultiReactor(su::Log& log, su::Net::TcpServer::IoEngine engine)
+{
+    const size_t countClients = 6;
+    const size_t count = 20;
+
+    EchoServer server(&log);
+    server.setIoEngine(engine);
+    server.setReactorCount(3);
+    CHECK(server.start() == su::Net::OK);
+    server.run(1);
+
+    sockaddr_in addr = {};
+    std::vector<std::unique_ptr<su::Net::PacketNode>> nodes;
+    std::vector<std::unique_ptr<EchoClient>> clients;
+
+    for (size_t ii = 0; ii < countClients; ++ii)
+    {
+        nodes.push_back(std::make_unique<su::Net::PacketNode>(Magic, SOCKET_ERROR, addr, -1, &log));
+        clients.push_back(std::make_unique<EchoClient>(*nodes.back(), &log));
+        clients.back()->connect("127.0.0.1", TcpPort);
+        clients.back()->run(1);
+    }
+
+    CHECK(waitFor([&server, countClients]() { return server.clientsCount() == countClients; }));
+
+    // the clients of all reactors are listed
+    auto accepted = server.clients();
+    CHECK(accepted.size() == countClients);
+    for (auto& client : accepted)
+    {
+        CHECK(client && client->isConnected());
+    }
+    accepted.clear();
+
+    for (size_t ii = 0; ii < count; ++ii)
+    {
+        for (auto& client : clients)
+        {
+            auto packet = makePacket(ii);
+            client->send(packet.data(), packet.size());
+        }
+    }
+
+    // the clients of all reactors receive the broadcast
+    const char* text = "broadcast";
+    CHECK(server.send(nullptr, text, strlen(text)));
+
+    for (auto& client : clients)
+    {
+        auto received = [&client]() { std::lock_guard<std::mutex> lock(client->m_mutex); return client->m_received.size() == count + 1; };
+        CHECK(waitFor(received));
+    }
+
+    for (auto& client : clients)
+    {
+        client->disconnect();
+    }
+    CHECK(waitFor([&server]() { return server.clientsCount() == 0; }));
+
+    for (auto& client : clients)
+    {
+        client->close();
+    }
+    server.close();
+}
+
+// The broadcast is framed once and the same buffers are queued to all clients, every client gets
+// every frame exactly once and intact
+void testBroadcast(su::Log& log, su::Net::TcpServer::IoEngine engine)
+{
+    const size_t countClients = 3;
+    const size_t count = 10;
+    const uint16_t port = BroadcastPort + static_cast<uint16_t>(engine);
+
+    EchoServer server(&log);
+    server.setIoEngine(engine);
+    CHECK(server.start("127.0.0.1", port) == su::Net::OK);
+    server.run(1);
+
+    sockaddr_in addr = {};
+    std::vector<std::unique_ptr<su::Net::PacketNode>> nodes;
+    std::vector<std::unique_ptr<EchoClient>> clients;
+
+    for (size_t ii = 0; ii < countClients; ++ii)
+    {
+        nodes.push_back(std::make_unique<su::Net::PacketNode>(Magic, SOCKET_ERROR, addr, -1, &log));
+        clients.push_back(std::make_unique<EchoClient>(*nodes.back(), &log));
+        clients.back()->connect("127.0.0.1", port);
+        clients.back()->run(1);
+    }
+
+    CHECK(waitFor([&server, countClients]() { return server.clientsCount() == countClients; }));
+
+    for (size_t ii = 0; ii < count; ++ii)
+    {
+        auto packet = makePacket(ii * 7 + 3);
+        CHECK(server.send(nullptr, su::Net::Bytes::take(std::move(packet))));
+    }
+
+    for (auto& client : clients)
+    {
+        auto received = [&client]() { std::lock_guard<std::mutex> lock(client->m_mutex); return client->m_received.size() >= count; };
+        CHECK(waitFor(received));
+    }
+
+    // nothing more is delivered
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    for (auto& client : clients)
+    {
+        std::lock_guard<std::mutex> lock(client->m_mutex);
+
+        CHECK(client->m_received.size() == count);
+        for (size_t ii = 0; ii < client->m_received.size() && ii < count; ++ii)
+        {
+            CHECK(client->m_received[ii] == makePacket(ii * 7 + 3));
+        }
+    }
+
+    for (auto& client : clients)
+    {
+        client->disconnect();
+    }
+    CHECK(waitFor([&server]() { return server.clientsCount() == 0; }));
+
+    for (auto& client : clients)
+    {
+        client->close();
+    }
+    server.close();
+}
+
+// The broadcast doesn't wait for the slow client even if its node doesn't share the frames
+void testBroadcastNoWait(su::Log& log)
+{
+    AdmissionServer server(0, &log);
+    server.setSendLimits(64 * 1024, 0, su::Net::Node::SendPolicy::Block);
+    CHECK(server.start() == su::Net::OK);
+    server.run(1);
+
+    // the client doesn't read
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(TcpPort);
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+
+    SOCKET socket = ::socket(AF_INET, SOCK_STREAM, 0);
+    int size = 4096;
+    setsockopt(socket, SOL_SOCKET, SO_RCVBUF, (char*)&size, sizeof(size));
+    CHECK(::connect(socket, (sockaddr*)&addr, sizeof(addr)) == 0);
+    CHECK(waitFor([&server]() { return server.clientsCount() == 1; }));
+
+    auto data = su::Net::Bytes::copy(std::vector<uint8_t>(16 * 1024, 'b').data(), 16 * 1024);
+    auto slowest = std::chrono::steady_clock::duration::zero();
+    bool isRefused = false;
+
+    for (size_t ii = 0; ii < 200 && slowest < std::chrono::milliseconds(500); ++ii)
+    {
+        auto start = std::chrono::steady_clock::now();
+        isRefused |= !server.send(nullptr, data);
+        slowest = std::max(slowest, std::chrono::steady_clock::now() - start);
+    }
+
+    // the full queue refuses the frame at once instead of the blocking for the timeout of the policy
+    CHECK(isRefused);
+    CHECK(slowest < std::chrono::milliseconds(500));
+
+    su::Net::closeSocket(socket);
+    server.close();
+}
+
+// The reactors sleep in the poller (or io_uring) until the events, they are woken by the sending and the commands
+void testReactorWait(su::Log& log, su::Net::TcpServer::IoEngine engine)
+{
+    const uint16_t port = WaitPort + static_cast<uint16_t>(engine);
+
+    EchoServer server(&log);
+    server.setIoEngine(engine);
+    server.setReactorCount(2);
+    CHECK(server.start("127.0.0.1", port) == su::Net::OK);
+    server.run(0);
+
+    // the idle reactors don't spin
+    auto cpu = std::clock();
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    CHECK(std::clock() - cpu < CLOCKS_PER_SEC / 20);
+
+    sockaddr_in addr = {};
+    su::Net::PacketNode packetNode(Magic, SOCKET_ERROR, addr, -1, &log);
+    EchoClient client(packetNode, &log);
+
+    client.connect("127.0.0.1", port);
+    client.run(1);
+    CHECK(waitFor([&server]() { return server.clientsCount() == 1; }));
+
+    // the sending of the other thread is written at once, not after the longest wait of the reactor
+    auto start = std::chrono::steady_clock::now();
+    const char* text = "wake";
+    CHECK(server.send(nullptr, text, strlen(text)));
+    CHECK(waitFor([&client]() { std::lock_guard<std::mutex> lock(client.m_mutex); return client.m_received.size() == 1; }));
+    CHECK(std::chrono::steady_clock::now() - start < std::chrono::milliseconds(500));
+
+    client.disconnect();
+    CHECK(waitFor([&server]() { return server.clientsCount() == 0; }));
+    client.close();
+
+    // the commands wake the waiting reactors
+    start = std::chrono::steady_clock::now();
+    server.close();
+    CHECK(std::chrono::steady_clock::now() - start < std::chrono::milliseconds(500));
+}
+
+// The client taken by clients() outlives the server, the sending to it doesn't call the server anymore
+void testDetachedClient(su::Log& log)
+{
+    std::shared_ptr<su::Net::Node> node;
+    sockaddr_in addr = {};
+
+    // the detached node doesn't count its data by the budget of the owner and doesn't call it back
+    {
+        su::Net::SendBudget budget;
+        int notified = 0;
+        su::Net::Node detached(SOCKET_ERROR, addr);
+
+        budget.m_limit = 1000;
+        detached.setSendBudget(&budget);
+        detached.setSendNotify([&notified](su::Net::Node*) { ++notified; });
+        CHECK(detached.send("data", 4) == 4);
+        CHECK(budget.m_used == 4 && notified == 1);
+
+        detached.detachOwner();
+        CHECK(budget.m_used == 0);
+        detached.clearSendQueue();
+        CHECK(detached.send("data", 4) == 4);
+        CHECK(budget.m_used == 0 && notified == 1);
+    }
+
+    {
+        EchoServer server(&log);
+        server.setSendBudget(1024 * 1024);
+        CHECK(server.start("127.0.0.1", DetachPort) == su::Net::OK);
+        server.run(1);
+
+        su::Net::PacketNode packetNode(Magic, SOCKET_ERROR, addr, -1, &log);
+        EchoClient client(packetNode, &log);
+
+        client.connect("127.0.0.1", DetachPort);
+        client.run(1);
+        CHECK(waitFor([&server]() { return server.clientsCount() == 1; }));
+
+        auto clients = server.clients();
+        CHECK(clients.size() == 1);
+        node = clients.size() ? clients[0] : nullptr;
+
+        // the deleted client is disconnected and refuses the data
+        client.disconnect();
+        CHECK(waitFor([&server]() { return server.clientsCount() == 0; }));
+        CHECK(node && !node->isConnected());
+        CHECK(node && node->send("x", 1) == 0);
+        CHECK(server.sendBudgetUsed() == 0);
+
+        client.close();
+        server.close();
+    }
+
+    CHECK(node && node->send("late", 4) == 0);
+    CHECK(node && node->sizeSendBuffer() == 0);
+}
+
+void testRecvSlab()
+{
+    su::Net::RecvSlab slab;
+    size_t size = 100;
+
+    // the block is reused when nobody keeps the data
+    uint8_t* first = slab.reserve(0, size);
+    memcpy(first, "kept", 4);
+    slab.commit(4);
+
+    size = 100;
+    CHECK(slab.reserve(0, size) == first);
+
+    // the kept data is not overwritten
+    memcpy(first, "kept", 4);
+    auto kept = slab.commit(4);
+
+    size = 100;
+    uint8_t* second = slab.reserve(0, size);
+    CHECK(second != first);
+    memset(second, 0, size);
+    CHECK(std::string(kept.begin(), kept.end()) == "kept");
+
+    // the rest of the block is used until it is full
+    size = su::Net::RecvSlab::BlockSize;
+    slab.reserve(su::Net::RecvSlab::BlockSize - 64, size);
+    slab.commit(size);
+
+    size = 100;
+    CHECK(slab.reserve(0, size) != first);
+    CHECK(std::string(kept.begin(), kept.end()) == "kept");
+
+    // the consumers keeping the views of many blocks don't pin more of them, the data is copied
+    std::vector<su::Net::Bytes> pinned;
+    for (size_t ii = 0; ii <= su::Net::RecvSlab::MaxPinnedBlocks; ++ii)
+    {
+        size = su::Net::RecvSlab::BlockSize;
+        memset(slab.reserve(su::Net::RecvSlab::BlockSize, size), int(ii), 1);
+        pinned.push_back(slab.commit(1));
+    }
+    CHECK(slab.isCopying());
+
+    size = 100;
+    uint8_t* current = slab.reserve(0, size);
+    memcpy(current, "copy", 4);
+    auto copied = slab.commit(4);
+    CHECK(copied.data() != current && std::string(copied.begin(), copied.end()) == "copy");
+    size = 100;
+    CHECK(slab.reserve(0, size) == current);
+
+    for (size_t ii = 0; ii < pinned.size(); ++ii)
+    {
+        CHECK(pinned[ii][0] == uint8_t(ii));
+    }
+
+    // the released blocks are forgotten, the views are handed out again
+    pinned.clear();
+    kept = su::Net::Bytes();
+    size = 100;
+    current = slab.reserve(0, size);
+    CHECK(!slab.isCopying());
+    CHECK(slab.commit(4).data() == current);
+}
+
+su::Net::RecvStatus deliver(su::Net::Node& from, su::Net::PacketNode& to)
+{
+    auto stream = takeStream(from);
+    sockaddr_in addr = {};
+    return to.recv(su::Net::Bytes::copy(stream.data(), stream.size()), addr);
+}
+
+void testChecksum(su::Log& log)
+{
+    using su::Net::Checksum;
+
+    // the hardware and the table CRC32C are the same
+    const char* check = "123456789";
+    CHECK(su::Net::crc32c(check, strlen(check)) == 0xe3069283);
+
+    su::Crc32 table(su::Polynomial::CRC32_C);
+    auto data = makePacket(3);
+    for (size_t offset = 0; offset < 9; ++offset)
+    {
+        for (size_t size = 0; size < 100; ++size)
+        {
+            CHECK(su::Net::crc32c(data.data() + offset, size) == table.get(data.data() + offset, size));
+        }
+    }
+
+    sockaddr_in addr = {};
+    su::Net::PacketNode first(Magic, SOCKET_ERROR, addr, -1, &log);
+    su::Net::PacketNode second(Magic, SOCKET_ERROR, addr, -1, &log);
+    auto packet = makePacket(10);
+
+    // Crc32 is used until the peer reports that it accepts CRC32C
+    CHECK(first.sendChecksum() == Checksum::Crc32);
+    first.send(packet.data(), packet.size());
+    CHECK(deliver(first, second) == su::Net::Complited);
+    CHECK(second.sendChecksum() == Checksum::Crc32C);
+
+    second.send(packet.data(), packet.size());
+    CHECK(deliver(second, first) == su::Net::Complited);
+    CHECK(first.sendChecksum() == Checksum::Crc32C);
+    CHECK(first.extractRecvPacket().raw.toVector() == packet);
+
+    // the packet of the old peer: zero flags and CRC32 IEEE
+    struct
+    {
+        uint32_t m_magic = Magic;
+        uint16_t m_version = 0x0100;
+        uint16_t m_flags = 0;
+        uint32_t m_reserved = 0;
+        uint32_t m_size = 0;
+        uint32_t m_dataHash = 0;
+        uint32_t m_hash = 0;
+    } legacy;
+
+    su::Crc32 ieee(su::Polynomial::CRC32_IEEE);
+    legacy.m_size = static_cast<uint32_t>(packet.size());
+    legacy.m_dataHash = ieee.get(packet.data(), packet.size());
+    legacy.m_hash = ieee.get(&legacy, sizeof(legacy) - sizeof(legacy.m_hash));
+
+    su::Net::Node old(SOCKET_ERROR, addr);
+    old.send(&legacy, sizeof(legacy));
+    old.send(packet.data(), packet.size());
+    CHECK(deliver(old, first) == su::Net::Complited);
+    CHECK(first.sendChecksum() == Checksum::Crc32);
+    CHECK(first.extractRecvPacket().raw.toVector() == packet);
+
+    // the payload isn't checked if both sides trust the link
+    su::Net::PacketNode trusted(Magic, SOCKET_ERROR, addr, -1, &log);
+    trusted.setChecksum(Checksum::None);
+    second.setChecksum(Checksum::None);
+
+    trusted.send(packet.data(), packet.size());
+    CHECK(deliver(trusted, second) == su::Net::Complited);
+    second.send(packet.data(), packet.size());
+    CHECK(deliver(second, trusted) == su::Net::Complited);
+    CHECK(trusted.sendChecksum() == Checksum::None);
+
+    // the packet without checksum is refused by the node which doesn't trust the link
+    su::Net::PacketNode strict(Magic, SOCKET_ERROR, addr, -1, &log);
+    trusted.send(packet.data(), packet.size());
+    CHECK(deliver(trusted, strict) == su::Net::Fault);
+}
+
+bool lzRoundTrip(const std::vector<uint8_t>& data, size_t* compressedSize = nullptr)
+{
+    std::vector<uint8_t> compressed(su::Net::lzCompressBound(data.size()));
+    std::vector<uint8_t> out(data.size());
+
+    size_t size = su::Net::lzCompress(data.data(), data.size(), compressed.data(), compressed.size());
+    if (compressedSize)
+    {
+        *compressedSize = size;
+    }
+
+    return size && su::Net::lzDecompress(compressed.data(), size, out.data(), out.size()) && out == data;
+}
+
+void testCompression(su::Log& log)
+{
+    size_t size = 0;
+
+    for (size_t ii = 0; ii < 40; ++ii)
+    {
+        CHECK(lzRoundTrip(makePacket(ii)));
+        CHECK(lzRoundTrip(makeText(ii, ii)));
+    }
+
+    CHECK(lzRoundTrip(makeText(1, 100000), &size));
+    CHECK(size < 100000 / 4);
+    CHECK(lzRoundTrip(std::vector<uint8_t>(70000, 'x'), &size));
+    CHECK(size < 1000);
+
+    // the broken data and the wrong size are detected
+    auto text = makeText(2, 5000);
+    std::vector<uint8_t> compressed(su::Net::lzCompressBound(text.size()));
+    size = su::Net::lzCompress(text.data(), text.size(), compressed.data(), compressed.size());
+    std::vector<uint8_t> out(text.size() + 1);
+    CHECK(!su::Net::lzDecompress(compressed.data(), size, out.data(), text.size() + 1));
+    CHECK(!su::Net::lzDecompress(compressed.data(), size / 2, out.data(), text.size()));
+    CHECK(su::Net::lzCompress(text.data(), text.size(), compressed.data(), size / 2) == 0);
+
+    sockaddr_in addr = {};
+    su::Net::PacketNode first(Magic, SOCKET_ERROR, addr, -1, &log);
+    su::Net::PacketNode second(Magic, SOCKET_ERROR, addr, -1, &log);
+    first.setCompression(64);
+    second.setCompression(64);
+
+    // the packets aren't compressed until the peer reports that it accepts the compression
+    first.send(text.data(), text.size());
+    CHECK(first.sizeSendBuffer() > text.size());
+    CHECK(deliver(first, second) == su::Net::Complited);
+    CHECK(second.extractRecvPacket().raw.toVector() == text);
+    CHECK(second.isCompressing());
+
+    second.send(text.data(), text.size());
+    CHECK(second.sizeSendBuffer() < text.size() / 2);
+    CHECK(deliver(second, first) == su::Net::Complited);
+    CHECK(first.extractRecvPacket().raw.toVector() == text);
+
+    // the random data and the small packets are sent as is
+    auto noise = makePacket(5);
+    for (auto& byte : noise)
+    {
+        byte = static_cast<uint8_t>(rand());
+    }
+    second.send(noise.data(), noise.size());
+    auto small = makeText(3, 32);
+    second.send(small.data(), small.size());
+    CHECK(second.sizeSendBuffer() > noise.size() + small.size());
+    CHECK(deliver(second, first) == su::Net::Complited);
+    CHECK(first.extractRecvPacket().raw.toVector() == noise);
+    CHECK(first.extractRecvPacket().raw.toVector() == small);
+
+    // the node which hasn't enabled the compression refuses the compressed packet
+    su::Net::PacketNode plain(Magic, SOCKET_ERROR, addr, -1, &log);
+    second.send(text.data(), text.size());
+    CHECK(deliver(second, plain) == su::Net::Fault);
+
+    // the pool compresses and decompresses the packets keeping their order
+    su::ThreadPool pool(2);
+    first.setCompressionPool(&pool);
+    second.setCompressionPool(&pool);
+
+    const size_t count = 20;
+    for (size_t ii = 0; ii < count; ++ii)
+    {
+        auto packet = ii % 3 ? makeText(ii, 1000 + ii * 100) : makeText(ii, 10);
+        first.send(su::Net::Bytes::take(std::move(packet)));
+    }
+    pool.wait_all();
+
+    // the receiving thread isn't blocked, the packets are taken by pollRecv() after the notification
+    std::atomic<size_t> notified = 0;
+    second.setRecvNotify([&notified](su::Net::Node*) { ++notified; });
+
+    auto stream = takeStream(first);
+    size_t half = stream.size() / 2;
+    second.recv(su::Net::Bytes::copy(stream.data(), half), addr);
+    second.recv(su::Net::Bytes::copy(stream.data() + half, stream.size() - half), addr);
+    CHECK(waitFor([&]() { second.pollRecv(); return second.countRecvPackets() == count; }, 2000));
+    CHECK(notified.load() >= 1);
+    for (size_t ii = 0; second.countRecvPackets(); ++ii)
+    {
+        auto expected = ii % 3 ? makeText(ii, 1000 + ii * 100) : makeText(ii, 10);
+        CHECK(second.extractRecvPacket().raw.toVector() == expected);
+    }
+    second.setRecvNotify(nullptr);
+
+    // the decompressed size over the maximum packet size breaks the stream before the allocation
+    second.setMaxPacketSize(text.size() - 1);
+    first.send(text.data(), text.size());
+    pool.wait_all();
+    CHECK(deliver(first, second) == su::Net::Fault);
+
+    // the packets waiting for the pool are counted by the water marks and the budget
+    su::ThreadPool busy(1);
+    std::atomic<bool> isReleased = false;
+    busy.add_task([&isReleased]() { while (!isReleased) std::this_thread::sleep_for(std::chrono::milliseconds(1)); });
+
+    su::Net::SendBudget budget;
+    budget.m_limit = 1024 * 1024;
+    first.setCompressionPool(&busy);
+    first.setSendBudget(&budget);
+    first.setWaterMarks(text.size() + 1000, 0, su::Net::Node::SendPolicy::Drop);
+
+    size_t dropped = first.countDroppedSends();
+    CHECK(first.send(su::Net::Bytes::copy(text.data(), text.size())) == text.size());
+    CHECK(first.sizeSendBuffer() == text.size() && budget.m_used == text.size());
+    CHECK(first.countSendPackets() == 0);
+    CHECK(first.send(su::Net::Bytes::copy(text.data(), text.size())) == 0);
+    CHECK(first.countDroppedSends() == dropped + 1);
+
+    // the compressed packet replaces its reservation
+    isReleased = true;
+    busy.wait_all();
+    CHECK(first.sizeSendBuffer() > 0 && first.sizeSendBuffer() < text.size() / 2);
+    CHECK(budget.m_used == first.sizeSendBuffer());
+    takeStream(first);
+    CHECK(budget.m_used == 0);
+}
+
+// The reactor and the client take the packets decompressed by the pool without waiting for it
+void testCompressedEcho(su::Log& log, su::Net::TcpServer::IoEngine engine)
+{
+    const size_t count = 100;
+    su::ThreadPool pool(2);
+
+    EchoServer server(&log);
+    server.setIoEngine(engine);
+    server.setCompression(64, &pool);
+    CHECK(server.start() == su::Net::OK);
+    server.run(1);
+
+    sockaddr_in addr = {};
+    su::Net::PacketNode node(Magic, SOCKET_ERROR, addr, -1, &log);
+    node.setCompression(64);
+    node.setCompressionPool(&pool);
+    EchoClient client(node, &log);
+
+    client.connect("127.0.0.1", TcpPort);
+    client.run(1);
+
+    CHECK(waitFor([&client]() { return client.isConnected(); }));
+    CHECK(waitFor([&server]() { return server.clientsCount() == 1; }));
+
+    for (size_t ii = 0; ii < count; ++ii)
+    {
+        auto packet = makeText(ii, 100 + ii * 50);
+        client.send(packet.data(), packet.size());
+    }
+
+    CHECK(waitFor([&client]() { std::lock_guard<std::mutex> lock(client.m_mutex); return client.m_received.size() == count; }));
+
+    {
+        std::lock_guard<std::mutex> lock(client.m_mutex);
+
+        for (size_t ii = 0; ii < client.m_received.size(); ++ii)
+        {
+            CHECK(client.m_received[ii] == makeText(ii, 100 + ii * 50));
+        }
+    }
+
+    client.disconnect();
+    CHECK(waitFor([&server]() { return server.clientsCount() == 0; }));
+
+    client.close();
+    server.close();
+}
+
+void testReassembly(su::Log& log)
+{
+    const size_t count = 50;
+    sockaddr_in addr = {};
+    su::Net::PacketNode sender(Magic, SOCKET_ERROR, addr, -1, &log);
+
+    for (size_t ii = 0; ii < count; ++ii)
+    {
+        auto packet = makePacket(ii % 5 ? ii % 7 : ii * 100);
+
+        if (ii % 2)
+        {
+            sender.send(packet.data(), packet.size());
+        }
+        else
+        {
+            sender.send(su::Net::Bytes::take(std::move(packet)));
+        }
+    }
+
+    auto stream = takeStream(sender);
+
+    // the stream is received by the chunks of the different sizes, the headers and payloads are split
+    for (size_t chunk : { size_t(1), size_t(7), size_t(1000), stream.size() })
+    {
+        su::Net::PacketNode receiver(Magic, SOCKET_ERROR, addr, -1, &log);
+        auto data = su::Net::Bytes::copy(stream.data(), stream.size());
+
+        // the second round reuses the released payload buffers of the first one
+        for (int round = 0; round < 2; ++round)
+        {
+            for (size_t pos = 0; pos < stream.size(); pos += chunk)
+            {
+                CHECK(receiver.recv(data.slice(pos, chunk), addr) != su::Net::Fault);
+            }
+
+            CHECK(receiver.countRecvPackets() == count);
+
+            // the first packet is extracted alone, the rest are drained, all in the order of sending
+            size_t index = 0;
+            auto checkPacket = [&index](su::Net::RawData& packet)
+            {
+                auto expected = makePacket(index % 5 ? index % 7 : index * 100);
+                CHECK(expected.size() == packet.raw.size() &&
+                      std::equal(expected.begin(), expected.end(), packet.raw.begin()));
+                ++index;
+            };
+
+            auto first = receiver.extractRecvPacket();
+            checkPacket(first);
+            CHECK(receiver.drainRecvPackets(checkPacket) == count - 1);
+            CHECK(index == count && !receiver.countRecvPackets());
+        }
+    }
+}
+
+void testUdp(su::Log& log)
+{
+    su::Net::UdpNode node(-1, &log);
+    su::Net::UdpServer server(node, "127.0.0.1", UdpPort, &log);
+
+    CHECK(server.start(false) == su::Net::OK);
+    server.run(1);
+
+    const std::string text = "loopback datagram ";
+    for (int ii = 0; ii < 10; ++ii)
+    {
+        auto datagram = text + std::to_string(ii);
+        CHECK(su::Net::updSend("127.0.0.1", UdpPort, (void*)datagram.data(), datagram.size(), su::Net::None) ==
+              (int)datagram.size());
+    }
+
+    // the node is processed by the server thread, so check it after finishing
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    server.close();
+
+    // the datagrams are extracted in the order of receiving
+    CHECK(node.countOfPackets() == 10);
+    for (int ii = 0; node.countOfPackets(); ++ii)
+    {
+        auto packet = node.extractPacket();
+        CHECK(std::string(packet.raw.begin(), packet.raw.end()) == text + std::to_string(ii));
+    }
+}
+
+class BatchServer : public su::Net::UdpServer
+{
+public:
+    BatchServer(su::Net::Node& node, su::Log* plog) : su::Net::UdpServer(node, "127.0.0.1", UdpPort, plog) {}
+
+    std::mutex m_mutex;
+    std::vector<std::string> m_received;
+    size_t m_countOfTruncated = 0;
+    size_t m_maxBatch = 0;
+
+protected:
+    virtual bool onRecvBatch(const su::Net::Datagram* datagrams, size_t count) override
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        for (size_t ii = 0; ii < count; ++ii)
+        {
+            m_received.emplace_back((const char*)datagrams[ii].m_data, datagrams[ii].m_size);
+            m_countOfTruncated += datagrams[ii].m_isTruncated;
+        }
+        m_maxBatch = std::max(m_maxBatch, count);
+        return true;
+    }
+};
+
+void testUdpBatch(su::Log& log)
+{
+    const size_t count = 500;
+
+    su::Net::UdpNode node(-1, &log);
+    BatchServer server(node, &log);
+
+    server.setRecvBatch(32, 256);
+    CHECK(server.start(false) == su::Net::OK);
+    CHECK(server.setRecvBufferSize(1024 * 1024) > 0);
+
+    // the datagrams are queued before the server reads them, so they are received by the batches
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(UdpPort);
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+
+    SOCKET socket = ::socket(AF_INET, SOCK_DGRAM, 0);
+    su::Net::SendBatch batch(64, 512);
+    size_t sent = 0;
+
+    for (size_t ii = 0; ii < count; ++ii)
+    {
+        auto text = "datagram " + std::to_string(ii);
+        if (!batch.add(addr, text.data(), text.size()))
+        {
+            sent += batch.send(socket);
+            CHECK(batch.add(addr, text.data(), text.size()));
+        }
+    }
+    sent += batch.send(socket);
+    CHECK(sent == count && batch.empty());
+
+    // the slot is smaller than the datagram
+    std::string big(400, 'b');
+    CHECK(batch.add(addr, big.data(), big.size()));
+    CHECK(!batch.add(addr, std::string(600, 'c').data(), 600));
+    CHECK(batch.send(socket) == 1);
+
+    server.run(1);
+    CHECK(waitFor([&server, count]() { std::lock_guard<std::mutex> lock(server.m_mutex); return server.m_received.size() == count + 1; }));
+    server.close();
+
+    for (size_t ii = 0; ii < count; ++ii)
+    {
+        CHECK(server.m_received[ii] == "datagram " + std::to_string(ii));
+    }
+    CHECK(server.m_received.back() == std::string(256, 'b'));
+    CHECK(server.m_countOfTruncated == 1);
+    CHECK(server.m_maxBatch == 32);
+    CHECK(node.countOfPackets() == 0);
+
+    su::Net::closeSocket(socket);
+}
+
+void testUdpOffload(su::Log& log)
+{
+    auto makeDatagram = [](size_t idx, size_t size)
+    {
+        std::string text(size, 'a' + idx % 26);
+        memcpy(text.data(), &idx, sizeof(idx));
+        return text;
+    };
+
+    su::Net::UdpNode node(-1, &log);
+    BatchServer server(node, &log);
+
+    server.setRecvBatch(8, 2048, true);
+    CHECK(server.start(false) == su::Net::OK);
+    server.setRecvBufferSize(4 * 1024 * 1024);
+
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(UdpPort);
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+
+    // the runs of the equal datagrams are segmented by the kernel, the last one of the run is shorter
+    SOCKET socket = ::socket(AF_INET, SOCK_DGRAM, 0);
+    su::Net::SendBatch batch(256, 1200);
+    std::vector<std::string> expected;
+
+    CHECK(batch.setGso(true));
+    for (size_t ii = 0; ii < 200; ++ii)
+    {
+        expected.push_back(makeDatagram(ii, ii == 150 ? 300 : 1000));
+        CHECK(batch.add(addr, expected.back().data(), expected.back().size()));
+    }
+    CHECK(batch.send(socket) == 200);
+    CHECK(batch.isGso() && batch.countOfErrors() == 0);
+
+    // the buffer is split into the datagrams by updSend()
+    std::string data;
+    for (size_t ii = 0; ii < 10; ++ii)
+    {
+        expected.push_back(makeDatagram(200 + ii, ii == 9 ? 37 : 100));
+        data += expected.back();
+    }
+    CHECK(su::Net::updSend("127.0.0.1", UdpPort, data.data(), data.size(), su::Net::None, 100) == (int)data.size());
+
+    server.run(1);
+    CHECK(waitFor([&server, &expected]() { std::lock_guard<std::mutex> lock(server.m_mutex); return server.m_received.size() >= expected.size(); }));
+    server.close();
+
+    CHECK(server.m_received == expected);
+    CHECK(server.m_countOfTruncated == 0);
+
+    // the refused peer doesn't turn the segmentation off, only the failed datagram is dropped
+    addr.sin_port = htons(RefusedPort);
+    CHECK(::connect(socket, (const sockaddr*)&addr, sizeof(addr)) == 0);
+    CHECK(::send(socket, "x", 1, 0) == 1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    batch.clear();
+    for (size_t ii = 0; ii < 4; ++ii)
+    {
+        CHECK(batch.add("refused", 7));
+    }
+    CHECK(batch.send(socket) == 3);
+    CHECK(batch.isGso() && batch.countOfErrors() == 1 && batch.lastError() == ECONNREFUSED);
+    su::Net::closeSocket(socket);
+
+    // the run rejected by EINVAL (the segmentation without the checksum) is sent one by one,
+    // the segmentation stays on for the next runs
+    socket = ::socket(AF_INET, SOCK_DGRAM, 0);
+    int noCheck = 1;
+    CHECK(setsockopt(socket, SOL_SOCKET, SO_NO_CHECK, &noCheck, sizeof(noCheck)) == 0);
+    addr.sin_port = htons(UdpPort);
+
+    for (size_t round = 0; round < 2; ++round)
+    {
+        batch.clear();
+        for (size_t ii = 0; ii < 4; ++ii)
+        {
+            CHECK(batch.add(addr, "rejected", 8));
+        }
+        CHECK(batch.send(socket) == 4);
+        CHECK(batch.isGso() && batch.countOfErrors() == 1);
+    }
+    su::Net::closeSocket(socket);
+}
+
+void testUdpSender(su::Log& log)
+{
+    su::Net::UdpNode node(-1, &log);
+    BatchServer server(node, &log);
+
+    server.setRecvBatch(16, 256);
+    CHECK(server.start(false) == su::Net::OK);
+
+    // the options are set once, before the socket is used
+    su::Net::UdpSender sender(&log);
+    CHECK(!sender.isOpen());
+    CHECK(sender.setMulticastTtl(4));
+    CHECK(sender.setMulticastLoopback(false));
+    CHECK(sender.setMulticastInterface("127.0.0.1"));
+    CHECK(!sender.setMulticastInterface("bad address"));
+    CHECK(sender.isOpen());
+    CHECK(sender.setBroadcast(true));
+    CHECK(sender.setBroadcast(true));
+
+    // the names are resolved once
+    sockaddr_in addr;
+    CHECK(sender.resolve("localhost", UdpPort, addr) && addr.sin_addr.s_addr == htonl(INADDR_LOOPBACK));
+    CHECK(!sender.resolve("unknown.host.invalid", UdpPort, addr));
+    sender.setCacheTtl(std::chrono::seconds(1));
+    CHECK(sender.resolve("localhost", UdpPort, addr) && addr.sin_addr.s_addr == htonl(INADDR_LOOPBACK));
+
+    std::vector<std::string> expected;
+    auto sendText = [&expected](const std::function<int(const std::string&)>& func)
+    {
+        expected.push_back("sender " + std::to_string(expected.size()));
+        CHECK(func(expected.back()) == (int)expected.back().size());
+    };
+
+    CHECK(sender.send("x", 1) == -1);
+    sendText([&sender](const std::string& text) { return sender.sendTo("127.0.0.1", UdpPort, text.data(), text.size()); });
+    sendText([&sender](const std::string& text) { return sender.sendTo("localhost", UdpPort, text.data(), text.size()); });
+    sendText([&sender, &addr](const std::string& text) { return sender.sendTo(addr, text.data(), text.size()); });
+
+    CHECK(sender.connect("localhost", UdpPort) == su::Net::OK && sender.isConnected());
+    sendText([&sender](const std::string& text) { return sender.send(text.data(), text.size()); });
+
+    // the full batch is sent by queuing the next datagram, the rest by flush()
+    sender.setBatch(4, 64);
+    for (size_t ii = 0; ii < 6; ++ii)
+    {
+        expected.push_back("sender " + std::to_string(expected.size()));
+        CHECK(ii % 2 ? sender.queue(expected.back().data(), expected.back().size())
+                     : sender.queue("127.0.0.1", UdpPort, expected.back().data(), expected.back().size()));
+    }
+    CHECK(!sender.queue(std::string(100, 'q').data(), 100));
+    CHECK(sender.flush() == 2);
+
+    server.run(1);
+    CHECK(waitFor([&server, &expected]() { std::lock_guard<std::mutex> lock(server.m_mutex); return server.m_received.size() >= expected.size(); }));
+    server.close();
+    sender.close();
+
+    CHECK(server.m_received == expected);
+    CHECK(!sender.isOpen() && !sender.isConnected());
+}
+
+} // namespace
+
+int main()
+{
+    su::Log log("loopback", "test_net_loopback", "./", su::Log::Level::Warning);
+    log.setFile(false);
+
+    su::Net::initWinSock2();
+
+    testRecvSlab();
+    testChecksum(log);
+    testCompression(log);
+    testReassembly(log);
+    testCompressedEcho(log, su::Net::TcpServer::IoEngine::Poller);
+    testCompressedEcho(log, su::Net::TcpServer::IoEngine::Uring);
+    testTcpEcho(log, su::Net::TcpServer::IoEngine::Poller);
+    // falls back to the poller if io_uring is not available
+    testTcpEcho(log, su::Net::TcpServer::IoEngine::Uring);
+    testCoalescing(log, su::Net::TcpServer::IoEngine::Poller);
+    testCoalescing(log, su::Net::TcpServer::IoEngine::Uring);
+    testBackpressure();
+    testSlowReader(log, su::Net::TcpServer::IoEngine::Poller);
+    testSlowReader(log, su::Net::TcpServer::IoEngine::Uring);
+    testTimingWheel();
+    testIdleTimeouts(log, su::Net::TcpServer::IoEngine::Poller);
+    testIdleTimeouts(log, su::Net::TcpServer::IoEngine::Uring);
+    testAcl(log);
+    testAdmission(log, su::Net::TcpServer::IoEngine::Poller);
+    testAdmission(log, su::Net::TcpServer::IoEngine::Uring);
+    testMultiReactor(log, su::Net::TcpServer::IoEngine::Poller);
+    testMultiReactor(log, su::Net::TcpServer::IoEngine::Uring);
+    testBroadcast(log, su::Net::TcpServer::IoEngine::Poller);
+    testBroadcast(log, su::Net::TcpServer::IoEngine::Uring);
+    testBroadcastNoWait(log);
+    testReactorWait(log, su::Net::TcpServer::IoEngine::Poller);
+    testReactorWait(log, su::Net::TcpServer::IoEngine::Uring);
+    testDetachedClient(log);
+    testUdp(log);
+    testUdpBatch(log);
+    testUdpOffload(log);
+    testUdpSender(log);
+
+    printf(g_failed ? "%i check(s) failed\n" : "All checks passed\n", g_failed);
+    return g_failed ? 1 : 0;
+}
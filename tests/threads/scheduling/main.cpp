@@ -0,0 +1,345 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "cotask.h"
+#include "thread_class.h"
+#include "thread_executor.h"
+#include "threadpool.h"
+#include "net/awaitable.h"
+
+namespace
+{
+
+int g_failed = 0;
+
+#define CHECK(exp) { if (!(exp)) { printf("FAILED %s:%i: %s\n", __FILE__, __LINE__, #exp); ++g_failed; } }
+
+using Clock = std::chrono::steady_clock;
+
+bool waitFor(const std::function<bool()>& cond, size_t msec = 5000)
+{
+    auto deadline = Clock::now() + std::chrono::milliseconds(msec);
+
+    while (!cond())
+    {
+        if (Clock::now() > deadline)
+        {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+su::CoTask scheduleTask(su::ThreadPool& pool, std::thread::id caller, std::atomic<int>& result)
+{
+    co_await pool.schedule();
+    result = std::this_thread::get_id() != caller ? 1 : -1;
+}
+
+su::CoTask sleepTask(su::ThreadPool& pool, std::chrono::milliseconds delay, std::atomic<int64_t>& elapsedMs)
+{
+    auto start = Clock::now();
+
+    co_await pool.sleep_for(delay);
+    elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count();
+}
+
+su::CoTask readTask(su::ThreadPool& pool, SOCKET socket, std::chrono::milliseconds timeout, std::atomic<int>& result)
+{
+    result = co_await su::Net::readable(pool, socket, timeout) ? 1 : 0;
+}
+
+su::CoTask writeTask(su::ThreadPool& pool, SOCKET socket, std::atomic<int>& result)
+{
+    result = co_await su::Net::writable(pool, socket) ? 1 : 0;
+}
+
+// Counts the calls of doWork(), the work may take some time
+class Counter : public su::ThreadClass
+{
+public:
+    explicit Counter(std::chrono::milliseconds work = std::chrono::milliseconds(0)) : m_work(work) {}
+    ~Counter() { close(); }
+
+    std::atomic<int> m_count = 0;
+    std::atomic<bool> m_isFinished = false;
+
+protected:
+    virtual void doWork() override
+    {
+        ++m_count;
+        if (m_work.count())
+        {
+            std::this_thread::sleep_for(m_work);
+        }
+    }
+
+    virtual void doFinished() override { m_isFinished = true; }
+
+private:
+    std::chrono::milliseconds m_work;
+};
+
+// The UDP socket sending to itself
+SOCKET openLoopSocket()
+{
+    sockaddr_in addr = {};
+    socklen_t size = sizeof(addr);
+
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    SOCKET socket = ::socket(AF_INET, SOCK_DGRAM, 0);
+    CHECK(::bind(socket, (sockaddr*)&addr, sizeof(addr)) == 0);
+    CHECK(::getsockname(socket, (sockaddr*)&addr, &size) == 0);
+    CHECK(::connect(socket, (sockaddr*)&addr, sizeof(addr)) == 0);
+    return socket;
+}
+
+void testCoroutines()
+{
+    su::ThreadPool pool(2);
+
+    std::atomic<int> scheduled = 0;
+    scheduleTask(pool, std::this_thread::get_id(), scheduled);
+    CHECK(waitFor([&scheduled]() { return scheduled != 0; }));
+    CHECK(scheduled == 1);
+
+    std::atomic<int64_t> elapsed = -1;
+    sleepTask(pool, std::chrono::milliseconds(30), elapsed);
+    CHECK(waitFor([&elapsed]() { return elapsed >= 0; }));
+    CHECK(elapsed >= 30);
+
+    // the readiness is reported by the reactor, the empty socket times out
+    SOCKET socket = openLoopSocket();
+    std::atomic<int> timedOut = -1;
+    std::atomic<int> received = -1;
+    std::atomic<int> writable = -1;
+
+    readTask(pool, socket, std::chrono::milliseconds(50), timedOut);
+    CHECK(waitFor([&timedOut]() { return timedOut >= 0; }));
+    CHECK(timedOut == 0);
+
+    readTask(pool, socket, std::chrono::milliseconds(5000), received);
+    writeTask(pool, socket, writable);
+    CHECK(waitFor([&writable]() { return writable >= 0; }));
+    CHECK(writable == 1);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    CHECK(received == -1);
+    CHECK(::send(socket, "x", 1, 0) == 1);
+    CHECK(waitFor([&received]() { return received >= 0; }));
+    CHECK(received == 1);
+
+    // the resumptions aren't tracked as the tasks
+    pool.wait_all();
+    CHECK(!pool.isTaskFinished(0));
+
+    su::Net::closeSocket(socket);
+}
+
+void testTaskGroups()
+{
+    su::ThreadPool pool(2);
+
+    // every callable of the range is the own task, the group is finished when all of them are done
+    std::atomic<int> sum = 0;
+    std::vector<std::function<void()>> tasks;
+    for (int ii = 1; ii <= 10; ++ii)
+    {
+        tasks.push_back([&sum, ii]() { std::this_thread::sleep_for(std::chrono::milliseconds(1)); sum += ii; });
+    }
+
+    auto group = pool.add_tasks(tasks);
+    CHECK(group.size() == tasks.size());
+    pool.wait(group);
+    CHECK(group.isFinished());
+    CHECK(sum == 55);
+    for (size_t ii = 0; ii < group.size(); ++ii)
+    {
+        CHECK(pool.isTaskFinished(group.firstTask() + ii));
+    }
+
+    // the bulk tasks get their indexes, the ids follow the previous group
+    std::vector<std::atomic<int>> hits(100);
+    auto bulk = pool.submit_bulk(hits.size(), [&hits](size_t index) { ++hits[index]; });
+    CHECK(bulk.firstTask() == group.firstTask() + group.size());
+    pool.wait(bulk);
+    CHECK(bulk.isFinished());
+    for (auto& hit : hits)
+    {
+        CHECK(hit == 1);
+    }
+
+    // the empty group is finished at once
+    auto empty = pool.submit_bulk(0, [](size_t) {});
+    CHECK(empty.size() == 0 && empty.isFinished());
+    pool.wait(empty);
+    CHECK(su::ThreadPool::TaskGroup().isFinished());
+}
+
+void testStats()
+{
+    su::ThreadPool pool(2);
+    const size_t count = 20;
+
+    for (size_t ii = 0; ii < count; ++ii)
+    {
+        pool.add_task([]() { std::this_thread::sleep_for(std::chrono::milliseconds(1)); });
+    }
+    pool.wait_all();
+
+    auto stats = pool.getStats();
+    CHECK(stats.m_tasksSubmitted == count);
+    CHECK(stats.m_tasksExecuted == count);
+    CHECK(stats.m_runTime.m_count == count && stats.m_queueWait.m_count == count);
+    CHECK(stats.m_runTime.m_maxNs >= 1000000);
+    CHECK(stats.m_runTime.percentile(50.0) >= 1000000);
+    CHECK(stats.m_workers.size() == 2);
+    CHECK(stats.m_workers[0].m_tasksExecuted + stats.m_workers[1].m_tasksExecuted == count);
+
+    // the untracked tasks are counted too
+    std::atomic<bool> isPosted = false;
+    pool.post([&isPosted]() { isPosted = true; });
+    CHECK(waitFor([&pool]() { return pool.getStats().m_tasksExecuted == count + 1; }));
+    CHECK(isPosted);
+    CHECK(pool.getStats().m_tasksSubmitted == count + 1);
+    CHECK(pool.dumpStats().find("submitted 21, executed 21") != std::string::npos);
+}
+
+void testThreadClass()
+{
+    Counter counter;
+
+    // notify() doesn't wait for the rest of the delay
+    counter.run(10000);
+    auto start = Clock::now();
+    counter.notify();
+    CHECK(waitFor([&counter]() { return counter.m_count >= 1; }, 2000));
+    CHECK(Clock::now() - start < std::chrono::milliseconds(2000));
+
+    // the paused thread doesn't work and ignores notify()
+    counter.pause();
+    CHECK(waitFor([&counter]() { return counter.isPaused(); }));
+    int count = counter.m_count;
+    counter.notify();
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    CHECK(counter.m_count == count);
+    CHECK(counter.isWork());
+
+    counter.restore();
+    CHECK(waitFor([&counter]() { return counter.status() == su::ThreadClass::Status::Running; }));
+    counter.notify();
+    CHECK(waitFor([&counter, count]() { return counter.m_count > count; }, 2000));
+
+    counter.finish();
+    CHECK(waitFor([&counter]() { return counter.status() == su::ThreadClass::Status::Finished; }));
+    CHECK(counter.m_isFinished);
+    CHECK(!counter.isWork());
+
+    counter.close();
+    CHECK(counter.status() == su::ThreadClass::Status::Closed);
+}
+
+void testThreadExecutor()
+{
+    su::ThreadExecutor executor(2);
+
+    // every object is called at its own period by the shared threads
+    Counter fast;
+    Counter slow;
+    Counter idle;
+
+    fast.run(10, executor);
+    slow.run(200, executor);
+    idle.run(10000, executor);
+    CHECK(executor.countOfObjects() == 3);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    int fastCount = fast.m_count;
+    int slowCount = slow.m_count;
+    CHECK(fastCount >= 10);
+    CHECK(slowCount >= 1 && slowCount <= 3);
+    CHECK(idle.m_count == 0);
+
+    // notify() moves the deadline to now
+    auto start = Clock::now();
+    idle.notify();
+    CHECK(waitFor([&idle]() { return idle.m_count == 1; }, 2000));
+    CHECK(Clock::now() - start < std::chrono::milliseconds(2000));
+
+    // the paused object isn't called until it is restored
+    fast.pause();
+    CHECK(waitFor([&fast]() { return fast.isPaused(); }));
+    fastCount = fast.m_count;
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    CHECK(fast.m_count == fastCount);
+    fast.restore();
+    CHECK(waitFor([&fast, fastCount]() { return fast.m_count > fastCount; }));
+
+    // the finished objects are unregistered
+    fast.close();
+    slow.close();
+    idle.close();
+    CHECK(fast.m_isFinished && slow.m_isFinished && idle.m_isFinished);
+    CHECK(executor.countOfObjects() == 0);
+}
+
+void testPeriodic()
+{
+    // the long period doesn't delay the commands and notify()
+    Counter counter;
+
+    counter.runPeriodic(std::chrono::seconds(5));
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    CHECK(counter.m_count == 0);
+
+    counter.notify();
+    CHECK(waitFor([&counter]() { return counter.m_count == 1; }, 2000));
+
+    auto start = Clock::now();
+    counter.close();
+    CHECK(Clock::now() - start < std::chrono::milliseconds(2000));
+    CHECK(counter.m_isFinished);
+    CHECK(counter.periodicStats().m_cycles == 0);
+}
+
+// doWork() longer than the period skips the missed cycles, they are counted as the overruns
+void testPeriodicOverruns()
+{
+    Counter counter(std::chrono::milliseconds(25));
+
+    counter.runPeriodic(std::chrono::milliseconds(10));
+    CHECK(waitFor([&counter]() { return counter.m_count >= 5; }));
+    counter.close();
+
+    auto stats = counter.periodicStats();
+    CHECK(stats.m_overruns >= uint64_t(counter.m_count.load()));
+    CHECK(stats.m_cycles + 1 == uint64_t(counter.m_count.load()));
+    // the phase is kept: the next start is on the boundary of the period after the end of doWork()
+    CHECK(stats.m_minUs >= 25000);
+    CHECK(stats.m_maxUs >= stats.m_avgUs && stats.m_avgUs >= stats.m_minUs);
+    CHECK(stats.m_p99Us >= stats.m_minUs);
+}
+
+} // namespace
+
+int main()
+{
+    testCoroutines();
+    testTaskGroups();
+    testStats();
+    testThreadClass();
+    testThreadExecutor();
+    testPeriodic();
+    testPeriodicOverruns();
+
+    printf(g_failed ? "%i check(s) failed\n" : "All checks passed\n", g_failed);
+    return g_failed ? 1 : 0;
+}
@@ -1,5 +1,14 @@
 
 #include "thread_class.h"
+#include "thread_executor.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
 
 namespace su
 {
@@ -17,15 +26,60 @@ ThreadClass::~ThreadClass()
 void ThreadClass::finish()
 {
     m_command.store(Command::Finish);
+    notify();
 }
 
 void ThreadClass::restore()
 {
     m_command.store(Command::Restore);
+    notify();
+}
+
+void ThreadClass::join() const
+{
+    if (m_thread)
+    {
+        m_thread->join();
+    }
+    else if (auto executor = m_executor.load())
+    {
+        executor->join(this);
+    }
+}
+
+void ThreadClass::notify()
+{
+    wakeUp();
+
+    if (auto executor = m_executor.load())
+    {
+        executor->wake(this);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_eventMutex);
+        m_isNotified = true;
+    }
+    m_eventCV.notify_one();
 }
 
 void ThreadClass::close()
 {
+    if (auto executor = m_executor.load())
+    {
+        Status status = m_status.load();
+        if (status == Status::Paused || status == Status::Running)
+        {
+            finish();
+        }
+
+        executor->join(this);
+        m_executor.store(nullptr);
+        m_status.store(Status::Closed);
+        return;
+    }
+
     if (!m_thread)
     {
         m_status.store(Status::Closed);
@@ -36,6 +90,11 @@ void ThreadClass::close()
     if (status == Status::Paused || status == Status::Running)
     {
         finish();
+    }
+
+    // the thread finished by finish() has to be joined too
+    if (m_thread->joinable())
+    {
         m_thread->join();
     }
 
@@ -50,6 +109,7 @@ void ThreadClass::pause()
     if (m_status.load() == Status::Running)
     {
         m_command.store(Command::Pause);
+        notify();
     }
 }
 
@@ -58,38 +118,265 @@ std::thread* ThreadClass::run(size_t delay)
     close();
 
     m_delay.store(delay);
+    m_isPausedState = false;
 
     m_thread = new std::thread(ThreadClass::ThreadFunc, this); //TODO
     m_status.store(Status::Running);
     return m_thread;
 }
 
-void ThreadClass::proccesing()
+void ThreadClass::run(size_t delay, ThreadExecutor& executor)
+{
+    close();
+
+    m_delay.store(delay);
+    m_isPausedState = false;
+    m_status.store(Status::Running);
+    m_executor.store(&executor);
+
+    executor.add(this);
+}
+
+std::thread* ThreadClass::runPeriodic(std::chrono::microseconds period, const PeriodicOptions& options)
 {
-    while (1)
+    close();
+
+    if (period.count() <= 0)
     {
-        Command command = m_command.exchange(Command::None);
-        size_t delay = m_delay.load();
-        bool isPaused = false;
+        period = std::chrono::microseconds(1);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_periodicMutex);
+        m_periodSamples.clear();
+        m_periodSamples.reserve(CountOfPeriodSamples);
+        m_periodicStats = PeriodicStats();
+        m_periodSumNs = 0;
+    }
+
+    m_delay.store(std::max<size_t>(1, std::chrono::duration_cast<std::chrono::milliseconds>(period).count()));
+    m_isPausedState = false;
+
+    m_thread = new std::thread(&ThreadClass::proccesingPeriodic, this, std::chrono::nanoseconds(period), options);
+    m_status.store(Status::Running);
+    return m_thread;
+}
+
+ThreadClass::PeriodicStats ThreadClass::periodicStats() const
+{
+    std::lock_guard<std::mutex> lock(m_periodicMutex);
+
+    PeriodicStats out = m_periodicStats;
+
+    if (m_periodSamples.size())
+    {
+        auto samples = m_periodSamples;
+        auto pos = samples.begin() + (samples.size() - 1) * 99 / 100;
+
+        std::nth_element(samples.begin(), pos, samples.end());
+        out.m_p99Us = *pos / 1000.0;
+        out.m_avgUs = m_periodSumNs / 1000.0 / out.m_cycles;
+    }
+
+    return out;
+}
+
+void ThreadClass::configureRealtime(const PeriodicOptions& options)
+{
+    bool isRealtime = false;
+    bool isPinned = false;
+
+#ifdef __linux__
+    if (options.m_priority > 0)
+    {
+        sched_param param = {};
+        param.sched_priority = options.m_priority;
+        isRealtime = ::pthread_setschedparam(::pthread_self(), SCHED_FIFO, &param) == 0;
+    }
+
+    if (options.m_cpu >= 0 && options.m_cpu < CPU_SETSIZE)
+    {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(options.m_cpu, &cpus);
+        isPinned = ::pthread_setaffinity_np(::pthread_self(), sizeof(cpus), &cpus) == 0;
+    }
+#else
+    (void)options;
+#endif
+
+    std::lock_guard<std::mutex> lock(m_periodicMutex);
+    m_periodicStats.m_isRealtime = isRealtime;
+    m_periodicStats.m_isPinned = isPinned;
+}
+
+void ThreadClass::addPeriodSample(std::chrono::nanoseconds period, std::chrono::nanoseconds actual)
+{
+    int64_t ns = actual.count();
+    double jitterUs = std::abs(ns - period.count()) / 1000.0;
+
+    std::lock_guard<std::mutex> lock(m_periodicMutex);
+
+    auto& stats = m_periodicStats;
+
+    stats.m_minUs = stats.m_cycles ? std::min(stats.m_minUs, ns / 1000.0) : ns / 1000.0;
+    stats.m_maxUs = std::max(stats.m_maxUs, ns / 1000.0);
+    stats.m_maxJitterUs = std::max(stats.m_maxJitterUs, jitterUs);
+    ++stats.m_cycles;
+    m_periodSumNs += ns;
+
+    if (m_periodSamples.size() < CountOfPeriodSamples)
+    {
+        m_periodSamples.push_back(ns);
+    }
+    else
+    {
+        m_periodSamples[stats.m_cycles % CountOfPeriodSamples] = ns;
+    }
+}
+
+// The thread sleeps on the event CV, so the commands and notify() wake it at once. The last `spin` before
+// the deadline is the busy waiting. false - the thread has been woken before the deadline.
+bool ThreadClass::sleepUntil(std::chrono::steady_clock::time_point deadline, std::chrono::microseconds spin)
+{
+    {
+        std::unique_lock<std::mutex> lock(m_eventMutex);
+
+        if (m_eventCV.wait_until(lock, deadline - spin, [this]()
+        {
+            return m_isNotified || m_command.load() != Command::None;
+        }))
+        {
+            m_isNotified = false;
+            return false;
+        }
+    }
 
-        switch (command)
+    while (std::chrono::steady_clock::now() < deadline)
+    {
+    }
+    return true;
+}
+
+void ThreadClass::proccesingPeriodic(std::chrono::nanoseconds period, PeriodicOptions options)
+{
+    using Clock = std::chrono::steady_clock;
+
+    configureRealtime(options);
+
+    auto next = Clock::now() + period;
+    Clock::time_point last;
+    bool hasLast = false;
+
+    while (applyCommand())
+    {
+        if (m_isPausedState)
         {
-            case Command::Finish: m_status.store(Status::Finished); doFinished(); return;
-            case Command::Pause:  m_status.store(Status::Paused); isPaused = true; break;
-            default: break;
+            waitEvent(16, true);
+
+            next = Clock::now() + period;
+            hasLast = false;
+            continue;
         }
 
-        if (isPaused)
+        if (!sleepUntil(next, options.m_spin))
         {
-            std::this_thread::sleep_for(std::chrono::milliseconds(delay < 16 ? 16 : delay));
+            // the command is applied at once, the notified doWork() is called out of the period,
+            // so it doesn't shift the deadlines and isn't sampled
+            if (m_command.load() == Command::None)
+            {
+                doWork();
+            }
             continue;
         }
 
-        m_status.store(Status::Running);
+        auto now = Clock::now();
+        if (hasLast)
+        {
+            addPeriodSample(period, now - last);
+        }
+        last = now;
+        hasLast = true;
+
+        doWork();
+
+        next += period;
+        now = Clock::now();
+
+        if (now >= next)
+        {
+            // skip the missed cycles, but keep the phase
+            auto missed = (now - next) / period + 1;
+            next += missed * period;
+
+            std::lock_guard<std::mutex> lock(m_periodicMutex);
+            m_periodicStats.m_overruns += missed;
+        }
+    }
+}
+
+void ThreadClass::waitEvent(size_t delay, bool onlyCommands)
+{
+    std::unique_lock<std::mutex> lock(m_eventMutex);
+
+    m_eventCV.wait_for(lock, std::chrono::milliseconds(delay), [this, onlyCommands]()
+    {
+        return (m_isNotified && !onlyCommands) || m_command.load() != Command::None;
+    });
+
+    m_isNotified = false;
+}
+
+bool ThreadClass::applyCommand()
+{
+    switch (m_command.exchange(Command::None))
+    {
+        case Command::Finish:  m_status.store(Status::Finished); doFinished(); return false;
+        case Command::Pause:   m_isPausedState = true; break;
+        case Command::Restore: m_isPausedState = false; break;
+        default: break;
+    }
+
+    m_status.store(m_isPausedState ? Status::Paused : Status::Running);
+    return true;
+}
+
+ThreadClass::Status ThreadClass::step()
+{
+    if (!applyCommand())
+    {
+        return Status::Finished;
+    }
+
+    if (!m_isPausedState)
+    {
+        doWork();
+    }
+
+    return m_status.load();
+}
+
+void ThreadClass::proccesing()
+{
+    while (applyCommand())
+    {
+        size_t delay = m_delay.load();
+
+        if (m_isPausedState)
+        {
+            // The paused thread is woken up by the commands only
+            waitEvent(delay < 16 ? 16 : delay, true);
+            continue;
+        }
 
         if (delay)
         {
-            std::this_thread::sleep_for(std::chrono::milliseconds(delay));
+            waitEvent(delay, false);
+
+            if (m_command.load() != Command::None)
+            {
+                continue;
+            }
         }
 
         doWork();
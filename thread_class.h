@@ -5,12 +5,18 @@
 #include <vector>
 #include <atomic>
 #include <mutex>
+#include <condition_variable>
+#include <chrono>
 
 namespace su
 {
 
+class ThreadExecutor;
+
 class ThreadClass
 {
+    friend class ThreadExecutor;
+
 public:
     enum class Status
     {
@@ -29,6 +35,30 @@ public:
         Restore,
     };
 
+    struct PeriodicOptions
+    {
+        std::chrono::microseconds m_spin = std::chrono::microseconds(0); // busy waiting before the deadline
+        int m_priority = 0;                                               // SCHED_FIFO priority, 0 - don't change
+        int m_cpu = -1;                                                   // pin the thread to the cpu, -1 - don't pin
+    };
+
+    // The actual periods (time between the starts of doWork()) in microseconds.
+    // The p99 is calculated over the last CountOfPeriodSamples periods.
+    struct PeriodicStats
+    {
+        uint64_t m_cycles = 0;
+        uint64_t m_overruns = 0;
+        double   m_minUs = 0;
+        double   m_maxUs = 0;
+        double   m_avgUs = 0;
+        double   m_p99Us = 0;
+        double   m_maxJitterUs = 0;
+        bool     m_isRealtime = false;
+        bool     m_isPinned = false;
+    };
+
+    static constexpr size_t CountOfPeriodSamples = 4096;
+
     ThreadClass();
     virtual ~ThreadClass();
 
@@ -37,26 +67,62 @@ public:
     bool isPaused() const { return m_status.load() == Status::Paused; }
     bool isWork() const { auto status = m_status.load(); return status == Status::Running || status == Status::Paused; }
 
-    virtual void join() const { if (m_thread) m_thread->join(); }
+    virtual void join() const;
     virtual void finish();
     virtual void restore();
     virtual void close();
     virtual void pause();
 
+    // Wake up the thread: doWork() will be called without waiting of the rest of the delay.
+    // The delay of the run() is the timeout between the calls of doWork() if nobody notifies the thread.
+    void notify();
+
     virtual std::thread* run(size_t delay);
 
+    // Run without the own thread: doWork() will be called by the executor threads every `delay` msec.
+    // The commands and notify() work the same way as for the own thread.
+    virtual void run(size_t delay, ThreadExecutor& executor);
+
+    // Run with the absolute deadlines: doWork() is started every `period` regardless of its duration,
+    // so the period doesn't drift. If doWork() overruns the period, the missed cycles are skipped.
+    // The commands interrupt the waiting for the deadline, notify() calls doWork() at once out of the period.
+    virtual std::thread* runPeriodic(std::chrono::microseconds period, const PeriodicOptions& options);
+    std::thread* runPeriodic(std::chrono::microseconds period) { return runPeriodic(period, PeriodicOptions()); }
+    PeriodicStats periodicStats() const;
+
     virtual void doWork() = 0;
     virtual void doFinished() = 0;
 
 protected:
+    // It is called by notify() and the commands, the class waiting for its own events in doWork()
+    // (e.g. in a poller) wakes the waiting up
+    virtual void wakeUp() {}
+
     Command popCommand();
     void proccesing();
+    void waitEvent(size_t delay, bool onlyCommands);
+    bool applyCommand();
+    Status step();
+    void proccesingPeriodic(std::chrono::nanoseconds period, PeriodicOptions options);
+    bool sleepUntil(std::chrono::steady_clock::time_point deadline, std::chrono::microseconds spin);
+    void configureRealtime(const PeriodicOptions& options);
+    void addPeriodSample(std::chrono::nanoseconds period, std::chrono::nanoseconds actual);
 
 private:
     std::thread* m_thread = nullptr;
+    std::atomic<ThreadExecutor*> m_executor = nullptr;
+    bool m_isPausedState = false;
     std::atomic<size_t> m_delay;
     std::atomic<Status> m_status;
     std::atomic<Command> m_command;
+    std::mutex m_eventMutex;
+    std::condition_variable m_eventCV;
+    bool m_isNotified = false;
+
+    mutable std::mutex m_periodicMutex;
+    std::vector<int64_t> m_periodSamples;
+    PeriodicStats m_periodicStats;
+    int64_t m_periodSumNs = 0;
 
     static void ThreadFunc(ThreadClass*);
 };
@@ -0,0 +1,171 @@
+#include "thread_executor.h"
+#include "thread_class.h"
+
+namespace su
+{
+
+ThreadExecutor::ThreadExecutor(uint32_t numThreads)
+{
+    if (!numThreads)
+    {
+        numThreads = std::thread::hardware_concurrency();
+        numThreads = numThreads ? numThreads : 1;
+    }
+
+    m_threads.reserve(numThreads);
+
+    for (uint32_t ii = 0; ii < numThreads; ++ii)
+    {
+        m_threads.emplace_back(&ThreadExecutor::run, this);
+    }
+}
+
+ThreadExecutor::~ThreadExecutor()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_exit = true;
+    }
+    m_cv.notify_all();
+
+    for (auto& item : m_threads)
+    {
+        item.join();
+    }
+}
+
+size_t ThreadExecutor::countOfObjects() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_entries.size();
+}
+
+void ThreadExecutor::add(ThreadClass* object)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto& entry = m_entries[object];
+    schedule(object, entry, Clock::now() + std::chrono::milliseconds(object->m_delay.load()));
+}
+
+void ThreadExecutor::wake(const ThreadClass* object)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto item = m_entries.find(object);
+    if (item == m_entries.end())
+    {
+        return;
+    }
+
+    auto& entry = item->second;
+    if (entry.m_isRunning)
+    {
+        // will be rescheduled immediately after the current doWork()
+        entry.m_isWoken = true;
+        return;
+    }
+
+    auto now = Clock::now();
+    if (!entry.m_isScheduled || entry.m_due > now)
+    {
+        schedule(const_cast<ThreadClass*>(object), entry, now);
+    }
+}
+
+void ThreadExecutor::join(const ThreadClass* object)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    m_finishedCV.wait(lock, [this, object]()
+    {
+        return m_exit || m_entries.find(object) == m_entries.end();
+    });
+}
+
+void ThreadExecutor::schedule(ThreadClass* object, Entry& entry, Clock::time_point due)
+{
+    entry.m_due = due;
+    entry.m_isScheduled = true;
+    ++entry.m_generation;
+
+    bool isFirst = m_queue.empty() || due < m_queue.top().m_due;
+    m_queue.push({due, object, entry.m_generation});
+
+    if (isFirst)
+    {
+        m_cv.notify_one();
+    }
+}
+
+void ThreadExecutor::run()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    while (!m_exit)
+    {
+        if (m_queue.empty())
+        {
+            m_cv.wait(lock);
+            continue;
+        }
+
+        auto top = m_queue.top();
+        if (top.m_due > Clock::now())
+        {
+            m_cv.wait_until(lock, top.m_due);
+            continue;
+        }
+
+        m_queue.pop();
+
+        auto item = m_entries.find(top.m_object);
+        if (item == m_entries.end() || item->second.m_generation != top.m_generation)
+        {
+            // the stale item, the object has been rescheduled
+            continue;
+        }
+
+        // the reference is stable, only this thread can erase the running entry
+        auto& entry = item->second;
+        entry.m_isScheduled = false;
+        entry.m_isRunning = true;
+        entry.m_isWoken = false;
+
+        // another object may be due already
+        if (!m_queue.empty())
+        {
+            m_cv.notify_one();
+        }
+
+        lock.unlock();
+        auto status = top.m_object->step();
+        lock.lock();
+
+        entry.m_isRunning = false;
+
+        if (status == ThreadClass::Status::Finished)
+        {
+            m_entries.erase(top.m_object);
+            m_finishedCV.notify_all();
+            continue;
+        }
+
+        auto now = Clock::now();
+        bool hasCommand = top.m_object->m_command.load() != ThreadClass::Command::None;
+
+        if (entry.m_isWoken || hasCommand)
+        {
+            schedule(top.m_object, entry, now);
+        }
+        else if (status == ThreadClass::Status::Running)
+        {
+            schedule(top.m_object, entry, now + std::chrono::milliseconds(top.m_object->m_delay.load()));
+        }
+        // the paused object is waiting for the command
+    }
+
+    m_finishedCV.notify_all();
+}
+
+} // namespace su
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace su
+{
+
+class ThreadClass;
+
+// The small pool of threads calling doWork() of the many ThreadClass objects, each one at its own period.
+// The object is never processed by two threads at the same time. ThreadClass::run(delay, executor)
+// registers the object, the object is unregistered when it has been finished.
+// All registered objects must be closed before the executor is destroyed.
+class ThreadExecutor
+{
+    using Clock = std::chrono::steady_clock;
+
+    struct Entry
+    {
+        Clock::time_point m_due;
+        uint64_t m_generation = 0;
+        bool m_isScheduled = false;
+        bool m_isRunning = false;
+        bool m_isWoken = false;
+    };
+
+    struct Item
+    {
+        Clock::time_point m_due;
+        ThreadClass* m_object;
+        uint64_t m_generation;
+
+        bool operator>(const Item& other) const { return m_due > other.m_due; }
+    };
+
+public:
+    ThreadExecutor(uint32_t numThreads = 0);
+    virtual ~ThreadExecutor();
+
+    uint32_t getThreadsCount() const { return static_cast<uint32_t>(m_threads.size()); }
+    size_t countOfObjects() const;
+
+    void add(ThreadClass* object);
+    void wake(const ThreadClass* object);
+    void join(const ThreadClass* object);
+
+private:
+    void run();
+    void schedule(ThreadClass* object, Entry& entry, Clock::time_point due);
+
+private:
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::condition_variable m_finishedCV;
+    std::unordered_map<const ThreadClass*, Entry> m_entries;
+    std::priority_queue<Item, std::vector<Item>, std::greater<Item>> m_queue;
+    std::vector<std::thread> m_threads;
+    bool m_exit = false;
+};
+
+} // namespace su
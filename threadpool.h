@@ -21,6 +21,23 @@
 #include <unordered_set>
 #include <atomic>
 #include <future>
+#include <map>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#ifdef SU_THREADPOOL_STATS
+#include <sstream>
+#include <string>
+#define SU_THREADPOOL_STAT(expr) expr
+#else
+#define SU_THREADPOOL_STAT(expr)
+#endif
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#include <coroutine>
+#define SU_THREADPOOL_COROUTINES
+#endif
 
 using TaskID = uint64_t;
 using LockGuard = std::lock_guard<std::mutex>;
@@ -31,7 +48,166 @@ namespace su
 
 class ThreadPool
 {
+    struct GroupState
+    {
+        GroupState(size_t count) : m_remaining(count) {}
+
+        std::atomic<size_t> m_remaining;
+    };
+
+    // The id of the task submitted by post()
+    static constexpr TaskID UntrackedTask = ~TaskID(0);
+
+    struct Task
+    {
+        std::future<void> m_func;
+        TaskID m_id;
+        std::shared_ptr<GroupState> m_group;
+#ifdef SU_THREADPOOL_STATS
+        std::chrono::steady_clock::time_point m_queued = {};
+#endif
+    };
+
+#ifdef SU_THREADPOOL_STATS
 public:
+    // Log2 histogram of the durations, the bucket N counts durations in [2^N, 2^(N+1)) nanoseconds
+    static constexpr size_t CountOfBuckets = 32;
+
+    struct Histogram
+    {
+        uint64_t m_buckets[CountOfBuckets] = { 0 };
+        uint64_t m_count = 0;
+        uint64_t m_totalNs = 0;
+        uint64_t m_maxNs = 0;
+
+        void merge(const Histogram& other)
+        {
+            for (size_t ii = 0; ii < CountOfBuckets; ++ii)
+            {
+                m_buckets[ii] += other.m_buckets[ii];
+            }
+            m_count += other.m_count;
+            m_totalNs += other.m_totalNs;
+            m_maxNs = std::max(m_maxNs, other.m_maxNs);
+        }
+
+        // Upper bound of the bucket containing the percentile, in nanoseconds
+        uint64_t percentile(double pct) const
+        {
+            uint64_t limit = static_cast<uint64_t>(m_count * pct / 100.0);
+            uint64_t sum = 0;
+
+            for (size_t ii = 0; ii < CountOfBuckets; ++ii)
+            {
+                sum += m_buckets[ii];
+                if (sum > limit)
+                {
+                    return std::min(m_maxNs, (uint64_t(2) << ii) - 1);
+                }
+            }
+            return m_maxNs;
+        }
+    };
+
+    struct WorkerStats
+    {
+        uint64_t m_tasksExecuted = 0;
+        uint64_t m_idleNs = 0;
+        uint64_t m_contention = 0;
+        Histogram m_queueWait;
+        Histogram m_runTime;
+    };
+
+    struct Stats
+    {
+        uint64_t m_tasksSubmitted = 0;
+        uint64_t m_tasksExecuted = 0;
+        uint64_t m_idleNs = 0;
+        uint64_t m_contention = 0;
+        uint64_t m_submitContention = 0;
+        Histogram m_queueWait;
+        Histogram m_runTime;
+        std::vector<WorkerStats> m_workers;
+    };
+
+private:
+    struct AtomicHistogram
+    {
+        std::atomic<uint64_t> m_buckets[CountOfBuckets] = {};
+        std::atomic<uint64_t> m_count = 0;
+        std::atomic<uint64_t> m_totalNs = 0;
+        std::atomic<uint64_t> m_maxNs = 0;
+
+        void add(uint64_t ns)
+        {
+            size_t idx = 0;
+            for (uint64_t val = ns >> 1; val && idx < CountOfBuckets - 1; val >>= 1)
+            {
+                ++idx;
+            }
+
+            m_buckets[idx].fetch_add(1, std::memory_order_relaxed);
+            m_count.fetch_add(1, std::memory_order_relaxed);
+            m_totalNs.fetch_add(ns, std::memory_order_relaxed);
+            if (ns > m_maxNs.load(std::memory_order_relaxed))
+            {
+                m_maxNs.store(ns, std::memory_order_relaxed);
+            }
+        }
+
+        Histogram load() const
+        {
+            Histogram out;
+
+            for (size_t ii = 0; ii < CountOfBuckets; ++ii)
+            {
+                out.m_buckets[ii] = m_buckets[ii].load(std::memory_order_relaxed);
+            }
+            out.m_count = m_count.load(std::memory_order_relaxed);
+            out.m_totalNs = m_totalNs.load(std::memory_order_relaxed);
+            out.m_maxNs = m_maxNs.load(std::memory_order_relaxed);
+            return out;
+        }
+    };
+
+    // Each counter is written by the own worker only
+    struct AtomicWorkerStats
+    {
+        std::atomic<uint64_t> m_tasksExecuted = 0;
+        std::atomic<uint64_t> m_idleNs = 0;
+        std::atomic<uint64_t> m_contention = 0;
+        AtomicHistogram m_queueWait;
+        AtomicHistogram m_runTime;
+    };
+
+    static uint64_t elapsedNs(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to)
+    {
+        return to > from ? std::chrono::duration_cast<std::chrono::nanoseconds>(to - from).count() : 0;
+    }
+#endif
+
+public:
+    // The handle of the tasks submitted by the one add_tasks/submit_bulk call
+    class TaskGroup
+    {
+        friend class ThreadPool;
+
+    public:
+        TaskGroup() = default;
+
+        size_t size() const { return m_count; }
+        TaskID firstTask() const { return m_first; }
+        bool isFinished() const { return !m_state || m_state->m_remaining.load() == 0; }
+
+    private:
+        TaskGroup(const std::shared_ptr<GroupState>& state, TaskID first, size_t count)
+            : m_state(state), m_first(first), m_count(count) {}
+
+        std::shared_ptr<GroupState> m_state;
+        TaskID m_first = 0;
+        size_t m_count = 0;
+    };
+
     ThreadPool(uint32_t numThreads)
     {
         if (!numThreads)
@@ -43,10 +219,11 @@ public:
             }
         }
         m_threads.reserve(numThreads);
+        SU_THREADPOOL_STAT(m_workerStats = std::make_unique<AtomicWorkerStats[]>(numThreads));
 
         for (uint32_t ii = 0; ii < numThreads; ++ii)
         {
-            m_threads.emplace_back(&ThreadPool::run, this);
+            m_threads.emplace_back(&ThreadPool::run, this, ii);
         }
     }
 
@@ -54,6 +231,15 @@ public:
     {
         m_exit = true;
 
+        {
+            LockGuard lock(m_timerMutex);
+            m_timerCV.notify_all();
+        }
+        if (m_timerThread.joinable())
+        {
+            m_timerThread.join();
+        }
+
         for (auto& itm : m_threads)
         {
             m_queueCV.notify_all();
@@ -74,16 +260,209 @@ public:
     template <typename Func, typename ...Args>
     TaskID add_task(const Func& task_func, Args&&... args)
     {
-        LockGuard lock(m_queueMutex);
+        LockUnique lock(m_queueMutex, std::defer_lock);
+#ifdef SU_THREADPOOL_STATS
+        lockQueue(lock, &m_submitContention);
+#else
+        lock.lock();
+#endif
 
         TaskID task_idx = m_lastIndex++;
 
-        m_queue.emplace(std::async(std::launch::deferred, task_func, args...), task_idx);
-        m_queueCV.notify_one();
+        Task task{std::async(std::launch::deferred, task_func, args...), task_idx, nullptr};
+        SU_THREADPOOL_STAT(task.m_queued = std::chrono::steady_clock::now());
+        m_queue.push(std::move(task));
+
+        if (m_idleThreads)
+        {
+            m_queueCV.notify_one();
+        }
 
         return task_idx;
     }
 
+    // The task isn't tracked: it has no TaskID and isn't seen by wait()/isTaskFinished(). It is used by
+    // the timers and the coroutine awaiters which are resumed many times, so the completed ids don't pile up.
+    template <typename Func>
+    void post(Func&& task_func)
+    {
+        LockUnique lock(m_queueMutex, std::defer_lock);
+#ifdef SU_THREADPOOL_STATS
+        lockQueue(lock, &m_submitContention);
+#else
+        lock.lock();
+#endif
+        SU_THREADPOOL_STAT(m_postedTasks.fetch_add(1, std::memory_order_relaxed));
+
+        Task task{std::async(std::launch::deferred, std::forward<Func>(task_func)), UntrackedTask, nullptr};
+        SU_THREADPOOL_STAT(task.m_queued = std::chrono::steady_clock::now());
+        m_queue.push(std::move(task));
+
+        if (m_idleThreads)
+        {
+            m_queueCV.notify_one();
+        }
+    }
+
+    // Submit every callable of the range as the separated task. The queue is locked only once
+    // and only idle workers are woken up.
+    template <typename Range>
+    TaskGroup add_tasks(const Range& range)
+    {
+        std::vector<std::future<void>> funcs;
+
+        for (const auto& task_func : range)
+        {
+            funcs.push_back(std::async(std::launch::deferred, task_func));
+        }
+
+        return push_group(funcs);
+    }
+
+    // Submit `count` tasks calling task_func(index), where index is [0, count)
+    template <typename Func>
+    TaskGroup submit_bulk(size_t count, const Func& task_func)
+    {
+        std::vector<std::future<void>> funcs;
+
+        funcs.reserve(count);
+        for (size_t ii = 0; ii < count; ++ii)
+        {
+            funcs.push_back(std::async(std::launch::deferred, task_func, ii));
+        }
+
+        return push_group(funcs);
+    }
+
+    // The task will be posted to the workers (post()) when the deadline is reached. Timers pending
+    // at the moment of the pool destruction are dropped without calling.
+    template <typename Func>
+    void add_timer(std::chrono::steady_clock::time_point deadline, Func&& task_func)
+    {
+        std::call_once(m_timerOnce, [this]() { m_timerThread = std::thread(&ThreadPool::runTimers, this); });
+
+        LockGuard lock(m_timerMutex);
+
+        auto item = m_timers.emplace(deadline, std::forward<Func>(task_func));
+        if (item == m_timers.begin())
+        {
+            m_timerCV.notify_one();
+        }
+    }
+
+#ifdef SU_THREADPOOL_COROUTINES
+    // co_await pool.schedule() - continue the coroutine on the one of the pool workers
+    class ScheduleAwaiter
+    {
+    public:
+        explicit ScheduleAwaiter(ThreadPool& pool) : m_pool(pool) {}
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> handle) { m_pool.post([handle]() { handle.resume(); }); }
+        void await_resume() const noexcept {}
+
+    private:
+        ThreadPool& m_pool;
+    };
+
+    // co_await pool.sleep_for(...) - continue the coroutine on the pool worker after the delay,
+    // the worker is not blocked while the coroutine is sleeping
+    class SleepAwaiter
+    {
+    public:
+        SleepAwaiter(ThreadPool& pool, std::chrono::steady_clock::time_point deadline) : m_pool(pool), m_deadline(deadline) {}
+
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> handle) { m_pool.add_timer(m_deadline, [handle]() { handle.resume(); }); }
+        void await_resume() const noexcept {}
+
+    private:
+        ThreadPool& m_pool;
+        std::chrono::steady_clock::time_point m_deadline;
+    };
+
+    ScheduleAwaiter schedule()
+    {
+        return ScheduleAwaiter(*this);
+    }
+
+    template <typename Rep, typename Period>
+    SleepAwaiter sleep_for(const std::chrono::duration<Rep, Period>& delay)
+    {
+        return SleepAwaiter(*this, std::chrono::steady_clock::now() +
+                                   std::chrono::duration_cast<std::chrono::steady_clock::duration>(delay));
+    }
+
+    SleepAwaiter sleep_until(std::chrono::steady_clock::time_point deadline)
+    {
+        return SleepAwaiter(*this, deadline);
+    }
+#endif
+
+#ifdef SU_THREADPOOL_STATS
+    Stats getStats() const
+    {
+        Stats out;
+
+        out.m_tasksSubmitted = m_lastIndex.load() + m_postedTasks.load(std::memory_order_relaxed);
+        out.m_submitContention = m_submitContention.load(std::memory_order_relaxed);
+
+        for (size_t ii = 0; ii < m_threads.size(); ++ii)
+        {
+            const auto& worker = m_workerStats[ii];
+            WorkerStats item;
+
+            item.m_tasksExecuted = worker.m_tasksExecuted.load(std::memory_order_relaxed);
+            item.m_idleNs = worker.m_idleNs.load(std::memory_order_relaxed);
+            item.m_contention = worker.m_contention.load(std::memory_order_relaxed);
+            item.m_queueWait = worker.m_queueWait.load();
+            item.m_runTime = worker.m_runTime.load();
+
+            out.m_tasksExecuted += item.m_tasksExecuted;
+            out.m_idleNs += item.m_idleNs;
+            out.m_contention += item.m_contention;
+            out.m_queueWait.merge(item.m_queueWait);
+            out.m_runTime.merge(item.m_runTime);
+            out.m_workers.push_back(item);
+        }
+
+        return out;
+    }
+
+    std::string dumpStats() const
+    {
+        auto stats = getStats();
+        std::ostringstream out;
+
+        auto dumpHistogram = [&out](const char* name, const Histogram& hist)
+        {
+            out << "  " << name << ": count " << hist.m_count
+                << ", avg " << (hist.m_count ? hist.m_totalNs / hist.m_count : 0) << " ns"
+                << ", p50 " << hist.percentile(50.0) << " ns"
+                << ", p99 " << hist.percentile(99.0) << " ns"
+                << ", max " << hist.m_maxNs << " ns\n";
+        };
+
+        out << "ThreadPool: " << m_threads.size() << " workers, submitted " << stats.m_tasksSubmitted
+            << ", executed " << stats.m_tasksExecuted << ", idle " << stats.m_idleNs / 1000000 << " ms"
+            << ", contention " << stats.m_contention << "/" << stats.m_submitContention << " (workers/submit)\n";
+        dumpHistogram("queue wait", stats.m_queueWait);
+        dumpHistogram("run time", stats.m_runTime);
+
+        for (size_t ii = 0; ii < stats.m_workers.size(); ++ii)
+        {
+            const auto& worker = stats.m_workers[ii];
+
+            out << "  worker " << ii << ": executed " << worker.m_tasksExecuted
+                << ", idle " << worker.m_idleNs / 1000000 << " ms"
+                << ", contention " << worker.m_contention
+                << ", run avg " << (worker.m_runTime.m_count ? worker.m_runTime.m_totalNs / worker.m_runTime.m_count : 0) << " ns\n";
+        }
+
+        return out.str();
+    }
+#endif
+
     void wait(TaskID task_id)
     {
         LockUnique lock(m_completedTaskMutex);
@@ -94,6 +473,21 @@ public:
         });
     }
 
+    void wait(const TaskGroup& group)
+    {
+        if (!group.m_state)
+        {
+            return;
+        }
+
+        LockUnique lock(m_completedTaskMutex);
+
+        m_completedTaskCV.wait(lock, [&group]()->bool
+        {
+            return group.m_state->m_remaining.load() == 0;
+        });
+    }
+
     void wait_all()
     {
         LockUnique lock(m_queueMutex);
@@ -117,13 +511,84 @@ public:
     }
 
 private:
-    void run()
+    TaskGroup push_group(std::vector<std::future<void>>& funcs)
+    {
+        if (funcs.empty())
+        {
+            return {};
+        }
+
+        auto state = std::make_shared<GroupState>(funcs.size());
+        uint32_t idle = 0;
+        TaskID first = 0;
+
+        {
+            LockUnique lock(m_queueMutex, std::defer_lock);
+#ifdef SU_THREADPOOL_STATS
+            lockQueue(lock, &m_submitContention);
+#else
+            lock.lock();
+#endif
+            SU_THREADPOOL_STAT(auto queued = std::chrono::steady_clock::now());
+
+            first = m_lastIndex.fetch_add(funcs.size());
+
+            for (size_t ii = 0; ii < funcs.size(); ++ii)
+            {
+                Task task{std::move(funcs[ii]), first + ii, state};
+                SU_THREADPOOL_STAT(task.m_queued = queued);
+                m_queue.push(std::move(task));
+            }
+
+            idle = m_idleThreads;
+        }
+
+        if (funcs.size() >= idle)
+        {
+            m_queueCV.notify_all();
+        }
+        else
+        {
+            for (size_t ii = 0; ii < funcs.size(); ++ii)
+            {
+                m_queueCV.notify_one();
+            }
+        }
+
+        return TaskGroup(state, first, funcs.size());
+    }
+
+#ifdef SU_THREADPOOL_STATS
+    void lockQueue(LockUnique& lock, std::atomic<uint64_t>* contention)
+    {
+        if (!lock.try_lock())
+        {
+            contention->fetch_add(1, std::memory_order_relaxed);
+            lock.lock();
+        }
+    }
+#endif
+
+    void run(uint32_t index)
     {
+        SU_THREADPOOL_STAT(auto& stats = m_workerStats[index]);
+        (void)index;
+
         while (!m_exit)
         {
-            LockUnique lock(m_queueMutex);
+            LockUnique lock(m_queueMutex, std::defer_lock);
+#ifdef SU_THREADPOOL_STATS
+            lockQueue(lock, &stats.m_contention);
+#else
+            lock.lock();
+#endif
 
+            SU_THREADPOOL_STAT(auto idleStart = std::chrono::steady_clock::now());
+            ++m_idleThreads;
             m_queueCV.wait(lock, [this]()->bool { return !m_queue.empty() || m_exit; });
+            --m_idleThreads;
+            SU_THREADPOOL_STAT(auto runStart = std::chrono::steady_clock::now());
+            SU_THREADPOOL_STAT(stats.m_idleNs.fetch_add(elapsedNs(idleStart, runStart), std::memory_order_relaxed));
 
             if (m_exit)
             {
@@ -136,19 +601,69 @@ private:
                 m_queue.pop();
                 lock.unlock();
 
-                elem.first.get();
+                elem.m_func.get();
+
+#ifdef SU_THREADPOOL_STATS
+                stats.m_queueWait.add(elapsedNs(elem.m_queued, runStart));
+                stats.m_runTime.add(elapsedNs(runStart, std::chrono::steady_clock::now()));
+                stats.m_tasksExecuted.fetch_add(1, std::memory_order_relaxed);
+#endif
 
                 LockGuard lock_result(m_completedTaskMutex);
-                m_completedTask.insert(elem.second);
+                if (elem.m_id != UntrackedTask)
+                {
+                    m_completedTask.insert(elem.m_id);
+                }
+
+                if (elem.m_group)
+                {
+                    --elem.m_group->m_remaining;
+                }
 
                 m_completedTaskCV.notify_all();
             }
         }
     }
 
-    std::queue<std::pair<std::future<void>, TaskID>> m_queue;
+    void runTimers()
+    {
+        LockUnique lock(m_timerMutex);
+
+        while (!m_exit)
+        {
+            if (m_timers.empty())
+            {
+                m_timerCV.wait(lock, [this]()->bool { return !m_timers.empty() || m_exit; });
+                continue;
+            }
+
+            auto first = m_timers.begin();
+            if (first->first > std::chrono::steady_clock::now())
+            {
+                m_timerCV.wait_until(lock, first->first);
+                continue;
+            }
+
+            auto task_func = std::move(first->second);
+            m_timers.erase(first);
+            lock.unlock();
+
+            post(std::move(task_func));
+
+            lock.lock();
+        }
+    }
+
+    std::queue<Task> m_queue;
     std::mutex m_queueMutex;
     std::condition_variable m_queueCV;
+    uint32_t m_idleThreads = 0;
+
+#ifdef SU_THREADPOOL_STATS
+    std::unique_ptr<AtomicWorkerStats[]> m_workerStats;
+    std::atomic<uint64_t> m_submitContention = 0;
+    std::atomic<uint64_t> m_postedTasks = 0;
+#endif
 
     std::unordered_set<TaskID> m_completedTask;
     std::mutex m_completedTaskMutex;
@@ -156,6 +671,12 @@ private:
 
     std::vector<std::thread> m_threads;
 
+    std::multimap<std::chrono::steady_clock::time_point, std::function<void()>> m_timers;
+    std::mutex m_timerMutex;
+    std::condition_variable m_timerCV;
+    std::once_flag m_timerOnce;
+    std::thread m_timerThread;
+
     std::atomic<bool> m_exit = false;
     std::atomic<TaskID> m_lastIndex = 0;
 };